@@ -0,0 +1,458 @@
+#ifndef SYLAR_SYLAR_CHANNEL_H_
+#define SYLAR_SYLAR_CHANNEL_H_
+
+#include <memory>
+#include <deque>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <cerrno>
+
+#include "fiber_sync.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+#include "noncopyable.h"
+#include "thread.h"
+#include "util.h"
+
+namespace sylar {
+
+/*
+ * 协程间传递消息的通道
+ * capacity为0时是无界通道, 否则通道满时send挂起, 通道空时recv挂起
+ * 在调度协程中挂起的是协程(线程可以继续调度其他协程), 在普通线程中挂起的是线程
+ * timeout_ms为-1表示一直等待, 为0表示不等待
+ * */
+template <typename T>
+class Channel : public NonCopyable {
+ public:
+  using ptr = std::shared_ptr<Channel>;
+  using MutexType = Mutex;
+
+  explicit Channel(size_t capacity = 0) : m_capacity(capacity) {}
+
+  // 发送成功返回true, 通道关闭或者超时返回false
+  bool send(const T& v, uint64_t timeout_ms = -1) {
+    T tmp(v);
+    return sendImpl(tmp, timeout_ms);
+  }
+
+  bool send(T&& v, uint64_t timeout_ms = -1) {
+    return sendImpl(v, timeout_ms);
+  }
+
+  // 接收成功返回true, 通道关闭且为空或者超时返回false
+  bool recv(T& v, uint64_t timeout_ms = -1) {
+    uint64_t deadline = Deadline(timeout_ms);
+    while (true) {
+      FiberWaiter::ptr waiter;
+      {
+        MutexType::Lock lock(m_mutex);
+        if (popNoLock(v)) {
+          return true;
+        }
+        if (m_closed || timeout_ms == 0) {
+          return false;
+        }
+        waiter = std::make_shared<FiberWaiter>();
+        m_recvWaiters.push_back(waiter);
+      }
+      if (!wait(waiter, deadline, m_recvWaiters)) {
+        return false;
+      }
+    }
+  }
+
+  bool trySend(const T& v) {return send(v, 0);}
+  bool trySend(T&& v) {return send(std::move(v), 0);}
+  bool tryRecv(T& v) {return recv(v, 0);}
+
+  // 关闭通道, 唤醒所有等待者; 已经在通道中的数据仍然可以被recv
+  void close() {
+    std::list<FiberWaiter::ptr> waiters;
+    {
+      MutexType::Lock lock(m_mutex);
+      if (m_closed) {
+        return;
+      }
+      m_closed = true;
+      waiters.swap(m_sendWaiters);
+      waiters.splice(waiters.end(), m_recvWaiters);
+    }
+    for (auto& i : waiters) {
+      i->notify();
+    }
+  }
+
+  bool isClosed() {
+    MutexType::Lock lock(m_mutex);
+    return m_closed;
+  }
+
+  size_t size() {
+    MutexType::Lock lock(m_mutex);
+    return m_queue.size();
+  }
+
+  size_t getCapacity() const {return m_capacity;}
+
+  /*
+   * 在多个通道上等待接收, 返回收到数据的通道下标
+   * 超时或者所有通道都已关闭且为空时返回-1
+   * */
+  static int Select(const std::vector<ptr>& chans, T& v, uint64_t timeout_ms = -1) {
+    static std::atomic<uint32_t> s_start {0};
+    uint64_t deadline = Deadline(timeout_ms);
+    if (chans.empty()) {
+      return -1;
+    }
+    // 等待者被某个通道唤醒过, 取走的可能是另一个通道的数据
+    bool woken = false;
+    while (true) {
+      auto waiter = std::make_shared<FiberWaiter>();
+      size_t closed = 0;
+      size_t start = s_start++ % chans.size(); // 轮流作为起点, 避免总是偏向第一个通道
+      for (size_t n = 0; n < chans.size(); ++n) {
+        size_t idx = (start + n) % chans.size();
+        auto& c = chans[idx];
+        MutexType::Lock lock(c->m_mutex);
+        if (c->popNoLock(v)) {
+          lock.unlock();
+          for (size_t k = 0; k < n; ++k) {
+            auto& prev = chans[(start + k) % chans.size()];
+            prev->removeWaiter(prev->m_recvWaiters, waiter);
+          }
+          if (!waiter->cancel()) {
+            // 前面登记过的通道已经唤醒了我们, 要把这次唤醒消费掉
+            waiter->wait();
+            woken = true;
+          }
+          if (woken) {
+            // 唤醒我们的通道的数据可能还在, 把唤醒转给它的其他等待者, 否则它们会一直挂起
+            RenotifyOthers(chans, idx);
+          }
+          return idx;
+        }
+        if (c->m_closed) {
+          ++closed;
+        } else if (timeout_ms != 0) {
+          c->m_recvWaiters.push_back(waiter);
+        }
+      }
+      if (closed == chans.size() || timeout_ms == 0) {
+        return -1;
+      }
+
+      int rt = waiter->waitFor(Remaining(deadline));
+      for (auto& c : chans) {
+        c->removeWaiter(c->m_recvWaiters, waiter);
+      }
+      if (rt == ETIMEDOUT) {
+        return -1;
+      }
+      woken = true;
+    }
+  }
+
+ private:
+  bool sendImpl(T& v, uint64_t timeout_ms) {
+    uint64_t deadline = Deadline(timeout_ms);
+    while (true) {
+      FiberWaiter::ptr waiter;
+      {
+        MutexType::Lock lock(m_mutex);
+        if (m_closed) {
+          return false;
+        }
+        if (!m_capacity || m_queue.size() < m_capacity) {
+          m_queue.push_back(std::move(v));
+          notifyOneNoLock(m_recvWaiters);
+          return true;
+        }
+        if (timeout_ms == 0) {
+          return false;
+        }
+        waiter = std::make_shared<FiberWaiter>();
+        m_sendWaiters.push_back(waiter);
+      }
+      if (!wait(waiter, deadline, m_sendWaiters)) {
+        return false;
+      }
+    }
+  }
+
+  bool popNoLock(T& v) {
+    if (m_queue.empty()) {
+      return false;
+    }
+    v = std::move(m_queue.front());
+    m_queue.pop_front();
+    notifyOneNoLock(m_sendWaiters);
+    return true;
+  }
+
+  // 除了idx之外还有数据的通道, 各唤醒一个接收者; 多余的唤醒只会让等待者重新检查一遍
+  static void RenotifyOthers(const std::vector<ptr>& chans, size_t idx) {
+    for (size_t i = 0; i < chans.size(); ++i) {
+      if (i == idx) {
+        continue;
+      }
+      MutexType::Lock lock(chans[i]->m_mutex);
+      if (!chans[i]->m_queue.empty()) {
+        notifyOneNoLock(chans[i]->m_recvWaiters);
+      }
+    }
+  }
+
+  // 唤醒第一个还在等待的等待者(跳过已经超时或者被其他通道唤醒的)
+  static void notifyOneNoLock(std::list<FiberWaiter::ptr>& waiters) {
+    while (!waiters.empty()) {
+      FiberWaiter::ptr w = waiters.front();
+      waiters.pop_front();
+      if (w->notify()) {
+        return;
+      }
+    }
+  }
+
+  void removeWaiter(std::list<FiberWaiter::ptr>& waiters, const FiberWaiter::ptr& w) {
+    MutexType::Lock lock(m_mutex);
+    waiters.remove(w);
+  }
+
+  // 挂起等待, 超时返回false
+  bool wait(const FiberWaiter::ptr& waiter, uint64_t deadline,
+            std::list<FiberWaiter::ptr>& waiters) {
+    Fiber::SetWaitReason(Fiber::WAIT_CHANNEL);
+    if (waiter->waitFor(Remaining(deadline)) == ETIMEDOUT) {
+      removeWaiter(waiters, waiter);
+      return false;
+    }
+    return true;
+  }
+
+  static uint64_t Deadline(uint64_t timeout_ms) {
+    if (timeout_ms == (uint64_t)-1 || timeout_ms == 0) {
+      return timeout_ms;
+    }
+    return GetCurrentMS() + timeout_ms;
+  }
+
+  static uint64_t Remaining(uint64_t deadline) {
+    if (deadline == (uint64_t)-1) {
+      return -1;
+    }
+    uint64_t now = GetCurrentMS();
+    return deadline > now ? deadline - now : 0;
+  }
+
+ private:
+  MutexType m_mutex;
+  size_t m_capacity = 0;
+  bool m_closed = false;
+  std::deque<T> m_queue;
+  std::list<FiberWaiter::ptr> m_sendWaiters;
+  std::list<FiberWaiter::ptr> m_recvWaiters;
+};
+
+/*
+ * 单生产者单消费者的有界通道
+ * 数据的收发是无锁的环形队列, 只有在队列满/空需要挂起时才会和对端交互一个原子变量
+ * 同一时刻只能有一个发送者和一个接收者
+ * */
+template <typename T>
+class SPSCChannel : public NonCopyable {
+ public:
+  using ptr = std::shared_ptr<SPSCChannel>;
+
+  // 最多容纳capacity个元素(至少为1), 环形数组的大小取不小于capacity+1的2的幂
+  explicit SPSCChannel(size_t capacity = 1024)
+      : m_capacity(capacity ? capacity : 1),
+        m_sendParker(std::make_shared<Parker>()),
+        m_recvParker(std::make_shared<Parker>()) {
+    size_t size = 2;
+    while (size < m_capacity + 1) {
+      size <<= 1;
+    }
+    m_mask = size - 1;
+    m_buffer.resize(size);
+  }
+
+  bool trySend(const T& v) {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t next = (tail + 1) & m_mask;
+    if (((tail - m_head.load(std::memory_order_acquire)) & m_mask) >= m_capacity) {
+      return false;
+    }
+    m_buffer[tail] = v;
+    m_tail.store(next, std::memory_order_release);
+    m_recvParker->unpark();
+    return true;
+  }
+
+  bool tryRecv(T& v) {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    v = std::move(m_buffer[head]);
+    m_head.store((head + 1) & m_mask, std::memory_order_release);
+    m_sendParker->unpark();
+    return true;
+  }
+
+  // 发送成功返回true, 通道关闭或者超时返回false
+  bool send(const T& v, uint64_t timeout_ms = -1) {
+    uint64_t deadline = timeout_ms == (uint64_t)-1 ? -1 : GetCurrentMS() + timeout_ms;
+    while (true) {
+      if (m_closed.load(std::memory_order_acquire)) {
+        return false;
+      }
+      if (trySend(v)) {
+        return true;
+      }
+      if (!m_sendParker->park(deadline, [this]() {
+            return !full() || m_closed.load(std::memory_order_acquire);
+          })) {
+        return false;
+      }
+    }
+  }
+
+  // 接收成功返回true, 通道关闭且为空或者超时返回false
+  bool recv(T& v, uint64_t timeout_ms = -1) {
+    uint64_t deadline = timeout_ms == (uint64_t)-1 ? -1 : GetCurrentMS() + timeout_ms;
+    while (true) {
+      if (tryRecv(v)) {
+        return true;
+      }
+      if (m_closed.load(std::memory_order_acquire)) {
+        // 关闭前发送的数据仍然要被取走
+        return tryRecv(v);
+      }
+      if (!m_recvParker->park(deadline, [this]() {
+            return !empty() || m_closed.load(std::memory_order_acquire);
+          })) {
+        return false;
+      }
+    }
+  }
+
+  void close() {
+    m_closed.store(true, std::memory_order_release);
+    m_sendParker->unpark();
+    m_recvParker->unpark();
+  }
+
+  bool isClosed() const {return m_closed.load(std::memory_order_acquire);}
+  bool empty() const {
+    return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+  }
+  bool full() const {
+    return ((m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire))
+        & m_mask) >= m_capacity;
+  }
+  size_t getCapacity() const {return m_capacity;}
+
+ private:
+  /*
+   * 一端挂起时登记的票据, 0表示没有挂起
+   * 对端(或者超时定时器)通过原子交换取走票据, 取走票据的一方负责唤醒, 保证只唤醒一次
+   * */
+  struct Parker : public std::enable_shared_from_this<Parker> {
+    std::atomic<uint64_t> ticket {0};
+    uint64_t generation = 0;
+    bool timedout = false;
+    Scheduler* scheduler = nullptr;
+    Fiber::ptr fiber;
+    Semaphore semaphore;
+
+    void wake() {
+      if (scheduler) {
+        Scheduler* s = scheduler;
+        Fiber::ptr f = fiber;
+        s->schedule(f);
+      } else {
+        semaphore.notify();
+      }
+    }
+
+    void unpark() {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (ticket.load(std::memory_order_relaxed) && ticket.exchange(0)) {
+        wake();
+      }
+    }
+
+    // ready在登记票据后再检查一次, 避免对端在登记之前已经放入/取走数据而丢失唤醒
+    template <typename Ready>
+    bool park(uint64_t deadline, Ready ready) {
+      uint64_t now = GetCurrentMS();
+      if (deadline != (uint64_t)-1 && now >= deadline) {
+        return false;
+      }
+      bool can_yield = FiberWaiter::CanYield();
+      scheduler = can_yield ? Scheduler::GetThis() : nullptr;
+      fiber = can_yield ? Fiber::GetThis() : nullptr;
+      timedout = false;
+      uint64_t t = ++generation;
+      // release: 对端exchange拿到票据后要能看到上面写的scheduler/fiber/timedout
+      ticket.store(t, std::memory_order_release);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (ready()) {
+        uint64_t expected = t;
+        if (ticket.compare_exchange_strong(expected, 0)) {
+          fiber.reset();
+          return true;
+        }
+        // 对端已经取走票据, 必须消费掉这次唤醒
+      }
+      if (can_yield) {
+        Timer::ptr timer;
+        if (deadline != (uint64_t)-1) {
+          IOManager* iom = IOManager::GetThis();
+          SYLAR_ASSERT2(iom, "SPSCChannel timeout needs an IOManager");
+          std::weak_ptr<Parker> weak(this->shared_from_this());
+          timer = iom->addConditionalTimer(deadline - now, [this, t]() {
+              uint64_t expected = t;
+              if (ticket.compare_exchange_strong(expected, 0)) {
+                timedout = true;
+                wake();
+              }
+            }, weak);
+        }
+        Fiber::SetWaitReason(Fiber::WAIT_CHANNEL);
+        Fiber::YieldToHold();
+        if (timer) {
+          timer->cancel();
+        }
+      } else if (deadline == (uint64_t)-1) {
+        semaphore.wait();
+      } else if (!semaphore.waitFor(deadline - now)) {
+        uint64_t expected = t;
+        if (ticket.compare_exchange_strong(expected, 0)) {
+          timedout = true;
+        } else {
+          semaphore.wait();
+        }
+      }
+      fiber.reset();
+      return !timedout;
+    }
+  };
+
+ private:
+  std::atomic<size_t> m_head {0};
+  std::atomic<size_t> m_tail {0};
+  std::atomic<bool> m_closed {false};
+  size_t m_capacity;
+  size_t m_mask = 0;
+  std::vector<T> m_buffer;
+  std::shared_ptr<Parker> m_sendParker;
+  std::shared_ptr<Parker> m_recvParker;
+};
+
+}
+
+#endif //SYLAR_SYLAR_CHANNEL_H_
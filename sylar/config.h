@@ -5,6 +5,7 @@
 #ifndef SYLAR_SYLAR_CONFIG_H_
 #define SYLAR_SYLAR_CONFIG_H_
 
+#include <atomic>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -13,12 +14,14 @@
 #include <unordered_map>
 #include <map>
 #include <functional>
+#include <vector>
 
 #include <boost/lexical_cast.hpp>
 #include <yaml-cpp/yaml.h>
 
 #include "log.h"
 #include "thread.h"
+#include "rcu.h"
 
 namespace sylar {
 
@@ -246,23 +249,28 @@ template<typename T, typename FromStr = LexicalCast<std::string, T>, typename To
 class ConfigVar : public ConfigVarBase {
  public:
   using RWMutexType = RWMutex;
+  using MutexType = Mutex;
   using ptr = std::shared_ptr<ConfigVar>;
   using on_change_cb = std::function<void (const T& old_value, const T& new_value)>;
 
   ConfigVar(const std::string& name,
 			const T& default_value,
 			const std::string& description = "")
-			: ConfigVarBase(name, description),
-			m_val(default_value) {}
+			: ConfigVarBase(name, description) {
+    m_val.store(new T(default_value));
+  }
+
+  ~ConfigVar() {
+    delete m_val.load();
+  }
 
   std::string toString() override {
 	try {
 	  // return boost::lexical_cast<std::string>(m_val);
-	  RWMutexType::ReadLock lock(m_mutex);
-	  return ToStr()(m_val);
+	  return ToStr()(*getValue());
 	} catch (std::exception& e) {
 	  SYLAR_LOG_ERROR(SYLAR_LOG_ROOT()) << "ConfigVar::toString exception" <<
-	  e.what() << " convert: " << typeid(m_val).name() << " to string ";
+	  e.what() << " convert: " << typeid(T).name() << " to string ";
 	}
 	return "";
   }
@@ -274,29 +282,56 @@ class ConfigVar : public ConfigVarBase {
 	  return true;
 	} catch (std::exception& e) {
 	  SYLAR_LOG_ERROR(SYLAR_LOG_ROOT()) << "ConfigVar::toString exception" <<
-										e.what() << " convert: string to " << typeid(m_val).name();
+										e.what() << " convert: string to " << typeid(T).name();
 	}
 	return false;
   }
 
-  const T& getValue() {
-    RWMutexType::ReadLock lock(m_mutex);
-    return m_val;
+  /*
+   * 读到的一个版本, 持有期间这个版本不会被释放, 不拷贝值
+   * 每个版本都是不可变的, 修改时发布新版本, 旧版本等读者都离开后回收
+   * 只在需要的范围内持有, 持有太久会推迟旧版本的回收
+   * */
+  class Snapshot {
+   public:
+    explicit Snapshot(const std::atomic<const T*>& val)
+        : m_ptr(val.load()) {
+    }
+    const T& operator*() const {return *m_ptr;}
+    const T* operator->() const {return m_ptr;}
+    const T* get() const {return m_ptr;}
+    T copy() const {return *m_ptr;}
+   private:
+    Rcu::ReadGuard m_guard; // 必须先于m_ptr构造
+    const T* m_ptr;
+  };
+
+  // 读当前值, 不加锁不等待; 要拷贝时用*getValue()或getValue().copy()
+  // 不提供到const T&的隐式转换, 快照是临时对象, 绑定引用会在语句结束后悬空
+  Snapshot getValue() const {
+    return Snapshot(m_val);
   }
 
+  // 先发布新版本, 再调用监听函数, 监听函数里getValue()得到的是新值
   void setValue(const T& v) {
-	{
-	  RWMutexType::ReadLock lock(m_mutex);
-	  if (v == m_val) {
-		return;
-	  }
-	  // 事件回调将在数值改变时被调用
-	  for (auto& i : m_cbs) {
-		(i.second)(m_val, v);
-	  }
+    MutexType::Lock lock(m_writeMutex);
+    const T* old_value = m_val.load();
+    if (v == *old_value) {
+      return;
+    }
+    const T* new_value = new T(v);
+    std::map<uint64_t, on_change_cb> cbs;
+    {
+      RWMutexType::ReadLock lock2(m_mutex);
+      cbs = m_cbs;
+    }
+    m_val.store(new_value);
+	// 事件回调将在数值改变时被调用, 不持有m_mutex, 回调里可以增删监听
+	for (auto& i : cbs) {
+	  (i.second)(*old_value, *new_value);
 	}
-	RWMutexType::WriteLock lock(m_mutex);
-	m_val = v;
+    // 回调结束后再退休, 旧版本在回调里一直有效
+    Rcu::Retire(old_value);
   }
 
   std::string getTypeName() const override {return typeid(T).name();}
@@ -326,8 +361,9 @@ class ConfigVar : public ConfigVarBase {
 	return it == m_cbs.end() ? nullptr : it->second;
   }
  private:
-  RWMutexType m_mutex;
-  T m_val;
+  RWMutexType m_mutex;  // 保护m_cbs
+  MutexType m_writeMutex; // 串行化setValue, 保证监听函数按修改的顺序调用
+  std::atomic<const T*> m_val; // 当前版本, 只有setValue会换掉它
   std::map<uint64_t, on_change_cb> m_cbs; // 变更回调函数组, key, 要求唯一,一般用hash
 };
 
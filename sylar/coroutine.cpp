@@ -0,0 +1,233 @@
+#include "coroutine.h"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include "fd_manager.h"
+#include "hook.h"
+#include "log.h"
+#include "macro.h"
+
+#include <cerrno>
+#include <sched.h>
+#include <cstring>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+bool IoAwaiter::await_suspend(std::coroutine_handle<> h) {
+  IOManager* iom = IOManager::GetThis();
+  SYLAR_ASSERT2(iom, "IoAwaiter must run inside an IOManager");
+  auto state = std::make_shared<State>();
+  m_state = state;
+  int fd = m_fd;
+  IOManager::Event event = m_event;
+
+  if (m_timeout != (uint64_t)-1) {
+    std::weak_ptr<State> weak(state);
+    state->timer = iom->addConditionalTimer(m_timeout, [weak, fd, event, iom]() {
+        auto t = weak.lock();
+        if (!t) {
+          return;
+        }
+        int expected = 0;
+        if (!t->cancelled.compare_exchange_strong(expected, ETIMEDOUT)) {
+          return;
+        }
+        iom->cancelEvent(fd, event);
+        t->settled.store(true, std::memory_order_release);
+      }, weak);
+  }
+
+  errno = 0;
+  if (iom->addEvent(fd, event, [h]() {h.resume();})) {
+    if (state->timer) {
+      state->timer->cancel();
+    }
+    m_error = errno ? errno : EINVAL;
+    return false;
+  }
+  // 事件可能已经在其他线程触发并恢复了协程, 从这里开始不能再访问成员
+  return true;
+}
+
+int IoAwaiter::await_resume() {
+  if (m_error) {
+    return m_error;
+  }
+  if (m_state->timer) {
+    m_state->timer->cancel();
+  }
+  int expected = 0;
+  if (m_state->cancelled.compare_exchange_strong(expected, -1)) {
+    return 0;
+  }
+  // 超时一方还在cancelEvent里, 等它结束, 免得取消掉同一个fd上下一次co_await注册的事件
+  while (!m_state->settled.load(std::memory_order_acquire)) {
+    sched_yield();
+  }
+  return expected;
+}
+
+void SleepAwaiter::await_suspend(std::coroutine_handle<> h) {
+  IOManager* iom = IOManager::GetThis();
+  SYLAR_ASSERT2(iom, "SleepAwaiter must run inside an IOManager");
+  iom->addTimer(m_ms, [h]() {h.resume();});
+}
+
+Task<int> async_recv(Socket::ptr sock, void* buffer, size_t length, int flags) {
+  int fd = sock->getSocket();
+  FdMgr::GetInstance()->get(fd, true); // 保证fd是非阻塞的
+  uint64_t timeout = sock->getRecvTimeout();
+  while (true) {
+    ssize_t n = recv_f(fd, buffer, length, flags);
+    if (n >= 0) {
+      co_return (int)n;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN) {
+      co_return -1;
+    }
+    int rt = co_await readable(fd, timeout);
+    if (rt) {
+      errno = rt;
+      co_return -1;
+    }
+  }
+}
+
+Task<int> async_send(Socket::ptr sock, const void* buffer, size_t length, int flags) {
+  int fd = sock->getSocket();
+  FdMgr::GetInstance()->get(fd, true);
+  uint64_t timeout = sock->getSendTimeout();
+  while (true) {
+    ssize_t n = send_f(fd, buffer, length, flags);
+    if (n >= 0) {
+      co_return (int)n;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN) {
+      co_return -1;
+    }
+    int rt = co_await writable(fd, timeout);
+    if (rt) {
+      errno = rt;
+      co_return -1;
+    }
+  }
+}
+
+Task<Socket::ptr> async_accept(Socket::ptr sock) {
+  int fd = sock->getSocket();
+  FdMgr::GetInstance()->get(fd, true);
+  uint64_t timeout = sock->getRecvTimeout();
+  while (true) {
+    int newsock = accept_f(fd, nullptr, nullptr);
+    if (newsock >= 0) {
+      FdMgr::GetInstance()->get(newsock, true);
+      auto client = std::make_shared<Socket>(sock->getFamily(), sock->getType(), sock->getProtocol());
+      if (client->init(newsock)) {
+        co_return client;
+      }
+      FdMgr::GetInstance()->del(newsock);
+      close_f(newsock);
+      co_return nullptr;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN) {
+      SYLAR_LOG_ERROR(g_logger) << "async_accept(" << fd << ") errno="
+          << errno << " errstr=" << strerror(errno);
+      co_return nullptr;
+    }
+    int rt = co_await readable(fd, timeout);
+    if (rt) {
+      errno = rt;
+      co_return nullptr;
+    }
+  }
+}
+
+Task<bool> async_connect(Socket::ptr sock, Address::ptr addr, uint64_t timeout_ms) {
+  int fd = sock->getSocket();
+  bool created = false;
+  if (!sock->isValid()) {
+    fd = socket_f(sock->getFamily(), sock->getType(), sock->getProtocol());
+    if (fd == -1) {
+      SYLAR_LOG_ERROR(g_logger) << "async_connect socket() errno="
+          << errno << " errstr=" << strerror(errno);
+      co_return false;
+    }
+    created = true;
+  }
+  FdMgr::GetInstance()->get(fd, true);
+
+  int rt = connect_f(fd, addr->getAddr(), addr->getAddrLen());
+  if (rt && errno == EINPROGRESS) {
+    int err = co_await writable(fd, timeout_ms);
+    if (!err) {
+      socklen_t len = sizeof(err);
+      if (getsockopt_f(fd, SOL_SOCKET, SO_ERROR, &err, &len)) {
+        err = errno;
+      }
+    }
+    rt = err ? -1 : 0;
+    errno = err;
+  }
+
+  // init会把Socket标记为已连接并获取两端地址
+  if (rt == 0 && sock->init(fd)) {
+    co_return true;
+  }
+  int err = errno;
+  if (created) {
+    FdMgr::GetInstance()->del(fd);
+    close_f(fd);
+  }
+  errno = err;
+  co_return false;
+}
+
+namespace {
+
+// co_spawn用的自动释放的协程
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() const noexcept {return {};}
+    std::suspend_never initial_suspend() const noexcept {return {};}
+    std::suspend_never final_suspend() const noexcept {return {};}
+    void return_void() const noexcept {}
+    void unhandled_exception() const noexcept {}
+  };
+};
+
+DetachedTask RunDetached(Task<void> task) {
+  try {
+    co_await task;
+  } catch (std::exception& e) {
+    SYLAR_LOG_ERROR(g_logger) << "co_spawn task except: " << e.what();
+  } catch (...) {
+    SYLAR_LOG_ERROR(g_logger) << "co_spawn task except";
+  }
+}
+
+}
+
+void co_spawn(IOManager* iom, Task<void> task) {
+  // Task只能移动, 而调度器的回调要求可拷贝
+  auto holder = std::make_shared<Task<void>>(std::move(task));
+  if (!iom->schedule(std::function<void()>([holder]() {
+      RunDetached(std::move(*holder));
+    }))) {
+    SYLAR_LOG_ERROR(g_logger) << "co_spawn rejected, scheduler queue is full";
+  }
+}
+
+}
+
+#endif
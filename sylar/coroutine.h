@@ -0,0 +1,205 @@
+#ifndef SYLAR_SYLAR_COROUTINE_H_
+#define SYLAR_SYLAR_COROUTINE_H_
+
+/*
+ * C++20无栈协程适配层(需要打开cmake选项SYLAR_ENABLE_COROUTINE)
+ * 无栈协程由IOManager的事件循环和定时器驱动, 可以和有栈的Fiber在同一个进程中共存:
+ * 每次恢复无栈协程都发生在IOManager调度的回调里
+ * */
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include "iomanager.h"
+#include "sylar_socket.h"
+
+namespace sylar {
+
+template <typename T = void> class Task;
+
+class TaskPromiseBase {
+ public:
+  struct FinalAwaiter {
+    bool await_ready() const noexcept {return false;}
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+      // 结束时转移到等待自己的协程, 没有则返回调用者
+      auto continuation = h.promise().m_continuation;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+  };
+
+  // 惰性启动, 被co_await或者co_spawn时才开始执行
+  std::suspend_always initial_suspend() const noexcept {return {};}
+  FinalAwaiter final_suspend() const noexcept {return {};}
+  void unhandled_exception() {m_exception = std::current_exception();}
+
+  void setContinuation(std::coroutine_handle<> h) {m_continuation = h;}
+
+ protected:
+  void rethrowIfFailed() const {
+    if (m_exception) {
+      std::rethrow_exception(m_exception);
+    }
+  }
+
+ private:
+  std::coroutine_handle<> m_continuation;
+  std::exception_ptr m_exception;
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+ public:
+  Task<T> get_return_object();
+
+  template <typename U>
+  void return_value(U&& v) {m_value.emplace(std::forward<U>(v));}
+
+  T result() {
+    rethrowIfFailed();
+    return std::move(*m_value);
+  }
+
+ private:
+  std::optional<T> m_value;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+ public:
+  Task<void> get_return_object();
+  void return_void() {}
+  void result() {rethrowIfFailed();}
+};
+
+// 无栈协程任务, 只能移动; co_await一个Task会启动它并在它结束后恢复当前协程
+template <typename T>
+class Task {
+ public:
+  using promise_type = TaskPromise<T>;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  Task() = default;
+  explicit Task(handle_type h) : m_handle(h) {}
+  Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (m_handle) {
+        m_handle.destroy();
+      }
+      m_handle = std::exchange(other.m_handle, nullptr);
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  ~Task() {
+    if (m_handle) {
+      m_handle.destroy();
+    }
+  }
+
+  bool valid() const {return !!m_handle;}
+  bool done() const {return !m_handle || m_handle.done();}
+
+  auto operator co_await() const noexcept {
+    struct Awaiter {
+      handle_type handle;
+      bool await_ready() const noexcept {return !handle || handle.done();}
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) noexcept {
+        handle.promise().setContinuation(h);
+        return handle;
+      }
+      T await_resume() {return handle.promise().result();}
+    };
+    return Awaiter{m_handle};
+  }
+
+ private:
+  handle_type m_handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+  return Task<T>(Task<T>::handle_type::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+  return Task<void>(Task<void>::handle_type::from_promise(*this));
+}
+
+// 等待fd上的事件就绪, co_await的结果: 0就绪, ETIMEDOUT超时, 其他为添加事件失败的错误码
+class IoAwaiter {
+ public:
+  IoAwaiter(int fd, IOManager::Event event, uint64_t timeout_ms = -1)
+      : m_fd(fd), m_event(event), m_timeout(timeout_ms) {}
+
+  bool await_ready() const noexcept {return false;}
+  bool await_suspend(std::coroutine_handle<> h);
+  int await_resume();
+
+ private:
+  // 事件和超时谁先把cancelled从0改掉谁负责唤醒, 超时一方在cancelEvent结束后置settled
+  struct State {
+    std::atomic<int> cancelled {0};
+    std::atomic<bool> settled {false};
+    Timer::ptr timer;
+  };
+
+  int m_fd;
+  IOManager::Event m_event;
+  uint64_t m_timeout;
+  int m_error = 0;
+  std::shared_ptr<State> m_state;
+};
+
+// 挂起ms毫秒, 由IOManager的定时器唤醒
+class SleepAwaiter {
+ public:
+  explicit SleepAwaiter(uint64_t ms) : m_ms(ms) {}
+
+  bool await_ready() const noexcept {return m_ms == 0;}
+  void await_suspend(std::coroutine_handle<> h);
+  void await_resume() const noexcept {}
+
+ private:
+  uint64_t m_ms;
+};
+
+inline IoAwaiter readable(int fd, uint64_t timeout_ms = -1) {
+  return IoAwaiter(fd, IOManager::READ, timeout_ms);
+}
+
+inline IoAwaiter writable(int fd, uint64_t timeout_ms = -1) {
+  return IoAwaiter(fd, IOManager::WRITE, timeout_ms);
+}
+
+inline SleepAwaiter sleep_for(uint64_t ms) {
+  return SleepAwaiter(ms);
+}
+
+/*
+ * Socket的无栈版本操作, 返回值和errno的含义与Socket的同名函数一致
+ * 超时时间取自Socket的SO_RCVTIMEO/SO_SNDTIMEO设置
+ * */
+Task<int> async_recv(Socket::ptr sock, void* buffer, size_t length, int flags = 0);
+Task<int> async_send(Socket::ptr sock, const void* buffer, size_t length, int flags = 0);
+Task<Socket::ptr> async_accept(Socket::ptr sock);
+Task<bool> async_connect(Socket::ptr sock, Address::ptr addr, uint64_t timeout_ms = -1);
+
+// 在iom上启动一个独立运行的任务, 任务结束后自动释放
+void co_spawn(IOManager* iom, Task<void> task);
+
+}
+
+#endif
+
+#endif //SYLAR_SYLAR_COROUTINE_H_
@@ -0,0 +1,44 @@
+#include "deadline.h"
+#include "fiber_local.h"
+#include "util.h"
+
+#include <algorithm>
+
+namespace sylar {
+
+static FiberLocal<uint64_t>& DeadlineLocal() {
+  static FiberLocal<uint64_t> s_deadline(~0ull);
+  return s_deadline;
+}
+
+uint64_t GetDeadline() {
+  uint64_t* deadline = DeadlineLocal().tryGet();
+  return deadline ? *deadline : ~0ull;
+}
+
+void SetDeadline(uint64_t deadline_ms) {
+  DeadlineLocal().set(deadline_ms);
+}
+
+DeadlineGuard::DeadlineGuard(uint64_t timeout_ms)
+    : m_old(GetDeadline()) {
+  uint64_t now = GetCurrentMS();
+  uint64_t deadline = timeout_ms > ~0ull - now ? ~0ull : now + timeout_ms;
+  m_deadline = std::min(m_old, deadline);
+  SetDeadline(m_deadline);
+}
+
+DeadlineGuard::~DeadlineGuard() {
+  SetDeadline(m_old);
+}
+
+uint64_t GetDeadlineRemainingMS() {
+  uint64_t deadline = GetDeadline();
+  if (deadline == ~0ull) {
+    return ~0ull;
+  }
+  uint64_t now = GetCurrentMS();
+  return deadline > now ? deadline - now : 0;
+}
+
+}
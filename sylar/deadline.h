@@ -0,0 +1,38 @@
+#ifndef SYLAR_SYLAR_DEADLINE_H_
+#define SYLAR_SYLAR_DEADLINE_H_
+
+#include <cstdint>
+
+#include "noncopyable.h"
+
+namespace sylar {
+
+/*
+ * 在作用域内给当前协程设置截止时间, 离开作用域时恢复
+ * 嵌套时取更早的截止时间; 协程中的hook IO和connect的超时取min(fd超时, 剩余时间),
+ * 已经过期时不再等待, 直接返回-1并设置errno为ETIMEDOUT
+ * */
+class DeadlineGuard : public NonCopyable {
+ public:
+  explicit DeadlineGuard(uint64_t timeout_ms);
+  ~DeadlineGuard();
+
+  // 生效的截止时间(毫秒时间戳)
+  uint64_t getDeadline() const {return m_deadline;}
+
+ private:
+  uint64_t m_old;
+  uint64_t m_deadline;
+};
+
+// 当前协程的截止时间(GetCurrentMS的毫秒时间戳), 没有设置时为~0ull
+uint64_t GetDeadline();
+// 直接设置当前协程的截止时间, 一般应该使用DeadlineGuard
+void SetDeadline(uint64_t deadline_ms);
+
+// 当前协程距离截止时间的毫秒数, 没有截止时间返回~0ull, 已经过期返回0
+uint64_t GetDeadlineRemainingMS();
+
+}
+
+#endif //SYLAR_SYLAR_DEADLINE_H_
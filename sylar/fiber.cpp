@@ -7,7 +7,10 @@
 #include "macro.h"
 #include "log.h"
 #include "scheduler.h"
+#include "util.h"
 
+#include <execinfo.h>
+#include <time.h>
 #include <atomic>
 #include <utility>
 
@@ -21,11 +24,32 @@ static std::atomic<uint64_t> s_fiber_count {0};
 static thread_local Fiber* t_fiber = nullptr; // 当前正在执行的协程
 static thread_local Fiber::ptr t_threadFiber = nullptr; // 主协程
 
+static std::atomic<size_t> s_local_index {0};
+
 static ConfigVar<uint32_t>::ptr g_fiber_stack_size =
 	Config::Lookup<uint32_t>("fiber.stack_size",
 							 1024 * 1024,
 							 "fiber stack size");
 
+static ConfigVar<bool>::ptr g_fiber_capture_stack =
+	Config::Lookup<bool>("fiber.capture_stack", false,
+						 "record the creation backtrace of each fiber for fiber dumps");
+
+// 存活协程的链表, 只在创建和销毁时加锁
+static Mutex& LiveMutex() {
+  // 不析构, 进程退出时其他线程的协程可能还在销毁
+  static Mutex* s_mutex = new Mutex;
+  return *s_mutex;
+}
+static Fiber* s_live_head = nullptr;
+
+// 粗粒度的单调时钟, 用于记录协程在当前状态的时间, 开销远小于精确时钟
+static uint64_t CoarseMS() {
+  timespec ts {};
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
 class MallocStackAllocator {
  public:
   static void* Alloc(size_t size) {
@@ -43,7 +67,7 @@ Fiber::Fiber(std::function<void()> cb, size_t stackSize, bool use_caller)
 	:m_id(++s_fiber_id),
 	m_cb(std::move(cb)) {
   ++s_fiber_count;
-  m_stacksize = stackSize ? stackSize : g_fiber_stack_size->getValue();
+  m_stacksize = stackSize ? stackSize : *g_fiber_stack_size->getValue();
 
   m_stack = StackAllocator::Alloc(m_stacksize); // 创建栈内存
   // 获取当前上下文
@@ -59,19 +83,39 @@ Fiber::Fiber(std::function<void()> cb, size_t stackSize, bool use_caller)
   } else {
 	makecontext(&m_ctx, CallerMainFunc, 0);
   }
+
+  m_createSite.store(__builtin_return_address(0), std::memory_order_relaxed);
+  setCallbackInfo();
+  if (*g_fiber_capture_stack->getValue()) {
+    m_createStack.reset(new std::vector<void*>(32));
+    m_createStack->resize(backtrace(&(*m_createStack)[0], m_createStack->size()));
+  }
+  linkLive();
   SYLAR_LOG_DEBUG(g_logger) << "Fiber::Fiber id=" << m_id;
 }
 
 Fiber::~Fiber() {
   --s_fiber_count;
+  {
+    Mutex::Lock lock(LiveMutex());
+    if (m_livePrev) {
+      m_livePrev->m_liveNext = m_liveNext;
+    } else {
+      s_live_head = m_liveNext;
+    }
+    if (m_liveNext) {
+      m_liveNext->m_livePrev = m_livePrev;
+    }
+  }
+  destroyLocals();
   if (m_stack) {
     // 子协程
-	SYLAR_ASSERT(m_state == TERM || m_state == INIT || m_state == EXCEPT);
+	SYLAR_ASSERT(getState() == TERM || getState() == INIT || getState() == EXCEPT);
 	StackAllocator::Dealloc(m_stack, m_stacksize);
   } else {
     // 主协程
 	SYLAR_ASSERT(!m_cb);
-	SYLAR_ASSERT(m_state == EXEC);
+	SYLAR_ASSERT(getState() == EXEC);
 
 	Fiber* cur = t_fiber;
 	if (cur == this) {
@@ -83,7 +127,7 @@ Fiber::~Fiber() {
 
 void Fiber::reset(std::function<void()> cb) {
   SYLAR_ASSERT(m_stack); // 必须是子协程
-  SYLAR_ASSERT(m_state == TERM || m_state == INIT || m_state == EXCEPT); // 该协程当前状态必须是终止或者初始化
+  SYLAR_ASSERT(getState() == TERM || getState() == INIT || getState() == EXCEPT); // 该协程当前状态必须是终止或者初始化
 
   m_cb = std::move(cb); // 更改回调函数
   if (getcontext(&m_ctx)) {
@@ -98,15 +142,35 @@ void Fiber::reset(std::function<void()> cb) {
   // 根据配置创建一个上下文
   makecontext(&m_ctx, MainFunc, 0);
   // 新的上下文状态是初始化
-  m_state = INIT;
+  setState(INIT);
+  m_stateSince.store(CoarseMS(), std::memory_order_relaxed);
+  setCallbackInfo();
+}
+
+void Fiber::setCallbackInfo() {
+  auto fn = m_cb.target<void(*)()>();
+  m_cbType.store(m_cb ? &m_cb.target_type() : nullptr, std::memory_order_relaxed);
+  m_cbAddr.store(fn ? (void*)*fn : nullptr, std::memory_order_relaxed);
+}
+
+void Fiber::linkLive() {
+  m_stateSince.store(CoarseMS(), std::memory_order_relaxed);
+  Mutex::Lock lock(LiveMutex());
+  m_liveNext = s_live_head;
+  if (s_live_head) {
+    s_live_head->m_livePrev = this;
+  }
+  s_live_head = this;
 }
 
 void Fiber::swapIn() {
   SetThis(this); // 设置当前协程为this
-  SYLAR_ASSERT(m_state != EXEC);
+  SYLAR_ASSERT(getState() != EXEC);
 
   // 当前上下文将要执行
-  m_state = EXEC;
+  setState(EXEC);
+  m_stateSince.store(CoarseMS(), std::memory_order_relaxed);
+  m_waitReason.store(WAIT_NONE, std::memory_order_relaxed);
 
   // 把主协程的上下文保存在t_threadFiber->m_ctx中，并激活当前上下文m_ctx
   if (swapcontext(&Scheduler::GetMainFiber()->m_ctx, &m_ctx)) {
@@ -117,6 +181,7 @@ void Fiber::swapIn() {
 void Fiber::swapOut() {
   // SetThis(t_threadFiber.get());  // 设置当前协程为主协程
   SetThis(Scheduler::GetMainFiber());
+  m_stateSince.store(CoarseMS(), std::memory_order_relaxed);
   if (swapcontext(&m_ctx, &Scheduler::GetMainFiber()->m_ctx)) {
 	SYLAR_ASSERT2(false, "swapcontext");
   }
@@ -124,7 +189,9 @@ void Fiber::swapOut() {
 
 void Fiber::call() {
   SetThis(this);
-  m_state = EXEC;
+  setState(EXEC);
+  m_stateSince.store(CoarseMS(), std::memory_order_relaxed);
+  m_waitReason.store(WAIT_NONE, std::memory_order_relaxed);
   if (swapcontext(&t_threadFiber->m_ctx, &m_ctx)) {
 	SYLAR_ASSERT2(false, "swapcontext");
   }
@@ -132,6 +199,7 @@ void Fiber::call() {
 
 void Fiber::back() {
   SetThis(t_threadFiber.get());
+  m_stateSince.store(CoarseMS(), std::memory_order_relaxed);
   if (swapcontext(&m_ctx, &t_threadFiber->m_ctx)) {
 	SYLAR_ASSERT2(false, "swapcontext");
   }
@@ -149,13 +217,13 @@ Fiber::ptr Fiber::GetThis() {
 
 void Fiber::YieldToReady() {
   Fiber::ptr cur = GetThis();
-  cur->m_state = READY;
+  cur->setState(READY);
   cur->swapOut();
 }
 
 void Fiber::YieldToHold() {
   Fiber::ptr cur = GetThis();
-  cur->m_state = HOLD;
+  cur->setState(HOLD);
   cur->swapOut();
 }
 
@@ -169,14 +237,14 @@ void Fiber::MainFunc() {
   try {
     cur->m_cb(); // 执行该协程的回调函数
     cur->m_cb = nullptr;
-    cur->m_state = TERM;
+    cur->setState(TERM);
   } catch (std::exception& ex) {
-    cur->m_state = EXCEPT;
+    cur->setState(EXCEPT);
 	SYLAR_LOG_ERROR(g_logger) << "Fiber Except: " << ex.what()
 	<< " fiber_id=" << cur->getId()
 	<< std::endl << BacktraceToString(10);
   } catch (...) {
-	cur->m_state = EXCEPT;
+	cur->setState(EXCEPT);
 	SYLAR_LOG_ERROR(g_logger) << "Fiber Except"
 		  << " fiber_id=" << cur->getId()
 	<< std::endl << BacktraceToString(10);
@@ -188,6 +256,7 @@ void Fiber::MainFunc() {
    * 这是由于swapOut之后,这里的栈对象依旧存在，
    * 因此我们需要手动给智能指针减一引用
    * */
+  cur->destroyLocals(); // 协程函数结束, 释放协程局部变量
   auto raw_ptr = cur.get();
   cur.reset(); // 这里调用的是智能指针类的成员函数
   raw_ptr->swapOut();
@@ -201,14 +270,14 @@ void Fiber::CallerMainFunc() {
   try {
 	cur->m_cb(); // 执行改协程的回调函数
 	cur->m_cb = nullptr;
-	cur->m_state = TERM;
+	cur->setState(TERM);
   } catch (std::exception& ex) {
-	cur->m_state = EXCEPT;
+	cur->setState(EXCEPT);
 	SYLAR_LOG_ERROR(g_logger) << "Fiber Except: " << ex.what()
 							  << " fiber_id=" << cur->getId()
 							  << std::endl << BacktraceToString(10);
   } catch (...) {
-	cur->m_state = EXCEPT;
+	cur->setState(EXCEPT);
 	SYLAR_LOG_ERROR(g_logger) << "Fiber Except"
 							  << " fiber_id=" << cur->getId()
 							  << std::endl << BacktraceToString(10);
@@ -220,6 +289,7 @@ void Fiber::CallerMainFunc() {
    * 这是由于swapOut之后,这里的栈对象依旧存在，
    * 因此我们需要手动给智能指针减一引用
    * */
+  cur->destroyLocals(); // 协程函数结束, 释放协程局部变量
   auto raw_ptr = cur.get();
   cur.reset(); // 这里调用的是智能指针类的成员函数
   raw_ptr->back();
@@ -229,7 +299,7 @@ void Fiber::CallerMainFunc() {
 
 Fiber::Fiber() {
   //　初始化主协程
-  m_state = EXEC;
+  setState(EXEC);
   SetThis(this);
 
   if (getcontext(&m_ctx)) {
@@ -237,6 +307,7 @@ Fiber::Fiber() {
   }
 
   ++s_fiber_count;
+  linkLive();
 
   SYLAR_LOG_DEBUG(g_logger) << "Fiber::Fiber";
 }
@@ -252,6 +323,137 @@ uint64_t Fiber::GetFiberId() {
   return 0;
 }
 
+const char* Fiber::WaitReasonToString(WaitReason reason) {
+  switch (reason) {
+#define XX(name, str) \
+    case name: \
+      return #str;
+    XX(WAIT_NONE, none);
+    XX(WAIT_READ, read);
+    XX(WAIT_WRITE, write);
+    XX(WAIT_CONNECT, connect);
+    XX(WAIT_SLEEP, sleep);
+    XX(WAIT_CHANNEL, channel);
+    XX(WAIT_WAITER, waiter);
+#undef XX
+    default:
+      return "unknown";
+  }
+}
+
+void Fiber::SetWaitReason(WaitReason reason, int64_t arg, bool overwrite) {
+  Fiber* cur = t_fiber;
+  if (!cur || (!overwrite && cur->getWaitReason() != WAIT_NONE)) {
+    return;
+  }
+  cur->m_waitArg.store(arg, std::memory_order_relaxed);
+  cur->m_waitReason.store(reason, std::memory_order_relaxed);
+}
+
+static const char* StateToString(Fiber::State state) {
+  switch (state) {
+#define XX(name) \
+    case Fiber::name: \
+      return #name;
+    XX(INIT);
+    XX(HOLD);
+    XX(EXEC);
+    XX(TERM);
+    XX(READY);
+    XX(EXCEPT);
+#undef XX
+    default:
+      return "UNKNOW";
+  }
+}
+
+void Fiber::DumpAll(std::ostream& os) {
+  uint64_t now = CoarseMS();
+  Mutex::Lock lock(LiveMutex());
+  os << "fibers: " << s_fiber_count << std::endl;
+  for (Fiber* f = s_live_head; f; f = f->m_liveNext) {
+    State state = f->getState();
+    uint64_t since = f->m_stateSince.load(std::memory_order_relaxed);
+    os << "fiber " << f->m_id << " " << StateToString(state)
+       << " " << (now > since ? now - since : 0) << "ms";
+    if (!f->m_stack) {
+      os << " thread_main";
+    }
+    WaitReason reason = f->getWaitReason();
+    if (reason != WAIT_NONE && state != EXEC) {
+      int64_t arg = f->m_waitArg.load(std::memory_order_relaxed);
+      os << " wait=" << WaitReasonToString(reason);
+      if (reason == WAIT_SLEEP) {
+        os << "(" << arg << "ms)";
+      } else if (reason == WAIT_READ || reason == WAIT_WRITE || reason == WAIT_CONNECT) {
+        os << "(fd=" << arg << ")";
+      }
+    }
+    const std::type_info* cb_type = f->m_cbType.load(std::memory_order_relaxed);
+    if (cb_type) {
+      os << " cb=" << CallbackName(cb_type, f->m_cbAddr.load(std::memory_order_relaxed));
+    }
+    void* site = f->m_createSite.load(std::memory_order_relaxed);
+    if (site) {
+      os << " created_at=" << SymbolName(site);
+    }
+    os << std::endl;
+    if (f->m_createStack) {
+      auto& frames = *f->m_createStack;
+      char** strings = backtrace_symbols(&frames[0], frames.size());
+      if (strings) {
+        for (size_t i = 1; i < frames.size(); ++i) {
+          os << "    " << strings[i] << std::endl;
+        }
+        free(strings);
+      }
+    }
+  }
+}
+
+size_t Fiber::AllocLocalIndex() {
+  size_t index = s_local_index++;
+  SYLAR_ASSERT2(index < kMaxLocals, "too many FiberLocal");
+  return index;
+}
+
+Fiber::LocalSlot& Fiber::GetLocalSlot(size_t index) {
+  if (!t_fiber) {
+    GetThis(); // 创建主协程
+  }
+  if (!t_fiber->m_locals) {
+    t_fiber->m_locals.reset(new LocalSlot[kMaxLocals]);
+  }
+  return t_fiber->m_locals[index];
+}
+
+void* Fiber::PeekLocal(size_t index) {
+  if (!t_fiber || !t_fiber->m_locals) {
+    return nullptr;
+  }
+  return t_fiber->m_locals[index].value;
+}
+
+void Fiber::destroyLocals() {
+  if (!m_locals) {
+    return;
+  }
+  // 析构函数里可能又访问了别的协程局部变量, 重复清理直到全部为空
+  bool found = true;
+  while (found) {
+    found = false;
+    for (size_t i = 0; i < kMaxLocals; ++i) {
+      LocalSlot& slot = m_locals[i];
+      if (slot.value) {
+        void* value = slot.value;
+        slot.value = nullptr;
+        slot.destroy(value);
+        found = true;
+      }
+    }
+  }
+}
+
 
 
 }
\ No newline at end of file
@@ -9,6 +9,10 @@
 
 #include <memory>
 #include <functional>
+#include <atomic>
+#include <ostream>
+#include <typeinfo>
+#include <vector>
 
 #include "thread.h"
 
@@ -29,6 +33,18 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
     EXCEPT // 异常状态
   };
 
+  // 协程挂起时在等待什么, 用于协程转储
+  enum WaitReason {
+    WAIT_NONE = 0,
+    WAIT_READ, // 等待fd可读, 参数为fd
+    WAIT_WRITE, // 等待fd可写, 参数为fd
+    WAIT_CONNECT, // 等待connect完成, 参数为fd
+    WAIT_SLEEP, // sleep, 参数为毫秒
+    WAIT_CHANNEL, // 等待Channel
+    WAIT_WAITER // 等待FiberWaiter(TaskGroup, parallel_for等)
+  };
+  static const char* WaitReasonToString(WaitReason reason);
+
   Fiber(std::function<void()> cb, size_t stackSize = 0, bool use_caller = false);
   ~Fiber();
 
@@ -38,8 +54,18 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
   void call(); // 把当前线程置换成目标线程
   void back();
   uint64_t getId() const {return m_id;}
-  const State& getState() const {return m_state;}
-  void setState(const State& state) {m_state = state;}
+  State getState() const {return m_state.load(std::memory_order_relaxed);}
+  void setState(State state) {m_state.store(state, std::memory_order_relaxed);}
+  const std::function<void()>& getCallback() const {return m_cb;}
+
+  /*
+   * 协程上下文的使用权, 调度器恢复协程前获取, 协程切换回来并处理完状态后释放
+   * 协程注册IO事件或定时器后还没让出, 其他线程就可能被唤醒来恢复它, 需要等前一个线程切换完
+   * */
+  void lockContext() {
+    while (m_ctxLock.test_and_set(std::memory_order_acquire));
+  }
+  void unlockContext() {m_ctxLock.clear(std::memory_order_release);}
 
   static void SetThis(Fiber* f); // 设置当前协程
   static Fiber::ptr GetThis(); // 获取当前的子协程，如果不存在子协程，则创建一个主协程
@@ -50,15 +76,61 @@ class Fiber : public std::enable_shared_from_this<Fiber> {
   static void CallerMainFunc(); // 协程执行的函数
   static uint64_t GetFiberId();
 
+  /*
+   * 记录当前协程接下来要等待的东西, 协程被恢复执行时清除
+   * overwrite为false时不覆盖已经设置的更具体的原因
+   * */
+  static void SetWaitReason(WaitReason reason, int64_t arg = 0, bool overwrite = true);
+  WaitReason getWaitReason() const {return m_waitReason.load(std::memory_order_relaxed);}
+  // 记录创建位置; 调度器用回调创建协程时传入提交任务的代码地址
+  void setCreateSite(void* site) {m_createSite.store(site, std::memory_order_relaxed);}
+
+  /*
+   * 输出所有存活的协程: id, 状态, 在该状态的时间, 等待原因, 创建位置, 回调和(可选的)创建时调用栈
+   * fiber.capture_stack开启时创建协程会记录调用栈
+   * */
+  static void DumpAll(std::ostream& os);
+
+  // 协程局部存储的槽位, 由FiberLocal使用
+  struct LocalSlot {
+    void* value = nullptr;
+    void (*destroy)(void*) = nullptr;
+  };
+  static constexpr size_t kMaxLocals = 64;
+  // 分配一个槽位下标, 所有协程共用同一套下标
+  static size_t AllocLocalIndex();
+  // 当前协程的第index个槽位, 第一次访问时分配槽位数组
+  static LocalSlot& GetLocalSlot(size_t index);
+  // 只读取当前协程第index个槽位的值, 不分配槽位数组
+  static void* PeekLocal(size_t index);
+
+ private:
+  void destroyLocals(); // 协程函数结束时销毁协程局部变量
+  void setCallbackInfo(); // 记录回调的类型, 转储时再解析成名字
+  void linkLive(); // 加入存活协程链表
+
  private:
   uint64_t m_id = 0;
   uint32_t m_stacksize = 0;
-  State m_state = INIT;
+  std::atomic<State> m_state {INIT};
 
   ucontext_t m_ctx;
   void* m_stack = nullptr;
 
   std::function<void()> m_cb;
+  std::unique_ptr<LocalSlot[]> m_locals;
+  std::atomic_flag m_ctxLock = ATOMIC_FLAG_INIT;
+
+  // 以下用于协程转储, 由其他线程读取, 只保存简单值, 用relaxed原子读写
+  std::atomic<uint64_t> m_stateSince {0}; // 进入当前状态的时间, 粗粒度单调时钟ms
+  std::atomic<WaitReason> m_waitReason {WAIT_NONE};
+  std::atomic<int64_t> m_waitArg {0};
+  std::atomic<void*> m_createSite {nullptr}; // 创建协程的代码地址
+  std::atomic<const std::type_info*> m_cbType {nullptr};
+  std::atomic<void*> m_cbAddr {nullptr};
+  std::unique_ptr<std::vector<void*>> m_createStack;
+  Fiber* m_livePrev = nullptr;
+  Fiber* m_liveNext = nullptr;
  };
 
 }
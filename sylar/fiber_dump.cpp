@@ -0,0 +1,163 @@
+#include "fiber_dump.h"
+#include "config.h"
+#include "fiber.h"
+#include "log.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static ConfigVar<int>::ptr g_fiber_dump_signal =
+    Config::Lookup<int>("fiber.dump_signal", 0, "dump all fibers to the log on this signal, 0 means disabled");
+
+static ConfigVar<std::string>::ptr g_fiber_admin_socket =
+    Config::Lookup<std::string>("fiber.admin_socket", "", "unix socket path serving fiber dumps");
+
+struct _FiberDumpIniter {
+  _FiberDumpIniter() {
+    g_fiber_dump_signal->addListener([](const int& old_value, const int& new_value) {
+        FiberDumperMgr::GetInstance()->installSignal(new_value);
+      });
+    g_fiber_admin_socket->addListener([](const std::string& old_value, const std::string& new_value) {
+        if (!new_value.empty()) {
+          FiberDumperMgr::GetInstance()->listenAdmin(new_value);
+        }
+      });
+  }
+};
+
+static _FiberDumpIniter s_fiber_dump_initer;
+
+// sem_post可以在信号处理函数中调用
+static Semaphore s_dump_semaphore;
+
+static void OnDumpSignal(int) {
+  int saved = errno;
+  s_dump_semaphore.notify();
+  errno = saved;
+}
+
+FiberDumper::FiberDumper() {
+}
+
+FiberDumper::~FiberDumper() {
+  installSignal(0);
+  m_stop = true;
+  if (m_signalThread) {
+    s_dump_semaphore.notify();
+    m_signalThread->join();
+  }
+  if (m_adminThread) {
+    // 让阻塞的accept返回
+    shutdown(m_listenFd, SHUT_RDWR);
+    m_adminThread->join();
+    close(m_listenFd);
+    unlink(m_path.c_str());
+  }
+}
+
+std::string FiberDumper::Dump() {
+  std::stringstream ss;
+  Fiber::DumpAll(ss);
+  return ss.str();
+}
+
+void FiberDumper::installSignal(int sig) {
+  MutexType::Lock lock(m_mutex);
+  if (sig == m_signal) {
+    return;
+  }
+  if (m_signal > 0) {
+    sigaction(m_signal, &m_oldAction, nullptr);
+    m_signal = 0;
+  }
+  if (sig <= 0) {
+    return;
+  }
+  if (!m_signalThread) {
+    m_signalThread.reset(new Thread(std::bind(&FiberDumper::signalLoop, this), "fiber_dump"));
+  }
+  struct sigaction sa {};
+  sa.sa_handler = OnDumpSignal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(sig, &sa, &m_oldAction)) {
+    SYLAR_LOG_ERROR(g_logger) << "install fiber dump signal " << sig << " fail, errno="
+        << errno << " errstr=" << strerror(errno);
+    return;
+  }
+  m_signal = sig;
+}
+
+bool FiberDumper::listenAdmin(const std::string& path) {
+  MutexType::Lock lock(m_mutex);
+  if (m_adminThread) {
+    return false;
+  }
+  sockaddr_un addr {};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    SYLAR_LOG_ERROR(g_logger) << "admin socket path too long: " << path;
+    return false;
+  }
+  addr.sun_family = AF_UNIX;
+  memcpy(addr.sun_path, path.c_str(), path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  unlink(path.c_str());
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) || listen(fd, 8)) {
+    SYLAR_LOG_ERROR(g_logger) << "listen admin socket " << path << " fail, errno="
+        << errno << " errstr=" << strerror(errno);
+    close(fd);
+    return false;
+  }
+  m_listenFd = fd;
+  m_path = path;
+  m_adminThread.reset(new Thread(std::bind(&FiberDumper::adminLoop, this), "fiber_admin"));
+  return true;
+}
+
+void FiberDumper::signalLoop() {
+  while (true) {
+    s_dump_semaphore.wait();
+    if (m_stop) {
+      break;
+    }
+    SYLAR_LOG_INFO(g_logger) << "fiber dump:" << std::endl << Dump();
+  }
+}
+
+void FiberDumper::adminLoop() {
+  // 这个线程不是调度线程, socket调用不经过hook, 直接阻塞
+  while (!m_stop) {
+    int client = accept(m_listenFd, nullptr, nullptr);
+    if (client < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    std::string text = Dump();
+    size_t offset = 0;
+    while (offset < text.size()) {
+      ssize_t n = send(client, text.c_str() + offset, text.size() - offset, MSG_NOSIGNAL);
+      if (n <= 0) {
+        break;
+      }
+      offset += n;
+    }
+    close(client);
+  }
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef SYLAR_SYLAR_FIBER_DUMP_H_
+#define SYLAR_SYLAR_FIBER_DUMP_H_
+
+#include <memory>
+#include <string>
+#include <atomic>
+#include <signal.h>
+
+#include "singleton.h"
+#include "thread.h"
+
+namespace sylar {
+
+/*
+ * 服务卡住时查看所有存活的协程(Fiber::DumpAll)
+ * fiber.dump_signal: 收到该信号时把转储打到system日志, 比如12(SIGUSR2), 0表示不处理
+ *   信号处理函数只post一个信号量, 由单独的线程做转储
+ * fiber.admin_socket: unix socket路径, 每个连接上来的客户端收到一份转储后断开, 比如
+ *   socat - UNIX-CONNECT:/tmp/sylar.sock
+ * */
+class FiberDumper {
+ public:
+  using MutexType = Mutex;
+
+  FiberDumper();
+  ~FiberDumper();
+
+  // 安装转储信号的处理函数; 之前安装过的信号恢复原来的处理方式, sig为0时只恢复
+  void installSignal(int sig);
+  // 在path上监听管理连接, 已经在监听时忽略
+  bool listenAdmin(const std::string& path);
+
+  // 转储到字符串
+  static std::string Dump();
+
+ private:
+  void signalLoop();
+  void adminLoop();
+
+ private:
+  MutexType m_mutex;
+  Thread::ptr m_signalThread;
+  Thread::ptr m_adminThread;
+  int m_signal = 0; // 当前安装了处理函数的信号
+  struct sigaction m_oldAction {}; // m_signal原来的处理方式
+  int m_listenFd = -1;
+  std::string m_path;
+  std::atomic<bool> m_stop {false};
+};
+
+typedef Singleton<FiberDumper> FiberDumperMgr;
+
+}
+
+#endif //SYLAR_SYLAR_FIBER_DUMP_H_
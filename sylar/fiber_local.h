@@ -0,0 +1,73 @@
+#ifndef SYLAR_SYLAR_FIBER_LOCAL_H_
+#define SYLAR_SYLAR_FIBER_LOCAL_H_
+
+#include <functional>
+#include <utility>
+
+#include "fiber.h"
+#include "noncopyable.h"
+
+namespace sylar {
+
+/*
+ * 协程局部变量
+ * 调度器会把协程放到不同的线程上执行, thread_local在协程中不可靠, 需要跟着协程走的状态用FiberLocal
+ * 每个协程第一次访问时构造, 协程函数结束(或协程析构)时析构; 访问是对协程槽位数组的一次下标操作
+ * 一般定义为静态变量, 整个进程最多Fiber::kMaxLocals个
+ * */
+template <typename T>
+class FiberLocal : public NonCopyable {
+ public:
+  FiberLocal()
+      : m_index(Fiber::AllocLocalIndex()),
+        m_factory([]() {return new T();}) {}
+
+  // 每个协程的初始值都是init的拷贝
+  explicit FiberLocal(T init)
+      : m_index(Fiber::AllocLocalIndex()),
+        m_factory([init]() {return new T(init);}) {}
+
+  // 当前协程的值, 不存在时构造
+  T& get() {
+    Fiber::LocalSlot& slot = Fiber::GetLocalSlot(m_index);
+    if (!slot.value) {
+      slot.value = m_factory();
+      slot.destroy = &Destroy;
+    }
+    return *static_cast<T*>(slot.value);
+  }
+
+  // 当前协程的值, 不存在时返回nullptr, 不会构造
+  T* tryGet() const {
+    return static_cast<T*>(Fiber::PeekLocal(m_index));
+  }
+
+  void set(T v) {get() = std::move(v);}
+
+  // 提前析构当前协程的值, 下次访问时重新构造
+  void reset() {
+    if (!tryGet()) {
+      return;
+    }
+    Fiber::LocalSlot& slot = Fiber::GetLocalSlot(m_index);
+    void* value = slot.value;
+    slot.value = nullptr;
+    Destroy(value);
+  }
+
+  T& operator*() {return get();}
+  T* operator->() {return &get();}
+
+ private:
+  static void Destroy(void* p) {
+    delete static_cast<T*>(p);
+  }
+
+ private:
+  size_t m_index;
+  std::function<T*()> m_factory;
+};
+
+}
+
+#endif //SYLAR_SYLAR_FIBER_LOCAL_H_
@@ -0,0 +1,81 @@
+#include "fiber_sync.h"
+#include "iomanager.h"
+#include "macro.h"
+#include "log.h"
+
+#include <cerrno>
+
+namespace sylar {
+
+bool FiberWaiter::CanYield() {
+  if (!Scheduler::GetThis()) {
+    return false;
+  }
+  Fiber::ptr cur = Fiber::GetThis();
+  // 线程的主协程(id为0)和调度器的主协程负责调度, 都不能被挂起
+  return cur->getId() != 0 && cur.get() != Scheduler::GetMainFiber();
+}
+
+FiberWaiter::FiberWaiter() {
+  if (CanYield()) {
+    m_scheduler = Scheduler::GetThis();
+    m_fiber = Fiber::GetThis();
+  }
+}
+
+bool FiberWaiter::notify(int reason) {
+  bool expected = false;
+  if (!m_notified.compare_exchange_strong(expected, true)) {
+    // 已经被其他人唤醒过了
+    return false;
+  }
+  m_reason = reason;
+  if (m_scheduler) {
+    // 先拷贝出来, 协程被调度后本对象可能随时被释放
+    Scheduler* scheduler = m_scheduler;
+    Fiber::ptr fiber = m_fiber;
+    scheduler->schedule(fiber);
+  } else {
+    m_semaphore.notify();
+  }
+  return true;
+}
+
+bool FiberWaiter::cancel() {
+  bool expected = false;
+  return m_notified.compare_exchange_strong(expected, true);
+}
+
+int FiberWaiter::wait() {
+  if (m_scheduler) {
+    // 无论notify是否已经发生都要让出一次, 因为notify已经把本协程放进了调度队列
+    Fiber::SetWaitReason(Fiber::WAIT_WAITER, 0, false);
+    Fiber::YieldToHold();
+    m_fiber.reset();
+  } else {
+    m_semaphore.wait();
+  }
+  return m_reason;
+}
+
+int FiberWaiter::waitFor(uint64_t timeout_ms) {
+  if (timeout_ms == (uint64_t)-1) {
+    return wait();
+  }
+  if (m_scheduler) {
+    IOManager* iom = IOManager::GetThis();
+    SYLAR_ASSERT2(iom, "FiberWaiter::waitFor needs an IOManager");
+    Timer::ptr timer = iom->addConditionalTimer(timeout_ms, [this]() {
+        notify(ETIMEDOUT);
+      }, shared_from_this());
+    wait();
+    timer->cancel();
+  } else if (!m_semaphore.waitFor(timeout_ms)) {
+    // 超时了, 不管是谁赢得了notify, 信号量都会被post一次
+    notify(ETIMEDOUT);
+    m_semaphore.wait();
+  }
+  return m_reason;
+}
+
+}
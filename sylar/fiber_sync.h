@@ -0,0 +1,48 @@
+#ifndef SYLAR_SYLAR_FIBER_SYNC_H_
+#define SYLAR_SYLAR_FIBER_SYNC_H_
+
+#include <memory>
+#include <atomic>
+
+#include "fiber.h"
+#include "thread.h"
+
+namespace sylar {
+
+class Scheduler;
+
+// 等待者: 在调度器的协程中等待时挂起协程(不阻塞线程),
+// 在普通线程中等待时阻塞在信号量上
+class FiberWaiter : public std::enable_shared_from_this<FiberWaiter>, public NonCopyable {
+ public:
+  using ptr = std::shared_ptr<FiberWaiter>;
+
+  // 必须在将要等待的协程(线程)中创建
+  FiberWaiter();
+
+  // 唤醒等待者, 只有第一次调用生效, 返回本次调用是否唤醒了等待者
+  bool notify(int reason = 0);
+  // 放弃等待(不会挂起), 返回false表示已经被唤醒, 此时必须调用wait把这次唤醒消费掉
+  bool cancel();
+  // 挂起直到被唤醒, 返回notify传入的原因
+  int wait();
+  // 最多挂起timeout_ms毫秒, 超时返回ETIMEDOUT
+  int waitFor(uint64_t timeout_ms);
+
+  bool isNotified() const {return m_notified;}
+  int getReason() const {return m_reason;}
+
+  // 当前是否运行在可以挂起的调度协程中
+  static bool CanYield();
+
+ private:
+  Scheduler* m_scheduler = nullptr;
+  Fiber::ptr m_fiber;
+  Semaphore m_semaphore;
+  std::atomic<bool> m_notified {false};
+  int m_reason = 0;
+};
+
+}
+
+#endif //SYLAR_SYLAR_FIBER_SYNC_H_
@@ -0,0 +1,371 @@
+#ifndef SYLAR_SYLAR_FUTURE_H_
+#define SYLAR_SYLAR_FUTURE_H_
+
+#include <memory>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <optional>
+#include <vector>
+#include <list>
+#include <atomic>
+#include <cerrno>
+
+#include "fiber_sync.h"
+#include "scheduler.h"
+#include "thread.h"
+
+namespace sylar {
+
+template <typename T> class Future;
+template <typename T> class Promise;
+
+// Future<void>在内部保存的占位值
+struct FutureUnit {};
+
+// Future和Promise共享的状态
+template <typename T>
+class FutureState {
+ public:
+  using ptr = std::shared_ptr<FutureState>;
+  using MutexType = Mutex;
+  using ValueType = typename std::conditional<std::is_void<T>::value, FutureUnit, T>::type;
+
+  // 设置结果, 已经设置过时返回false
+  template <typename... Args>
+  bool trySetValue(Args&&... args) {
+    {
+      MutexType::Lock lock(m_mutex);
+      if (m_ready) {
+        return false;
+      }
+      m_value.reset(new ValueType(std::forward<Args>(args)...));
+      m_ready = true;
+    }
+    onReady();
+    return true;
+  }
+
+  bool trySetException(std::exception_ptr e) {
+    {
+      MutexType::Lock lock(m_mutex);
+      if (m_ready) {
+        return false;
+      }
+      m_exception = std::move(e);
+      m_ready = true;
+    }
+    onReady();
+    return true;
+  }
+
+  bool isReady() {
+    MutexType::Lock lock(m_mutex);
+    return m_ready;
+  }
+
+  // 等待结果, 超时返回false
+  bool wait(uint64_t timeout_ms = -1) {
+    FiberWaiter::ptr waiter;
+    {
+      MutexType::Lock lock(m_mutex);
+      if (m_ready) {
+        return true;
+      }
+      if (timeout_ms == 0) {
+        return false;
+      }
+      waiter = std::make_shared<FiberWaiter>();
+      m_waiters.push_back(waiter);
+    }
+    if (waiter->waitFor(timeout_ms) == ETIMEDOUT) {
+      MutexType::Lock lock(m_mutex);
+      m_waiters.remove(waiter);
+      return m_ready;
+    }
+    return true;
+  }
+
+  // 结果就绪后执行cb, 已经就绪则立刻在当前协程执行
+  void addCallback(std::function<void()> cb) {
+    {
+      MutexType::Lock lock(m_mutex);
+      if (!m_ready) {
+        m_callbacks.push_back(std::move(cb));
+        return;
+      }
+    }
+    cb();
+  }
+
+  // 以下接口只能在结果就绪后调用
+  const ValueType& getValue() const {
+    if (m_exception) {
+      std::rethrow_exception(m_exception);
+    }
+    return *m_value;
+  }
+  std::exception_ptr getException() const {return m_exception;}
+
+ private:
+  void onReady() {
+    std::list<FiberWaiter::ptr> waiters;
+    std::vector<std::function<void()>> cbs;
+    {
+      MutexType::Lock lock(m_mutex);
+      waiters.swap(m_waiters);
+      cbs.swap(m_callbacks);
+    }
+    for (auto& i : waiters) {
+      i->notify();
+    }
+    for (auto& i : cbs) {
+      i();
+    }
+  }
+
+ private:
+  MutexType m_mutex;
+  bool m_ready = false;
+  std::unique_ptr<ValueType> m_value;
+  std::exception_ptr m_exception;
+  std::list<FiberWaiter::ptr> m_waiters;
+  std::vector<std::function<void()>> m_callbacks;
+};
+
+// then的回调的返回值类型, Future<void>的回调没有参数
+template <typename F, typename T>
+struct FutureInvokeResult {
+  using type = typename std::invoke_result<F, const T&>::type;
+};
+
+template <typename F>
+struct FutureInvokeResult<F, void> {
+  using type = typename std::invoke_result<F>::type;
+};
+
+/*
+ * 异步结果
+ * 在调度协程中等待时挂起协程而不阻塞线程, 在普通线程中等待时阻塞线程
+ * */
+template <typename T>
+class Future {
+  friend class Promise<T>;
+ public:
+  using ValueType = T;
+
+  Future() = default;
+
+  bool valid() const {return !!m_state;}
+  bool isReady() const {return m_state->isReady();}
+
+  void wait() const {m_state->wait();}
+  // 最多等待timeout_ms毫秒, 超时返回false
+  bool waitFor(uint64_t timeout_ms) const {return m_state->wait(timeout_ms);}
+
+  // 等待并返回结果, 如果设置的是异常则重新抛出
+  T get() const {
+    m_state->wait();
+    if constexpr (std::is_void<T>::value) {
+      m_state->getValue();
+    } else {
+      return m_state->getValue();
+    }
+  }
+
+  bool hasException() const {
+    return m_state->isReady() && m_state->getException();
+  }
+
+  // 就绪后返回保存的异常, 没有异常返回空
+  std::exception_ptr getException() const {
+    return m_state->isReady() ? m_state->getException() : nullptr;
+  }
+
+  // 就绪后(不论是值还是异常)在设置结果的协程中执行cb(*this)
+  void onComplete(std::function<void(const Future&)> cb) const {
+    Future self = *this;
+    m_state->addCallback([self, cb]() {
+        cb(self);
+      });
+  }
+
+  /*
+   * 结果就绪后执行fn(value), 返回fn结果的Future
+   * scheduler为空时fn在设置结果的协程中执行, 否则调度到scheduler上执行
+   * 前一个Future是异常时fn不会被调用, 异常会传递给返回的Future
+   * */
+  template <typename F>
+  auto then(F fn, Scheduler* scheduler = nullptr) const
+      -> Future<typename FutureInvokeResult<F, T>::type> {
+    using R = typename FutureInvokeResult<F, T>::type;
+    Promise<R> promise;
+    Future<R> future = promise.getFuture();
+    auto state = m_state;
+    std::function<void()> cb = [state, promise, fn]() mutable {
+      if (state->getException()) {
+        promise.setException(state->getException());
+        return;
+      }
+      try {
+        if constexpr (std::is_void<T>::value) {
+          RunAndSet(promise, fn);
+        } else {
+          RunAndSet(promise, fn, state->getValue());
+        }
+      } catch (...) {
+        promise.setException(std::current_exception());
+      }
+    };
+    if (scheduler) {
+      m_state->addCallback([scheduler, cb]() {
+          if (!scheduler->schedule(cb)) {
+            cb(); // 调度器队列满拒绝了任务, 在当前协程执行
+          }
+        });
+    } else {
+      m_state->addCallback(std::move(cb));
+    }
+    return future;
+  }
+
+ private:
+  template <typename R, typename F, typename... Args>
+  static void RunAndSet(Promise<R>& promise, F& fn, Args&&... args) {
+    if constexpr (std::is_void<R>::value) {
+      fn(std::forward<Args>(args)...);
+      promise.setValue();
+    } else {
+      promise.setValue(fn(std::forward<Args>(args)...));
+    }
+  }
+
+  explicit Future(typename FutureState<T>::ptr state) : m_state(std::move(state)) {}
+
+ private:
+  typename FutureState<T>::ptr m_state;
+};
+
+template <typename T>
+class Promise {
+ public:
+  Promise() : m_state(std::make_shared<FutureState<T>>()) {}
+
+  Future<T> getFuture() const {return Future<T>(m_state);}
+
+  // 设置结果, 只有第一次设置生效, 返回是否生效
+  template <typename... Args>
+  bool setValue(Args&&... args) {
+    return m_state->trySetValue(std::forward<Args>(args)...);
+  }
+
+  bool setException(std::exception_ptr e) {
+    return m_state->trySetException(std::move(e));
+  }
+
+ private:
+  typename FutureState<T>::ptr m_state;
+};
+
+// 把fn调度到scheduler上执行, 返回fn结果的Future; 调度器拒绝任务时Future以异常就绪
+template <typename F>
+auto async(Scheduler* scheduler, F fn) -> Future<typename std::invoke_result<F>::type> {
+  using R = typename std::invoke_result<F>::type;
+  Promise<R> promise;
+  Future<R> future = promise.getFuture();
+  bool rt = scheduler->schedule(std::function<void()>([promise, fn]() mutable {
+      try {
+        if constexpr (std::is_void<R>::value) {
+          fn();
+          promise.setValue();
+        } else {
+          promise.setValue(fn());
+        }
+      } catch (...) {
+        promise.setException(std::current_exception());
+      }
+    }));
+  if (!rt) {
+    promise.setException(std::make_exception_ptr(std::runtime_error("scheduler queue is full")));
+  }
+  return future;
+}
+
+// 所有Future都就绪后就绪, 结果按输入顺序排列; 任意一个是异常时以第一个异常就绪
+template <typename T>
+auto whenAll(const std::vector<Future<T>>& futures)
+    -> Future<typename std::conditional<std::is_void<T>::value, void, std::vector<T>>::type> {
+  using R = typename std::conditional<std::is_void<T>::value, void, std::vector<T>>::type;
+  using SlotType = typename std::conditional<std::is_void<T>::value, FutureUnit, T>::type;
+  // 每个结果单独一个槽位, 不同线程写不同下标不会冲突(std::vector<bool>按位存放, 不能直接用)
+  struct Context {
+    Promise<R> promise;
+    std::vector<std::optional<SlotType>> values;
+    std::atomic<size_t> left {0};
+  };
+  auto ctx = std::make_shared<Context>();
+  Future<R> future = ctx->promise.getFuture();
+  if (futures.empty()) {
+    ctx->promise.setValue();
+    return future;
+  }
+  ctx->values.resize(futures.size());
+  ctx->left = futures.size();
+  for (size_t i = 0; i < futures.size(); ++i) {
+    futures[i].onComplete([ctx, i](const Future<T>& f) {
+      if (f.getException()) {
+        ctx->promise.setException(f.getException());
+        return;
+      }
+      if constexpr (!std::is_void<T>::value) {
+        ctx->values[i].emplace(f.get());
+      }
+      if (--ctx->left == 0) {
+        if constexpr (std::is_void<T>::value) {
+          ctx->promise.setValue();
+        } else {
+          R values;
+          values.reserve(ctx->values.size());
+          for (auto& v : ctx->values) {
+            values.push_back(std::move(*v));
+          }
+          ctx->promise.setValue(std::move(values));
+        }
+      }
+    });
+  }
+  return future;
+}
+
+// 任意一个Future就绪后就绪, 结果是(下标, 值); 第一个就绪的是异常时以该异常就绪
+template <typename T>
+auto whenAny(const std::vector<Future<T>>& futures)
+    -> Future<typename std::conditional<std::is_void<T>::value,
+                                        size_t, std::pair<size_t, T>>::type> {
+  using R = typename std::conditional<std::is_void<T>::value,
+                                      size_t, std::pair<size_t, T>>::type;
+  Promise<R> promise;
+  Future<R> future = promise.getFuture();
+  if (futures.empty()) {
+    promise.setException(std::make_exception_ptr(std::invalid_argument("whenAny: no futures")));
+    return future;
+  }
+  for (size_t i = 0; i < futures.size(); ++i) {
+    futures[i].onComplete([promise, i](const Future<T>& f) mutable {
+      if (f.getException()) {
+        promise.setException(f.getException());
+      } else if constexpr (std::is_void<T>::value) {
+        promise.setValue(i);
+      } else {
+        promise.setValue(i, f.get());
+      }
+    });
+  }
+  return future;
+}
+
+}
+
+#endif //SYLAR_SYLAR_FUTURE_H_
@@ -7,8 +7,14 @@
 #include "fd_manager.h"
 #include "log.h"
 #include "config.h"
+#include "fiber_sync.h"
+#include "task_group.h"
+#include "deadline.h"
 
 #include <dlfcn.h>
+#include <algorithm>
+#include <sched.h>
+#include <atomic>
 
 namespace sylar {
 
@@ -17,6 +23,10 @@ static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 static sylar::ConfigVar<int>::ptr g_tcp_connect_timeout = 
   sylar::Config::Lookup("tcp.connect.timeout", 5000, "tcp connect timeout");
 
+static sylar::ConfigVar<uint64_t>::ptr g_accept_high_water =
+  sylar::Config::Lookup<uint64_t>("scheduler.accept_high_water", 0,
+      "hooked accept waits while the run queue is deeper than this, 0 means never");
+
 static thread_local bool t_hook_enable = false; // hook是否可用
 
 #define HOOK_FUN(XX) \
@@ -60,15 +70,22 @@ void hook_init() {
 }
 
 static uint64_t s_connect_timeout = -1;
+static std::atomic<uint64_t> s_accept_high_water {0};
 struct _HookIniter {
   _HookIniter() {
 	  hook_init(); // 在main函数之前执行hook_init函数
-    s_connect_timeout = g_tcp_connect_timeout->getValue();
+    s_connect_timeout = *g_tcp_connect_timeout->getValue();
 
     g_tcp_connect_timeout->addListener([](const int& old_value, const int& new_value) {
         SYLAR_LOG_INFO(g_logger) << "tcp connect timeout changed from " << old_value << " to " << new_value;
         s_connect_timeout = new_value;
       });
+
+    s_accept_high_water.store(*g_accept_high_water->getValue(), std::memory_order_relaxed);
+    g_accept_high_water->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+        SYLAR_LOG_INFO(g_logger) << "accept high water changed from " << old_value << " to " << new_value;
+        s_accept_high_water.store(new_value, std::memory_order_relaxed);
+      });
   }
 };
 
@@ -82,10 +99,102 @@ void set_hook_enable(bool flag) {
  t_hook_enable = flag;
 }
 
+/*
+ * __errno_location()被声明为const, 编译器会在同一个函数里复用算出来的errno地址,
+ * 而协程挂起后可能在另一个线程被唤醒, 所以协程切换之后要通过这个函数访问errno
+ * */
+__attribute__((noinline, noipa)) static int& fiber_errno() {
+  return errno;
+}
+
+/*
+ * 一次等待的唤醒原因, 超时定时器/取消令牌/事件到来三方谁先把cancelled从0改掉谁负责唤醒
+ * 超时或取消一方在cancelEvent结束后置settled, 协程要等它结束才能再次在这个fd上注册事件
+ * */
 struct timer_info {
-  int cancelled = 0;
+  std::atomic<int> cancelled {0};
+  std::atomic<bool> settled {false};
 };
 
+// 超时或取消时调用, 只有抢到唤醒权的一方取消事件
+static void cancel_wait(const std::weak_ptr<timer_info>& winfo, int reason,
+    IOManager* iom, int fd, uint32_t event) {
+  auto t = winfo.lock();
+  if (!t) {
+    return;
+  }
+  int expected = 0;
+  if (!t->cancelled.compare_exchange_strong(expected, reason)) {
+    return;
+  }
+  iom->cancelEvent(fd, IOManager::Event(event));
+  t->settled.store(true, std::memory_order_release);
+}
+
+// 协程被唤醒后调用, 事件先到返回0, 否则等对方的cancelEvent结束后返回超时或取消原因
+static int claim_wait(timer_info& info) {
+  int expected = 0;
+  if (info.cancelled.compare_exchange_strong(expected, -1)) {
+    return 0;
+  }
+  while (!info.settled.load(std::memory_order_acquire)) {
+    sched_yield();
+  }
+  return expected;
+}
+
+// 调度器队列超过高水位时暂停accept, 先处理已经接入的连接, 新连接留在内核的backlog里
+// 挂起在FiberWaiter上, 调度线程取出任务使队列降到高水位以下时唤醒, 不轮询
+static void accept_backpressure() {
+  uint64_t high_water = s_accept_high_water.load(std::memory_order_relaxed);
+  if (!t_hook_enable || !high_water) {
+    return;
+  }
+  IOManager* iom = IOManager::GetThis();
+  if (!iom) {
+    return;
+  }
+  CancellationToken::ptr token = CancellationToken::GetCurrent();
+  while (!token || !token->isCancelled()) {
+    auto waiter = std::make_shared<FiberWaiter>();
+    if (!iom->waitQueueDepth(high_water, waiter)) {
+      return;
+    }
+    uint64_t id = 0;
+    if (token) {
+      id = token->addCallback([waiter](int reason) {
+          waiter->notify(reason);
+        });
+    }
+    waiter->wait();
+    if (id) {
+      token->delCallback(id);
+    }
+  }
+}
+
+// 把当前协程的取消令牌关联到这次等待: 取消时设置错误码并取消事件, 唤醒等待的协程
+static uint64_t watch_cancel(const CancellationToken::ptr& token, std::weak_ptr<timer_info> winfo,
+    int fd, IOManager* iom, uint32_t event) {
+  return token->addCallback([winfo, fd, iom, event](int reason) {
+      cancel_wait(winfo, reason, iom, fd, event);
+    });
+}
+
+// 带取消令牌的协程中的sleep, 被取消时提前返回取消原因, 正常结束返回0
+static int cancellable_sleep(uint64_t ms, const CancellationToken::ptr& token) {
+  auto waiter = std::make_shared<FiberWaiter>();
+  uint64_t id = token->addCallback([waiter](int reason) {
+      waiter->notify(reason);
+    });
+  Fiber::SetWaitReason(Fiber::WAIT_SLEEP, ms);
+  waiter->waitFor(ms);
+  if (id) {
+    token->delCallback(id);
+  }
+  return token->getReason();
+}
+
 template <typename OriginFun, typename... Args>
 static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
     uint32_t event, int timeout_so, Args&&... args) {
@@ -112,31 +221,38 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
   }
 
   uint64_t to = ctx->getTimeout(timeout_so); // 取得超时时间
-  auto tinfo = std::make_shared<timer_info>();
 
 retry:
   ssize_t n = fun(fd, std::forward<Args>(args)...);
   // 这里如果返回非负数，代表读到数据或者操作成功,直接返回函数
-  while (n == -1 && errno == EINTR) {
+  while (n == -1 && fiber_errno() == EINTR) {
 	// 被系统中断,直接进行重试
     n = fun(fd, std::forward<Args>(args)...);
   }
-  if (n == -1 && errno == EAGAIN) {
+  if (n == -1 && fiber_errno() == EAGAIN) {
+    sylar::CancellationToken::ptr token = sylar::CancellationToken::GetCurrent();
+    if (token && token->isCancelled()) {
+      fiber_errno() = token->getReason();
+      return -1;
+    }
+    // 每次等待都重新计算: 取fd超时和协程剩余时间中较小的一个
+    uint64_t remain = sylar::GetDeadlineRemainingMS();
+    if (remain == 0) {
+      fiber_errno() = ETIMEDOUT;
+      return -1;
+    }
+    uint64_t wait_ms = std::min(to, remain);
     sylar::IOManager* iom = sylar::IOManager::GetThis();
     sylar::Timer::ptr timer;
+    // 每次等待一个新的timer_info, 上一次等待的唤醒标记不会影响这一次
+    auto tinfo = std::make_shared<timer_info>();
     std::weak_ptr<timer_info> winfo(tinfo);
 
-    if (to != (uint64_t)-1) {
+    if (wait_ms != (uint64_t)-1) {
       // 有设置超时，放进定时器
-      timer = iom->addConditionalTimer(to, [winfo, fd, iom, event]() {
-          auto t = winfo.lock();
-          if (!t || t->cancelled) {
-			      // 定时器不存在或设置了错误代码(不是0)
-            return;
-          }
-		  // 定时器设置为超时，并取消该定时器
-          t->cancelled = ETIMEDOUT;
-          iom->cancelEvent(fd, sylar::IOManager::Event(event));
+      timer = iom->addConditionalTimer(wait_ms, [winfo, fd, iom, event]() {
+          // 没有被事件或取消抢先时设置为超时, 并取消事件唤醒协程
+          cancel_wait(winfo, ETIMEDOUT, iom, fd, event);
         }, winfo);
     }
 
@@ -150,14 +266,21 @@ retry:
       }
       return -1;
     } else {
+      uint64_t cancel_id = token ? watch_cancel(token, winfo, fd, iom, event) : 0;
+      sylar::Fiber::SetWaitReason(event == sylar::IOManager::READ
+          ? sylar::Fiber::WAIT_READ : sylar::Fiber::WAIT_WRITE, fd);
       sylar::Fiber::YieldToHold();
       // 这里被唤醒
-      // 两种情况: 1. 事件被取消了 2. 有数据到来
+      // 两种情况: 1. 事件被取消了(超时或令牌取消) 2. 有数据到来
       if (timer) {
         timer->cancel();
       }
-      if (tinfo->cancelled) {
-        errno = tinfo->cancelled;
+      if (cancel_id) {
+        token->delCallback(cancel_id);
+      }
+      int reason = claim_wait(*tinfo);
+      if (reason) {
+        fiber_errno() = reason;
         return -1;
       }
 
@@ -184,11 +307,17 @@ extern "C" {
 	  return sleep_f(seconds);
 	}
 
+	sylar::CancellationToken::ptr token = sylar::CancellationToken::GetCurrent();
+	if (token) {
+	  return sylar::cancellable_sleep(seconds * 1000, token) ? seconds : 0;
+	}
+
 	sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
 	sylar::IOManager* iom = sylar::IOManager::GetThis();
-  iom->addTimer(seconds * 1000, std::bind((void(sylar::Scheduler::*)
+  iom->addTimer(seconds * 1000, std::bind((bool(sylar::Scheduler::*)
           (sylar::Fiber::ptr, int thread))&sylar::IOManager::schedule
         , iom, fiber, -1));
+	sylar::Fiber::SetWaitReason(sylar::Fiber::WAIT_SLEEP, seconds * 1000);
 	sylar::Fiber::YieldToHold();
 	return 0;
   }
@@ -199,11 +328,22 @@ extern "C" {
 	  return usleep_f(usec);
 	}
 
+	sylar::CancellationToken::ptr token = sylar::CancellationToken::GetCurrent();
+	if (token) {
+	  int rt = sylar::cancellable_sleep(usec / 1000, token);
+	  if (rt) {
+	    sylar::fiber_errno() = rt;
+	    return -1;
+	  }
+	  return 0;
+	}
+
 	sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
 	sylar::IOManager* iom = sylar::IOManager::GetThis();
-  iom->addTimer(usec / 1000, std::bind((void(sylar::Scheduler::*)
+  iom->addTimer(usec / 1000, std::bind((bool(sylar::Scheduler::*)
           (sylar::Fiber::ptr, int thread))&sylar::IOManager::schedule
         , iom, fiber, -1));
+	sylar::Fiber::SetWaitReason(sylar::Fiber::WAIT_SLEEP, usec / 1000);
 	sylar::Fiber::YieldToHold();
 	return 0;
   }
@@ -214,11 +354,21 @@ extern "C" {
 	  }
 
 	  long timeout_ms = rqtp->tv_sec * 1000L + rqtp->tv_nsec / 1000000L;
+	  sylar::CancellationToken::ptr token = sylar::CancellationToken::GetCurrent();
+	  if (token) {
+	    int rt = sylar::cancellable_sleep(timeout_ms, token);
+	    if (rt) {
+	      sylar::fiber_errno() = rt;
+	      return -1;
+	    }
+	    return 0;
+	  }
 	  sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
 	  sylar::IOManager* iom = sylar::IOManager::GetThis();
-    iom->addTimer(timeout_ms, std::bind((void(sylar::Scheduler::*)
+    iom->addTimer(timeout_ms, std::bind((bool(sylar::Scheduler::*)
             (sylar::Fiber::ptr, int thread))&sylar::IOManager::schedule
             , iom, fiber, -1));
+	  sylar::Fiber::SetWaitReason(sylar::Fiber::WAIT_SLEEP, timeout_ms);
 	  sylar::Fiber::YieldToHold();
 	  return 0;
   }
@@ -258,6 +408,17 @@ extern "C" {
       return n;
     }
 
+    sylar::CancellationToken::ptr token = sylar::CancellationToken::GetCurrent();
+    if (token && token->isCancelled()) {
+      errno = token->getReason();
+      return -1;
+    }
+    uint64_t remain = sylar::GetDeadlineRemainingMS();
+    if (remain == 0) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+    timeout_ms = std::min(timeout_ms, remain);
     sylar::IOManager* iom = sylar::IOManager::GetThis();
     sylar::Timer::ptr timer;
     auto tinfo = std::make_shared<sylar::timer_info>();
@@ -266,23 +427,24 @@ extern "C" {
     if (timeout_ms != (uint64_t)-1) {
       // 设置定时器
       timer = iom->addConditionalTimer(timeout_ms, [winfo, sockfd, iom]() {
-          auto t = winfo.lock();
-          if (!t || t->cancelled) {
-            return;
-          }
-          t->cancelled = ETIMEDOUT;
-          iom->cancelEvent(sockfd, sylar::IOManager::WRITE);
+          sylar::cancel_wait(winfo, ETIMEDOUT, iom, sockfd, sylar::IOManager::WRITE);
         }, winfo);
     }
 
     int rt = iom->addEvent(sockfd, sylar::IOManager::WRITE);
     if (rt == 0) {
+      uint64_t cancel_id = token ? sylar::watch_cancel(token, winfo, sockfd, iom, sylar::IOManager::WRITE) : 0;
+      sylar::Fiber::SetWaitReason(sylar::Fiber::WAIT_CONNECT, sockfd);
       sylar::Fiber::YieldToHold();
       if (timer) {
         timer->cancel();
       }
-      if (tinfo->cancelled) {
-        errno = tinfo->cancelled;
+      if (cancel_id) {
+        token->delCallback(cancel_id);
+      }
+      int reason = sylar::claim_wait(*tinfo);
+      if (reason) {
+        sylar::fiber_errno() = reason;
         return -1;
       }
     } else {
@@ -299,7 +461,7 @@ extern "C" {
     if (error == 0) {
       return 0;
     } else {
-      errno = error;
+      sylar::fiber_errno() = error;
       return -1;
     }
   }
@@ -309,6 +471,7 @@ extern "C" {
   }
 
   int accept(int s, struct sockaddr* addr, socklen_t* addrlen) {
+    sylar::accept_backpressure();
     int fd = sylar::do_io(s, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
     if (fd >= 0) {
       sylar::FdMgr::GetInstance()->get(fd, true);
@@ -4,7 +4,10 @@
 
 #include "iomanager.h"
 #include "log.h"
+#include "log_limit.h"
 #include "macro.h"
+#include "watchdog.h"
+#include "metrics.h"
 
 #include <sys/epoll.h>
 #include <unistd.h>
@@ -80,7 +83,7 @@ int IOManager::addEvent(int fd, IOManager::Event event, std::function<void()> cb
 
   int rt = epoll_ctl(m_epfd, op, fd, &event1);
   if (rt) {
-	SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+	SYLAR_LOG_ERROR_LIMITED(g_logger) << "epoll_ctl(" << m_epfd << ", "
 		<< op << ", " << fd << ", " << event1.events << ");"
 		<< rt << " (" << errno << ") (" << strerror(errno) << ")";
 	return -1;
@@ -126,7 +129,7 @@ bool IOManager::delEvent(int fd, IOManager::Event event) {
 
   int rt = epoll_ctl(m_epfd, op, fd, &epevent);
   if (rt) {
-	SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+	SYLAR_LOG_ERROR_LIMITED(g_logger) << "epoll_ctl(" << m_epfd << ", "
 							  << op << ", " << fd << ", " << epevent.events << ");"
 							  << rt << " (" << errno << ") (" << strerror(errno) << ")";
 	return false;
@@ -164,7 +167,7 @@ bool IOManager::cancelEvent(int fd, IOManager::Event event) {
 
   int rt = epoll_ctl(m_epfd, op, fd, &epevent);
   if (rt) {
-	SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+	SYLAR_LOG_ERROR_LIMITED(g_logger) << "epoll_ctl(" << m_epfd << ", "
 							  << op << ", " << fd << ", " << epevent.events << ");"
 							  << rt << " (" << errno << ") (" << strerror(errno) << ")";
 	return false;
@@ -198,7 +201,7 @@ bool IOManager::cancelAll(int fd) {
 
   int rt = epoll_ctl(m_epfd, op, fd, &epevent);
   if (rt) {
-	SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+	SYLAR_LOG_ERROR_LIMITED(g_logger) << "epoll_ctl(" << m_epfd << ", "
 							  << op << ", " << fd << ", " << epevent.events << ");"
 							  << rt << " (" << errno << ") (" << strerror(errno) << ")";
 	return false;
@@ -217,6 +220,12 @@ bool IOManager::cancelAll(int fd) {
   return true;
 }
 
+void IOManager::getStats(Stats& stats) {
+  Scheduler::getStats(stats);
+  stats.pendingEvents = m_pendingEventCount;
+  stats.timers = getTimerCount();
+}
+
 IOManager *IOManager::GetThis() {
   return dynamic_cast<IOManager*>(Scheduler::GetThis());
 }
@@ -238,6 +247,7 @@ void IOManager::tickle() {
   }
   int rt = write(m_tickleFds[1], "T", 1);
   SYLAR_ASSERT(rt == 1);
+  MetricsManager::Add(MetricsManager::TICKLES);
 }
 
 bool IOManager::stopping(uint64_t& timeout) {
@@ -259,6 +269,8 @@ void IOManager::idle() {
   });
 
   while (true) {
+    // 回到事件循环, 检查上一轮从epoll_wait返回后是否卡顿
+    WatchdogManager::LoopEnter();
     uint64_t next_timeout = 0;
     if (stopping(next_timeout)) {
 	  SYLAR_LOG_INFO(g_logger) << "name=" << getName() << " idle stopping exit";
@@ -282,12 +294,15 @@ void IOManager::idle() {
         break;
       }
     } while (true);
+    WatchdogManager::LoopWake();
+    MetricsManager::Add(MetricsManager::EPOLL_WAITS);
 
     std::vector<std::function<void()>> cbs;
 	listExpiredCb(cbs);
 	if (!cbs.empty()) {
+	  MetricsManager::Add(MetricsManager::TIMERS_EXPIRED, cbs.size());
 	  // 把超时的任务，全部加入调度器中
-	  schedule(cbs.begin(), cbs.end());
+	  scheduleInternal(cbs.begin(), cbs.end());
 	}
 
     for (int i = 0; i < rt; ++i) {
@@ -299,6 +314,7 @@ void IOManager::idle() {
 		continue;
       }
       // 是具体的事件
+      MetricsManager::Add(MetricsManager::EPOLL_EVENTS);
       FdContext* fd_ctx = (FdContext*)event.data.ptr;
       FdContext::MutexType::Lock lock(fd_ctx->mutex);
       if (event.events & (EPOLLERR | EPOLLHUP)) {
@@ -312,7 +328,9 @@ void IOManager::idle() {
         real_events |= WRITE;
       }
 
-      if ((fd_ctx->events & real_events) == NONE) {
+      // EPOLLERR/EPOLLHUP会同时带上读写, 只触发实际注册过的事件
+      real_events &= fd_ctx->events;
+      if (real_events == NONE) {
         // fd_ctx没有读和写事件，可能被处理过了
 		continue;
       }
@@ -323,7 +341,7 @@ void IOManager::idle() {
 
       int rt2 = epoll_ctl(m_epfd, op, fd_ctx->fd, &event);
       if (rt2) {
-		SYLAR_LOG_ERROR(g_logger) << "epoll_ctl(" << m_epfd << ", "
+		SYLAR_LOG_ERROR_LIMITED(g_logger) << "epoll_ctl(" << m_epfd << ", "
 								  << op << ", " << fd_ctx->fd << ", " << event.events << ");"
 								  << rt2 << " (" << errno << ") (" << strerror(errno) << ")";
 		continue;
@@ -375,10 +393,12 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
   SYLAR_ASSERT(events & event);
   events = (Event) (events & ~event);
   EventContext& ctx = getContext(event);
+  // 传指针让调度器把cb/fiber交换走, 否则同一个fd再次addEvent时会断言失败
+  // IO事件唤醒的任务对延迟敏感, 放进高优先级队列
   if (ctx.cb) {
-    ctx.scheduler->schedule(ctx.cb);
+    ctx.scheduler->scheduleInternal(&ctx.cb, Scheduler::HIGH);
   } else {
-    ctx.scheduler->schedule(ctx.fiber);
+    ctx.scheduler->scheduleInternal(&ctx.fiber, Scheduler::HIGH);
   }
   ctx.scheduler = nullptr;
 }
@@ -54,6 +54,9 @@ class IOManager : public Scheduler, public TimerManager {
 
   static IOManager* GetThis(); // 获取当前线程的IOManager
 
+  size_t getPendingEventCount() const {return m_pendingEventCount;}
+  void getStats(Stats& stats) override;
+
  protected:
   void tickle() override;
   bool stopping() override;
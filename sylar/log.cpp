@@ -3,123 +3,206 @@
 //
 
 #include "log.h"
+#include "log_binary.h"
+#include "log_rotate.h"
+#include "log_mmap.h"
+#include "log_structured.h"
 #include "config.h"
+#include "watchdog.h"
 
 #include <map>
+#include <set>
 #include <utility>
+#include <cstring>
 #include <time.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 
 namespace sylar{
 
 
+void LogWriter::AppendTime(std::string& out, const char* fmt, time_t t) {
+  tm tmp {};
+  localtime_r(&t, &tmp);
+  char buf[64];
+  size_t n = strftime(buf, sizeof(buf), fmt, &tmp);
+  out.append(buf, n);
+}
+
+// 线程局部的日期缓存, 几个appender格式不同时各占一项
+struct TimeCacheEntry {
+  uint64_t id = 0;
+  time_t second = -1;
+  size_t size = 0;
+  char text[64];
+};
+
+static constexpr int kTimeCacheSize = 4;
+static thread_local TimeCacheEntry t_time_cache[kTimeCacheSize];
+static thread_local int t_time_cache_next = 0;
+static std::atomic<uint64_t> s_time_format_id {0};
+
+uint64_t LogWriter::NextTimeFormatId() {
+  return ++s_time_format_id;
+}
+
+void LogWriter::AppendTime(std::string& out, uint64_t id, const char* fmt, time_t t) {
+  TimeCacheEntry* entry = nullptr;
+  for (auto& i : t_time_cache) {
+    if (i.id == id) {
+      if (i.second == t) {
+        out.append(i.text, i.size);
+        return;
+      }
+      entry = &i;
+      break;
+    }
+  }
+  if (!entry) {
+    entry = &t_time_cache[t_time_cache_next];
+    t_time_cache_next = (t_time_cache_next + 1) % kTimeCacheSize;
+  }
+  tm tmp {};
+  localtime_r(&t, &tmp);
+  entry->id = id;
+  entry->second = t;
+  entry->size = strftime(entry->text, sizeof(entry->text), fmt, &tmp);
+  out.append(entry->text, entry->size);
+}
+
+#define SYLAR_FORMAT_ITEM_ARGS \
+  std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event
+
 class MessageFormatItem : public LogFormatter::FormatItem {
  public:
   explicit MessageFormatItem(const std::string& str = "") {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	out << event->getContent();
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	out.append(event->getContentData(), event->getContentSize());
+	if (event->hasFields()) {
+	  LogEscape::AppendLogfmtFields(out, *event);
+	}
   }
 };
 
 class LevelFormatItem : public LogFormatter::FormatItem {
  public:
   explicit LevelFormatItem(const std::string& str = "") {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	out << LogLevel::toString(level);
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	out.append(LogLevel::toString(level));
   }
 };
 
 class ElapseFormatItem : public LogFormatter::FormatItem {
  public:
   explicit ElapseFormatItem(const std::string& str = "") {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	out << event->getElapse();
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	LogWriter::AppendUInt(out, event->getElapse());
   }
 };
 
 class NameFormatItem : public LogFormatter::FormatItem {
  public:
   explicit NameFormatItem(const std::string& str = "") {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
 	// out << logger->getName();
-	out << event->getLogger()->getName();
+	out.append(event->getLogger()->getName());
   }
 };
 
 class ThreadIdFormatItem : public LogFormatter::FormatItem {
  public:
   explicit ThreadIdFormatItem(const std::string& str = "") {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	out << event->getThreadId();
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	LogWriter::AppendUInt(out, event->getThreadId());
   }
 };
 
 class ThreadNameFormatItem : public LogFormatter::FormatItem {
  public:
   explicit ThreadNameFormatItem(const std::string& str = "") {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	out << event->getThreadName();
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	out.append(event->getThreadName());
   }
 };
 
 class FiberIdFormatItem : public LogFormatter::FormatItem {
  public:
   explicit FiberIdFormatItem(const std::string& str = "") {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	out << event->getFiberId();
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	LogWriter::AppendUInt(out, event->getFiberId());
   }
 };
 
 class DateTimeFormatItem : public LogFormatter::FormatItem {
  public:
   explicit DateTimeFormatItem(std::string format = "%Y-%m-%d %H:%M:%S")
-	  : m_format(std::move(format)) {
+	  : m_format(std::move(format)),
+	    m_id(LogWriter::NextTimeFormatId()) {
     if (m_format.empty()) {
       m_format = "%Y-%m-%d %H:%M:%S";
     }
   }
 
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	tm tmp {};
-	time_t t = event->getTime();
-	localtime_r(&t, &tmp);
-	char buf[64];
-	strftime(buf, sizeof(buf), m_format.c_str(), &tmp);
-    out << buf;
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	LogWriter::AppendTime(out, m_id, m_format.c_str(), event->getTime());
   }
  private:
   std::string m_format;
+  uint64_t m_id;
+};
+
+// 时间戳的毫秒部分, 3位
+class MilliSecondFormatItem : public LogFormatter::FormatItem {
+ public:
+  explicit MilliSecondFormatItem(const std::string& str = "") {}
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	LogWriter::AppendPadded(out, event->getTimeUs() / 1000 % 1000, 3);
+  }
+};
+
+// 时间戳的微秒部分, 6位
+class MicroSecondFormatItem : public LogFormatter::FormatItem {
+ public:
+  explicit MicroSecondFormatItem(const std::string& str = "") {}
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	LogWriter::AppendPadded(out, event->getTimeUs() % 1000000, 6);
+  }
 };
 
 class FileNameFormatItem : public LogFormatter::FormatItem {
  public:
   explicit FileNameFormatItem(const std::string& str = "") {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	out << event->getFile();
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	out.append(event->getFile());
   }
 };
 
 class LineFormatItem : public LogFormatter::FormatItem {
  public:
   explicit LineFormatItem(const std::string& str = "") {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	out << event->getLine();
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	LogWriter::AppendInt(out, event->getLine());
   }
 };
 
 class NewLineFormatItem : public LogFormatter::FormatItem {
  public:
   explicit NewLineFormatItem(const std::string& str = "") {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	out << std::endl;
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	out.push_back('\n');
   }
 };
 
 class TabFormatItem : public LogFormatter::FormatItem {
  public:
   explicit TabFormatItem(const std::string& str = "") {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	out << "\t";
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	out.push_back('\t');
   }
 };
 
@@ -127,81 +210,141 @@ class StringFormatItem : public LogFormatter::FormatItem {
  public:
   explicit StringFormatItem(const std::string& str)
   	:FormatItem(str), m_string(str) {}
-  void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override {
-	out << m_string;
+  void format(SYLAR_FORMAT_ITEM_ARGS) override {
+	out.append(m_string);
   }
  private:
   std::string m_string;
 };
 
-Logger::Logger(std::string name) : m_name (std::move(name)), m_level(LogLevel::DEBUG) {
+#undef SYLAR_FORMAT_ITEM_ARGS
+
+// 每个线程一个格式化缓冲, 复用时保留容量
+static std::string& FormatBuffer() {
+  static thread_local std::string t_buffer;
+  t_buffer.clear();
+  return t_buffer;
+}
+
+Logger::Logger(std::string name)
+	: m_name (std::move(name)), m_level(LogLevel::DEBUG), m_appenders(new std::vector<LogAppender::ptr>) {
   m_logformatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m\n"));
 }
 
+Logger::~Logger() {
+  delete m_appenders.load();
+}
+
 void Logger::log(LogLevel::Level level, const LogEvent::ptr& event) {
-  if (level >= m_level) {
-	auto self = shared_from_this();
-	MutexType::Lock lock(m_mutex);
-	if (!m_appenders.empty()) {
-	  for (auto& c : m_appenders) {
+  if (isEnabled(level)) {
+	log(level, event, shared_from_this());
+  }
+}
+
+void Logger::logBinary(LogLevel::Level level, const BinaryLogRecord& record) {
+  if (isEnabled(level)) {
+	logBinary(level, record, shared_from_this());
+  }
+}
+
+void Logger::log(LogLevel::Level level, const LogEvent::ptr& event, const Logger::ptr& self) {
+  if (isEnabled(level)) {
+	// 不持有m_mutex调用appender, appender阻塞(如异步appender的BLOCK策略)不会挡住别的线程和配置修改
+	Rcu::ReadGuard guard;
+	auto appenders = m_appenders.load();
+	if (!appenders->empty()) {
+	  for (auto& c : *appenders) {
 		c->log(self, level, event);
 	  }
 	} else if (m_root) {
-	  m_root->log(level, event);
+	  m_root->log(level, event, m_root);
 	}
   }
 }
 
-void Logger::debug(LogEvent::ptr event) {
+void Logger::logBinary(LogLevel::Level level, const BinaryLogRecord& record, const Logger::ptr& self) {
+  if (isEnabled(level)) {
+	Rcu::ReadGuard guard;
+	auto appenders = m_appenders.load();
+	if (!appenders->empty()) {
+	  for (auto& c : *appenders) {
+		c->logBinary(self, level, record);
+	  }
+	} else if (m_root) {
+	  m_root->logBinary(level, record, m_root);
+	}
+  }
+}
+
+void Logger::debug(const LogEvent::ptr& event) {
   // debug(LogLevel::DEBUG, events);
   log(LogLevel::DEBUG, event);
 }
 
-void Logger::info(LogEvent::ptr event) {
+void Logger::info(const LogEvent::ptr& event) {
   log(LogLevel::INFO, event);
 }
 
-void Logger::warn(LogEvent::ptr event) {
+void Logger::warn(const LogEvent::ptr& event) {
   log(LogLevel::WARN, event);
 }
 
-void Logger::error(LogEvent::ptr event) {
+void Logger::error(const LogEvent::ptr& event) {
   log(LogLevel::ERROR, event);
 }
 
-void Logger::fatal(LogEvent::ptr event) {
+void Logger::fatal(const LogEvent::ptr& event) {
   log(LogLevel::FATAL, event);
 }
 
 void Logger::addAppender(LogAppender::ptr appender) {
-  MutexType::Lock lock(m_mutex);
-   if (!appender->getFormatter()) {
-     MutexType::Lock li(appender->m_mutex);
-     appender->m_formatter = m_logformatter;
-   }
-  m_appenders.push_back(appender);
+  const std::vector<LogAppender::ptr>* old;
+  {
+    MutexType::Lock lock(m_mutex);
+    if (!appender->getFormatter()) {
+      MutexType::Lock li(appender->m_mutex);
+      appender->m_formatter = m_logformatter;
+    }
+    old = m_appenders.load();
+    auto appenders = new std::vector<LogAppender::ptr>(*old);
+    appenders->push_back(appender);
+    m_appenders.store(appenders);
+  }
+  // 旧集合里的appender可能在析构时写日志, 在锁外退休
+  Rcu::Retire(old);
 }
 
 void Logger::deleteAppender(LogAppender::ptr appender) {
-  MutexType::Lock lock(m_mutex);
-  for (auto it = m_appenders.begin(); it != m_appenders.end(); ++it) {
-    if (*it == appender) {
-      m_appenders.erase(it);
-	  break;
+  const std::vector<LogAppender::ptr>* old;
+  {
+    MutexType::Lock lock(m_mutex);
+    old = m_appenders.load();
+    auto it = std::find(old->begin(), old->end(), appender);
+    if (it == old->end()) {
+      return;
     }
+    auto appenders = new std::vector<LogAppender::ptr>(*old);
+    appenders->erase(appenders->begin() + (it - old->begin()));
+    m_appenders.store(appenders);
   }
+  Rcu::Retire(old);
 }
 
 void Logger::clearAppender() {
-  MutexType::Lock lock(m_mutex);
-  m_appenders.clear();
+  const std::vector<LogAppender::ptr>* old;
+  {
+    MutexType::Lock lock(m_mutex);
+    old = m_appenders.load();
+    m_appenders.store(new std::vector<LogAppender::ptr>);
+  }
+  Rcu::Retire(old);
 }
 
 void Logger::setFormatter(LogFormatter::ptr val) {
   MutexType::Lock lock(m_mutex);
   m_logformatter = std::move(val);
 
-  for (auto& i : m_appenders) {
+  for (auto& i : *m_appenders.load()) {
     MutexType::Lock li(i->m_mutex);
     if (!i->m_hasFormatter) {
       i->m_formatter = m_logformatter;
@@ -210,7 +353,7 @@ void Logger::setFormatter(LogFormatter::ptr val) {
 }
 
 void Logger::setFormatter(const std::string& val) {
-  auto new_val = std::make_shared<LogFormatter>(val);
+  auto new_val = LogFormatter::Create(val);
   if (new_val->isError()) {
     std::cout << "Logger setFormatter name=" << m_name << " value=" << val << " invalid formatter" << std::endl;
 	return;
@@ -228,13 +371,14 @@ std::string Logger::toYamlString() {
   MutexType::Lock lock(m_mutex);
   YAML::Node node;
   node["name"] = m_name;
-  if (m_level != LogLevel::UNKNOW)
-  	node["level"] = LogLevel::toString(m_level);
+  LogLevel::Level level = getLevel();
+  if (level != LogLevel::UNKNOW)
+  	node["level"] = LogLevel::toString(level);
   if (!m_logformatter) {
     node["formatter"] = m_logformatter->getPattern();
   }
 
-  for(auto& i : m_appenders) {
+  for(auto& i : *m_appenders.load()) {
     node["appenders"].push_back(YAML::Load(i->toYamlString()));
   }
   std::stringstream ss;
@@ -246,19 +390,32 @@ FileLogAppender::FileLogAppender(const std::string &filename)
 	: m_filename(filename) {
 }
 
-void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, const LogEvent::ptr event) {
+void FileLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
   if (level >= m_level) {
     if (!m_fileoutstream.is_open()) {
-      if (reopen()) {
-		MutexType::Lock lock(m_mutex);
-		m_fileoutstream << m_formatter->format(logger, level, event);
-	  } else {
+      if (!reopen()) {
 		SYLAR_LOG_FMT_FATAL(logger, "Can't open file %s", m_filename.c_str());
 		std::exit(-1);
       }
-    } else {
+    }
+    std::string& buf = FormatBuffer();
+    // 切分时换下来的文件流, 在释放锁之后析构(刷新缓冲并关闭)
+    std::ofstream old;
+    std::string rotated;
+    {
 	  MutexType::Lock lock(m_mutex);
-	  m_fileoutstream << m_formatter->format(logger, level, event);
+	  m_formatter->format(buf, logger, level, event);
+	  time_t now = event->getTime();
+	  if ((m_maxSize && m_fileSize && m_fileSize + buf.size() > m_maxSize)
+	      || (m_nextRotate && now >= m_nextRotate)) {
+	    rotateLocked(now, old, rotated);
+	  }
+	  m_fileoutstream.write(buf.c_str(), buf.size());
+	  m_fileSize += buf.size();
+    }
+    if (!rotated.empty()) {
+      old.close();
+      submitRotated(rotated);
     }
   }
 }
@@ -268,15 +425,106 @@ bool FileLogAppender::reopen() {
   if (m_fileoutstream.is_open()) {
     m_fileoutstream.close();
   }
-  m_fileoutstream.open(m_filename);
+  m_fileoutstream.open(m_filename, std::ios::out | std::ios::app);
+  struct stat st {};
+  m_fileSize = stat(m_filename.c_str(), &st) ? 0 : st.st_size;
   return m_fileoutstream.is_open();
 }
 
+bool FileLogAppender::rotate() {
+  std::ofstream old;
+  std::string rotated;
+  bool rt;
+  {
+    MutexType::Lock lock(m_mutex);
+    // 和日志事件的时间用同一个时钟(GetMonotonicWallUS), 墙上时间跳变时切分时间不会错乱
+    rt = rotateLocked(GetMonotonicWallUS() / 1000000, old, rotated);
+  }
+  if (rt) {
+    old.close();
+    submitRotated(rotated);
+  }
+  return rt;
+}
+
+bool FileLogAppender::rotateLocked(time_t now, std::ofstream& old, std::string& rotated) {
+  m_nextRotate = LogRotator::NextRotateTime(now, m_rotateInterval);
+  if (!m_fileSize) {
+    return false;
+  }
+  rotated = LogRotator::RotatedName(m_filename, now);
+  // 改名是原子的, 改名后旧的流还写在被改名的文件上
+  if (rename(m_filename.c_str(), rotated.c_str())) {
+    std::cout << "FileLogAppender rotate " << m_filename << " fail, errno=" << errno
+              << " errstr=" << strerror(errno) << std::endl;
+    // 改名失败时继续写原文件, 过一段大小再试
+    m_fileSize = 0;
+    rotated.clear();
+    return false;
+  }
+  std::ofstream out(m_filename, std::ios::out | std::ios::app);
+  if (!out.is_open()) {
+    // 打开新文件失败时接着写改名后的文件
+    std::cout << "FileLogAppender open " << m_filename << " fail after rotate, errno=" << errno << std::endl;
+    m_fileSize = 0;
+    rotated.clear();
+    return false;
+  }
+  old.swap(m_fileoutstream);
+  m_fileoutstream.swap(out);
+  m_fileSize = 0;
+  return true;
+}
+
+void FileLogAppender::submitRotated(const std::string& rotated) {
+  bool compress;
+  uint32_t max_files;
+  {
+    MutexType::Lock lock(m_mutex);
+    compress = m_compress;
+    max_files = m_maxFiles;
+  }
+  LogRotatorMgr::GetInstance()->submit(m_filename, rotated, compress, max_files);
+}
+
+void FileLogAppender::setMaxSize(uint64_t bytes) {
+  MutexType::Lock lock(m_mutex);
+  m_maxSize = bytes;
+}
+
+void FileLogAppender::setRotateInterval(uint32_t seconds) {
+  MutexType::Lock lock(m_mutex);
+  m_rotateInterval = seconds;
+  m_nextRotate = LogRotator::NextRotateTime(GetMonotonicWallUS() / 1000000, seconds);
+}
+
+void FileLogAppender::setMaxFiles(uint32_t count) {
+  MutexType::Lock lock(m_mutex);
+  m_maxFiles = count;
+}
+
+void FileLogAppender::setCompress(bool v) {
+  MutexType::Lock lock(m_mutex);
+  m_compress = v;
+}
+
 std::string FileLogAppender::toYamlString() {
   MutexType::Lock lock(m_mutex);
   YAML::Node node;
   node["type"] = "FileLogAppender";
   node["file"] = m_filename;
+  if (m_maxSize) {
+    node["max_size"] = m_maxSize;
+  }
+  if (m_rotateInterval) {
+    node["rotate_interval"] = m_rotateInterval;
+  }
+  if (m_maxFiles) {
+    node["max_files"] = m_maxFiles;
+  }
+  if (m_compress) {
+    node["compress"] = true;
+  }
   if (m_level != LogLevel::UNKNOW)
 	node["level"] = LogLevel::toString(m_level);
   if (m_formatter && m_hasFormatter) {
@@ -287,10 +535,323 @@ std::string FileLogAppender::toYamlString() {
   return ss.str();
 }
 
-void StdoutLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, const LogEvent::ptr event) {
+struct AsyncLogAppender::Ring {
+  explicit Ring(size_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+  std::vector<std::string> slots;
+  size_t mask;
+  // appender已经析构, 线程下次建新缓冲时从自己的表中删掉
+  std::atomic<bool> dead {false};
+  // 生产者和消费者的下标分开放在不同的缓存行
+  alignas(64) std::atomic<uint64_t> head {0}; // 只由消费端写
+  alignas(64) std::atomic<uint64_t> tail {0}; // 只由所属线程写
+};
+
+// 线程持有自己的缓冲, 线程退出后由后台线程写完再回收
+struct AsyncLogAppender::ThreadRings {
+  uint64_t lastId = 0;
+  Ring* last = nullptr;
+  std::unordered_map<uint64_t, std::shared_ptr<Ring>> rings;
+};
+
+thread_local AsyncLogAppender::ThreadRings AsyncLogAppender::t_rings;
+
+static std::atomic<uint64_t> s_async_appender_id {0};
+
+// 进程退出时全局对象的析构顺序不确定, 这两个对象不释放
+static Mutex& FlushAppendersMutex() {
+  static auto mutex = new Mutex;
+  return *mutex;
+}
+
+static std::set<LogAppender*>& FlushAppenders() {
+  static auto appenders = new std::set<LogAppender*>;
+  return *appenders;
+}
+
+static void FlushAppendersAtExit() {
+  LogAppender::FlushAll();
+}
+
+void LogAppender::RegisterFlushAtExit(LogAppender* appender) {
+  static bool s_atexit = (atexit(FlushAppendersAtExit), true);
+  (void)s_atexit;
+  Mutex::Lock lock(FlushAppendersMutex());
+  FlushAppenders().insert(appender);
+}
+
+void LogAppender::UnregisterFlushAtExit(LogAppender* appender) {
+  Mutex::Lock lock(FlushAppendersMutex());
+  FlushAppenders().erase(appender);
+}
+
+void LogAppender::FlushAll() {
+  Mutex::Lock lock(FlushAppendersMutex());
+  for (auto i : FlushAppenders()) {
+    i->flush();
+  }
+}
+
+static void WriteAll(int fd, iovec* iov, int count) {
+  while (count > 0) {
+    ssize_t n = writev(fd, iov, count);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cout << "AsyncLogAppender writev fail, errno=" << errno << " errstr=" << strerror(errno) << std::endl;
+      return;
+    }
+    while (count > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = (char*)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+}
+
+const char* AsyncLogAppender::OverflowToString(Overflow overflow) {
+  switch (overflow) {
+#define XX(name, str) \
+    case name: \
+      return #str;
+    XX(BLOCK, block);
+    XX(DROP, drop);
+    XX(COUNT, count);
+#undef XX
+    default:
+      return "block";
+  }
+}
+
+AsyncLogAppender::Overflow AsyncLogAppender::OverflowFromString(const std::string& str) {
+  std::string str1 = str;
+  std::transform(str1.begin(), str1.end(), str1.begin(), ::tolower);
+  if (str1 == "drop") {
+    return DROP;
+  } else if (str1 == "count") {
+    return COUNT;
+  }
+  return BLOCK;
+}
+
+AsyncLogAppender::AsyncLogAppender(const std::string& filename, size_t capacity, Overflow overflow)
+    : m_id(++s_async_appender_id),
+      m_filename(filename),
+      m_capacity(2),
+      m_overflow(overflow) {
+  while (m_capacity < capacity) {
+    m_capacity <<= 1;
+  }
+  if (!reopen()) {
+    std::cout << "AsyncLogAppender open " << m_filename << " fail, errno=" << errno
+              << " errstr=" << strerror(errno) << std::endl;
+  }
+  RegisterFlushAtExit(this);
+  m_thread.reset(new Thread(std::bind(&AsyncLogAppender::flushLoop, this), "async_log"));
+}
+
+AsyncLogAppender::~AsyncLogAppender() {
+  UnregisterFlushAtExit(this);
+  m_stop = true;
+  m_dataSem.notify();
+  if (m_thread) {
+    m_thread->join();
+  }
+  drain();
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+  // 线程表里还引用着缓冲, 先释放槽位的内存, 剩下的空壳由线程回收
+  Mutex::Lock lock(m_ringMutex);
+  for (auto& ring : m_rings) {
+    std::vector<std::string>().swap(ring->slots);
+    ring->dead.store(true, std::memory_order_release);
+  }
+}
+
+void AsyncLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+  if (level < m_level) {
+    return;
+  }
+  LogFormatter::ptr formatter;
+  {
+    MutexType::Lock lock(m_mutex);
+    formatter = m_formatter;
+  }
+  // 格式化在调用线程完成, 不持有appender的锁; FATAL不丢弃
+  std::string& buf = FormatBuffer();
+  formatter->format(buf, logger, level, event);
+  push(buf, m_overflow == BLOCK || level == LogLevel::FATAL);
+  if (level == LogLevel::FATAL) {
+    flush();
+  }
+}
+
+AsyncLogAppender::Ring* AsyncLogAppender::getRing() {
+  ThreadRings& t = t_rings;
+  if (t.lastId == m_id) {
+    return t.last;
+  }
+  auto& ring = t.rings[m_id];
+  if (!ring) {
+    // 新建缓冲时顺便删掉已经析构的appender留下的缓冲, 配置重载不会让表一直变大
+    for (auto it = t.rings.begin(); it != t.rings.end();) {
+      if (it->second && it->second->dead.load(std::memory_order_acquire)) {
+        if (t.last == it->second.get()) {
+          t.lastId = 0;
+          t.last = nullptr;
+        }
+        it = t.rings.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    ring = std::make_shared<Ring>(m_capacity);
+    Mutex::Lock lock(m_ringMutex);
+    m_rings.push_back(ring);
+  }
+  t.lastId = m_id;
+  t.last = ring.get();
+  return t.last;
+}
+
+bool AsyncLogAppender::push(const std::string& line, bool block) {
+  Ring* ring = getRing();
+  uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+  while (tail - ring->head.load(std::memory_order_acquire) >= ring->slots.size()) {
+    if (!block || m_stop) {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    // 环是本线程的, 不能让出协程换线程; 登记后再检查一次, 仍然是满的就挂起线程等drain()唤醒
+    m_blocked.fetch_add(1);
+    if (tail - ring->head.load() >= ring->slots.size()) {
+      m_spaceSem.wait();
+    }
+  }
+  // 槽位的字符串写出后只清空不释放, 复制进去不分配内存
+  ring->slots[tail & ring->mask].assign(line);
+  ring->tail.store(tail + 1);
+  // 之前的都已经被取走, 后台线程可能在等待, 通知它
+  // tail和head的读写都是顺序一致的: 要么drain()看到新的tail, 要么这里看到drain()写的head
+  if (ring->head.load() == tail) {
+    m_dataSem.notify();
+  }
+  return true;
+}
+
+size_t AsyncLogAppender::drain() {
+  Mutex::Lock lock(m_drainMutex);
+  // m_drainRings复用容量, 后台线程每轮不分配内存
+  std::vector<std::shared_ptr<Ring>>& rings = m_drainRings;
+  {
+    Mutex::Lock lock2(m_ringMutex);
+    rings = m_rings;
+  }
+
+  size_t total = 0;
+  iovec iov[IOV_MAX];
+  for (auto& ring : rings) {
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load();
+    while (head != tail) {
+      uint64_t end = std::min<uint64_t>(tail, head + IOV_MAX);
+      int count = 0;
+      for (uint64_t i = head; i != end; ++i) {
+        std::string& line = ring->slots[i & ring->mask];
+        iov[count].iov_base = &line[0];
+        iov[count].iov_len = line.size();
+        ++count;
+      }
+      if (m_fd >= 0) {
+        WriteAll(m_fd, iov, count);
+      }
+      for (uint64_t i = head; i != end; ++i) {
+        ring->slots[i & ring->mask].clear();
+      }
+      total += end - head;
+      head = end;
+      ring->head.store(head);
+    }
+  }
+
+  // 唤醒登记过的阻塞生产者, 多余的唤醒只会让生产者再检查一次
+  int blocked = m_blocked.exchange(0);
+  while (blocked-- > 0) {
+    m_spaceSem.notify();
+  }
+
+  if (m_overflow == COUNT) {
+    uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+    if (dropped != m_reportedDropped && m_fd >= 0) {
+      std::string msg = "AsyncLogAppender dropped " + std::to_string(dropped - m_reportedDropped)
+          + " log lines, total " + std::to_string(dropped) + "\n";
+      iovec v {&msg[0], msg.size()};
+      WriteAll(m_fd, &v, 1);
+      m_reportedDropped = dropped;
+    }
+  }
+
+  rings.clear();
+
+  // 回收已经退出的线程留下的空缓冲
+  Mutex::Lock lock2(m_ringMutex);
+  m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [](const std::shared_ptr<Ring>& ring) {
+      return ring.use_count() == 1
+          && ring->head.load(std::memory_order_relaxed) == ring->tail.load(std::memory_order_acquire);
+    }), m_rings.end());
+  return total;
+}
+
+void AsyncLogAppender::flush() {
+  drain();
+}
+
+void AsyncLogAppender::flushLoop() {
+  while (!m_stop) {
+    if (!drain()) {
+      m_dataSem.wait();
+    }
+  }
+}
+
+bool AsyncLogAppender::reopen() {
+  Mutex::Lock lock(m_drainMutex);
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+  m_fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  return m_fd >= 0;
+}
+
+std::string AsyncLogAppender::toYamlString() {
+  MutexType::Lock lock(m_mutex);
+  YAML::Node node;
+  node["type"] = "AsyncLogAppender";
+  node["file"] = m_filename;
+  node["capacity"] = m_capacity;
+  node["overflow"] = OverflowToString(m_overflow);
+  if (m_level != LogLevel::UNKNOW)
+	node["level"] = LogLevel::toString(m_level);
+  if (m_formatter && m_hasFormatter) {
+    node["formatter"] = m_formatter->getPattern();
+  }
+  std::stringstream ss;
+  ss << node;
+  return ss.str();
+}
+
+void StdoutLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
   if (level >= m_level) {
+    std::string& buf = FormatBuffer();
 	MutexType::Lock lock(m_mutex);
-	std::cout << m_formatter->format(logger, level, event);
+	m_formatter->format(buf, logger, level, event);
+	std::cout.write(buf.c_str(), buf.size());
   }
 }
 
@@ -308,6 +869,16 @@ std::string StdoutLogAppender::toYamlString() {
   return ss.str();
 }
 
+LogFormatter::ptr LogFormatter::Create(const std::string& pattern) {
+  if (pattern == "json") {
+    return std::make_shared<JsonLogFormatter>();
+  }
+  if (pattern == "logfmt") {
+    return std::make_shared<LogfmtLogFormatter>();
+  }
+  return std::make_shared<LogFormatter>(pattern);
+}
+
 LogFormatter::LogFormatter(const std::string &pattern)
 	:m_pattern(pattern){
   init();
@@ -400,7 +971,9 @@ void LogFormatter::init() {
 	  XX(l, LineFormatItem),        // 行号
 	  XX(T, TabFormatItem),         // Tab
 	  XX(F, FiberIdFormatItem),     // 协程id
-	  XX(N, ThreadNameFormatItem)   // 线程名称
+	  XX(N, ThreadNameFormatItem),  // 线程名称
+	  XX(ms, MilliSecondFormatItem), // 毫秒部分
+	  XX(us, MicroSecondFormatItem)  // 微秒部分
 #undef XX
   };
 
@@ -429,16 +1002,22 @@ void LogFormatter::init() {
    * %d : 时间
    * %f : 文件名
    * %l : 行号
+   * %ms : 时间的毫秒部分(3位), 如"%d.%ms"
+   * %us : 时间的微秒部分(6位)
    * */
 }
 
 
-std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
-  std::stringstream  ss;
+std::string LogFormatter::format(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+  std::string out;
+  format(out, logger, level, event);
+  return out;
+}
+
+void LogFormatter::format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
   for(auto& c : m_items) {
-    c->format(ss, logger, level, event);
+    c->format(out, logger, level, event);
   }
-  return ss.str();
 }
 
 const char *LogLevel::toString(LogLevel::Level level) {
@@ -476,6 +1055,55 @@ LogLevel::Level LogLevel::fromString(const std::string& str) {
 	return LogLevel::UNKNOW;
 }
 
+LogStreamBuf::LogStreamBuf() {
+  reset();
+}
+
+void LogStreamBuf::reset() {
+  setp(m_inline, m_inline + kInlineSize);
+  m_spill.clear();
+  m_spilled = false;
+}
+
+const char* LogStreamBuf::data() const {
+  return m_spilled ? m_spill.data() : pbase();
+}
+
+size_t LogStreamBuf::size() const {
+  return m_spilled ? m_spill.size() : pptr() - pbase();
+}
+
+LogStreamBuf::int_type LogStreamBuf::overflow(int_type ch) {
+  if (traits_type::eq_int_type(ch, traits_type::eof())) {
+    return traits_type::not_eof(ch);
+  }
+  char c = ch;
+  xsputn(&c, 1);
+  return ch;
+}
+
+std::streamsize LogStreamBuf::xsputn(const char* s, std::streamsize n) {
+  if (!m_spilled) {
+    if (epptr() - pptr() >= n) {
+      memcpy(pptr(), s, n);
+      pbump(n);
+      return n;
+    }
+    // 内联缓冲写满, 之后都追加到m_spill
+    m_spill.assign(pbase(), pptr() - pbase());
+    m_spilled = true;
+    setp(nullptr, nullptr);
+  }
+  m_spill.append(s, n);
+  return n;
+}
+
+LogEvent::LogEvent()
+    : m_threadName(&Thread::GetName()),
+      m_ss(&m_buf) {
+  m_ss.pword(StreamIndex()) = this;
+}
+
 LogEvent::LogEvent(std::shared_ptr<Logger> logger,
 				   LogLevel::Level level,
 				   const char *file,
@@ -484,16 +1112,81 @@ LogEvent::LogEvent(std::shared_ptr<Logger> logger,
 				   uint32_t thread_id,
 				   uint32_t fiber_id,
 				   uint32_t time,
-				   std::string  thread_name) :
-				   m_file(file) ,
-				   m_line(line),
-				   m_elapse(elapse),
-				   m_threadId(thread_id),
-				   m_fiberId(fiber_id),
-				   m_time(time),
-				   m_logger(std::move(logger)),
-				   m_level(level),
-				   m_threadName(std::move(thread_name)) {
+				   const std::string& thread_name)
+    : m_ss(&m_buf),
+      m_ownLogger(std::move(logger)),
+      m_ownThreadName(thread_name) {
+  m_ss.pword(StreamIndex()) = this;
+  reset(m_ownLogger.get(), level, file, line, elapse, thread_id, fiber_id, time * 1000000UL, m_ownThreadName);
+}
+
+void LogEvent::reset(Logger* logger,
+                     LogLevel::Level level,
+                     const char *file,
+                     int32_t line,
+                     uint32_t elapse,
+                     uint32_t thread_id,
+                     uint32_t fiber_id,
+                     uint64_t time_us,
+                     const std::string& thread_name) {
+  m_file = file;
+  m_line = line;
+  m_elapse = elapse;
+  m_threadId = thread_id;
+  m_fiberId = fiber_id;
+  m_timeUs = time_us;
+  m_time = time_us / 1000000;
+  m_threadName = &thread_name;
+  m_logger = logger;
+  m_level = level;
+  m_buf.reset();
+  m_fields.clear();
+  // 上一条日志可能改过格式(std::hex等)
+  m_ss.clear();
+  m_ss.flags(std::ios_base::dec | std::ios_base::skipws);
+  m_ss.precision(6);
+  m_ss.width(0);
+  m_ss.fill(' ');
+}
+
+int LogEvent::StreamIndex() {
+  static const int s_index = std::ios_base::xalloc();
+  return s_index;
+}
+
+void LogEvent::addField(std::string_view key, char type, std::string_view value) {
+  uint8_t key_len = key.size() > 0xff ? 0xff : key.size();
+  uint32_t value_len = value.size();
+  m_fields.push_back(type);
+  m_fields.push_back((char)key_len);
+  m_fields.append(key.data(), key_len);
+  m_fields.append((const char*)&value_len, sizeof(value_len));
+  m_fields.append(value.data(), value_len);
+}
+
+bool LogEvent::nextField(size_t& pos, Field& field) const {
+  if (pos >= m_fields.size()) {
+    return false;
+  }
+  const char* p = m_fields.data() + pos;
+  field.type = p[0];
+  uint8_t key_len = p[1];
+  field.key = std::string_view(p + 2, key_len);
+  uint32_t value_len;
+  memcpy(&value_len, p + 2 + key_len, sizeof(value_len));
+  field.value = std::string_view(p + 2 + key_len + sizeof(value_len), value_len);
+  pos += 2 + key_len + sizeof(value_len) + value_len;
+  return true;
+}
+
+std::ostream& PutLogField(std::ostream& os, const char* key, char type, std::string_view value) {
+  auto event = static_cast<LogEvent*>(os.pword(LogEvent::StreamIndex()));
+  if (event) {
+    event->addField(key, type, value);
+  } else {
+    os << ' ' << key << '=' << value;
+  }
+  return os;
 }
 
 void LogEvent::format(const char *fmt, ...) {
@@ -504,12 +1197,56 @@ void LogEvent::format(const char *fmt, ...) {
 }
 
 void LogEvent::format(const char *fmt, va_list list) {
-  char* buf = nullptr;
-  int len = vasprintf(&buf, fmt, list);
-  if (len != -1) {
-    m_ss << std::string(buf, len);
-	free(buf);
+  char buf[512];
+  va_list copy;
+  va_copy(copy, list);
+  int len = vsnprintf(buf, sizeof(buf), fmt, copy);
+  va_end(copy);
+  if (len < 0) {
+    return;
+  }
+  if ((size_t)len < sizeof(buf)) {
+    m_ss.write(buf, len);
+    return;
+  }
+  std::string str(len + 1, '\0');
+  vsnprintf(&str[0], str.size(), fmt, list);
+  m_ss.write(str.c_str(), len);
+}
+
+// 线程局部的事件池, 用事件的占用标记区分空闲的事件, LogEventWarp析构时release()解除占用
+struct LogEventPool {
+  static constexpr int kSize = 4;
+  LogEvent::ptr events[kSize];
+
+  LogEventPool() {
+    for (auto& i : events) {
+      i = std::make_shared<LogEvent>();
+    }
+  }
+
+  const LogEvent::ptr* acquire() {
+    for (auto& i : events) {
+      if (i->tryAcquire()) {
+        return &i;
+      }
+    }
+    return nullptr;
+  }
+};
+
+LogEventWarp::LogEventWarp(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const char* file, int32_t line,
+                           uint64_t suppressed)
+    : m_logger(&logger),
+      m_suppressed(suppressed) {
+  static thread_local LogEventPool t_pool;
+  const LogEvent::ptr* p = t_pool.acquire();
+  if (p) {
+    m_event = *p;
+  } else {
+    m_event = std::make_shared<LogEvent>();
   }
+  m_event->reset(logger.get(), level, file, line, 0, GetThreadId(), GetFiberId(), GetMonotonicWallUS(), Thread::GetName());
 }
 
 LogEventWarp::LogEventWarp(LogEvent::ptr p)
@@ -517,10 +1254,21 @@ LogEventWarp::LogEventWarp(LogEvent::ptr p)
 }
 
 LogEventWarp::~LogEventWarp() {
-  m_event->getLogger()->log(m_event->getLevel(), m_event);
+  if (m_suppressed) {
+    m_event->getSS() << " (suppressed " << m_suppressed << ")";
+  }
+  if (m_logger) {
+    (*m_logger)->log(m_event->getLevel(), m_event, *m_logger);
+  } else {
+    m_event->getLogger()->log(m_event->getLevel(), m_event);
+  }
+  // 事件放回池中
+  m_event->release();
+  m_event.reset();
+  check_preempt_in_log();
 }
 
-std::stringstream &LogEventWarp::getSS() {
+std::ostream& LogEventWarp::getSS() {
   return m_event->getSS();
 }
 
@@ -547,16 +1295,32 @@ Logger::ptr LoggerManager::getLogger(const std::string &name) {
 }
 
 struct LogAppenderDefine {
-  int type = 0; // 1 File, 2 Stdout
+  int type = 0; // 1 File, 2 Stdout, 3 Async, 4 Binary, 5 Mmap
   LogLevel::Level level = LogLevel::UNKNOW;
   std::string formatter;
   std::string file;
+  size_t capacity = 0; // Async: 每个线程的缓冲条数, 0表示默认
+  std::string overflow; // Async: block/drop/count
+  uint64_t maxSize = 0; // File: 按大小切分, 支持K/M/G后缀
+  uint32_t rotateInterval = 0; // File: 按时间切分的秒数
+  uint32_t maxFiles = 0; // File: 保留的切分文件个数
+  bool compress = false; // File: 压缩切分出来的文件
+  uint64_t chunkSize = 0; // Mmap: 每次扩展的大小, 支持K/M/G后缀, 0表示默认
+  uint64_t syncInterval = 0; // Mmap: 后台msync的毫秒间隔, 0表示默认
 
   bool operator==(const LogAppenderDefine& other) const {
     return type == other.type &&
     	level == other.level &&
     	formatter == other.formatter &&
-    	file == other.file;
+    	file == other.file &&
+    	capacity == other.capacity &&
+    	overflow == other.overflow &&
+    	maxSize == other.maxSize &&
+    	rotateInterval == other.rotateInterval &&
+    	maxFiles == other.maxFiles &&
+    	compress == other.compress &&
+    	chunkSize == other.chunkSize &&
+    	syncInterval == other.syncInterval;
   }
 };
 
@@ -617,8 +1381,68 @@ class LexicalCast<std::string, std::set<LogDefine>> {
 	        if (a["formatter"].IsDefined()) {
 	          lad.formatter = a["formatter"].as<std::string>();
 	        }
+	        if (a["max_size"].IsDefined()) {
+	          lad.maxSize = LogRotator::ParseSize(a["max_size"].as<std::string>());
+	        }
+	        if (a["rotate_interval"].IsDefined()) {
+	          lad.rotateInterval = a["rotate_interval"].as<uint32_t>();
+	        }
+	        if (a["max_files"].IsDefined()) {
+	          lad.maxFiles = a["max_files"].as<uint32_t>();
+	        }
+	        if (a["compress"].IsDefined()) {
+	          lad.compress = a["compress"].as<bool>();
+	        }
+	      } else if (type == "AsyncLogAppender") {
+	        lad.type = 3;
+	        if (!a["file"].IsDefined()) {
+			  std::cout << "log config error: async appender's file is null, " <<
+						a << std::endl;
+			  continue;
+			}
+	        lad.file = a["file"].as<std::string>();
+	        if (a["formatter"].IsDefined()) {
+	          lad.formatter = a["formatter"].as<std::string>();
+	        }
+	        if (a["capacity"].IsDefined()) {
+	          lad.capacity = a["capacity"].as<size_t>();
+	        }
+	        if (a["overflow"].IsDefined()) {
+	          lad.overflow = a["overflow"].as<std::string>();
+	        }
+	      } else if (type == "BinaryFileLogAppender") {
+	        lad.type = 4;
+	        if (!a["file"].IsDefined()) {
+			  std::cout << "log config error: binary appender's file is null, " <<
+						a << std::endl;
+			  continue;
+			}
+	        lad.file = a["file"].as<std::string>();
+	        if (a["formatter"].IsDefined()) {
+	          lad.formatter = a["formatter"].as<std::string>();
+	        }
+	      } else if (type == "MmapFileLogAppender") {
+	        lad.type = 5;
+	        if (!a["file"].IsDefined()) {
+			  std::cout << "log config error: mmap appender's file is null, " <<
+						a << std::endl;
+			  continue;
+			}
+	        lad.file = a["file"].as<std::string>();
+	        if (a["formatter"].IsDefined()) {
+	          lad.formatter = a["formatter"].as<std::string>();
+	        }
+	        if (a["chunk_size"].IsDefined()) {
+	          lad.chunkSize = LogRotator::ParseSize(a["chunk_size"].as<std::string>());
+	        }
+	        if (a["sync_interval"].IsDefined()) {
+	          lad.syncInterval = a["sync_interval"].as<uint64_t>();
+	        }
 	      } else if (type == "StdoutLogAppender") {
 	        lad.type = 2;
+	        if (a["formatter"].IsDefined()) {
+	          lad.formatter = a["formatter"].as<std::string>();
+	        }
 	      } else {
 			std::cout << "log config error: appender type is null, " <<
 					  a << std::endl;
@@ -652,8 +1476,41 @@ class LexicalCast<std::set<LogDefine>, std::string> {
 	    if (i.type == 1) {
 	      node1["type"] = "FileLogAppender";
 	      node1["file"] = i.file;
+	      if (i.maxSize) {
+	        node1["max_size"] = i.maxSize;
+	      }
+	      if (i.rotateInterval) {
+	        node1["rotate_interval"] = i.rotateInterval;
+	      }
+	      if (i.maxFiles) {
+	        node1["max_files"] = i.maxFiles;
+	      }
+	      if (i.compress) {
+	        node1["compress"] = true;
+	      }
 	    } else if (i.type == 2) {
 	      node1["type"] = "StdoutLogAppender";
+	    } else if (i.type == 3) {
+	      node1["type"] = "AsyncLogAppender";
+	      node1["file"] = i.file;
+	      if (i.capacity) {
+	        node1["capacity"] = i.capacity;
+	      }
+	      if (!i.overflow.empty()) {
+	        node1["overflow"] = i.overflow;
+	      }
+	    } else if (i.type == 4) {
+	      node1["type"] = "BinaryFileLogAppender";
+	      node1["file"] = i.file;
+	    } else if (i.type == 5) {
+	      node1["type"] = "MmapFileLogAppender";
+	      node1["file"] = i.file;
+	      if (i.chunkSize) {
+	        node1["chunk_size"] = i.chunkSize;
+	      }
+	      if (i.syncInterval) {
+	        node1["sync_interval"] = i.syncInterval;
+	      }
 	    }
 	    if (i.level != LogLevel::UNKNOW)
 		  node1["level"] = LogLevel::toString(i.level);
@@ -699,16 +1556,32 @@ struct LogIniter {
 		for (auto& a : i.appenders) {
 		  LogAppender::ptr ap;
 		  switch (a.type) {
-			case 1:
-			  ap.reset(new FileLogAppender(a.file));
+			case 1: {
+			  auto file = std::make_shared<FileLogAppender>(a.file);
+			  file->setMaxSize(a.maxSize);
+			  file->setRotateInterval(a.rotateInterval);
+			  file->setMaxFiles(a.maxFiles);
+			  file->setCompress(a.compress);
+			  ap = file;
 			  break;
+			}
 			case 2:
 			  ap.reset(new StdoutLogAppender());
 			  break;
+			case 3:
+			  ap.reset(new AsyncLogAppender(a.file, a.capacity ? a.capacity : 8192,
+			                                AsyncLogAppender::OverflowFromString(a.overflow)));
+			  break;
+			case 4:
+			  ap.reset(new BinaryFileLogAppender(a.file));
+			  break;
+			case 5:
+			  ap.reset(new MmapFileLogAppender(a.file, a.chunkSize ? a.chunkSize : 16 * 1024 * 1024, a.syncInterval));
+			  break;
 		  }
 		  ap->setLevel(a.level);
 		  if (!a.formatter.empty()) {
-		    auto fmt = std::make_shared<LogFormatter>(a.formatter);
+		    auto fmt = LogFormatter::Create(a.formatter);
 		    if (!fmt->isError()) {
 		      ap->setFormatter(fmt);
 		    } else {
@@ -16,15 +16,35 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include <charconv>
+#include <ctime>
+#include <cmath>
+#include <string_view>
+#include <type_traits>
 
 #include "util.h"
 #include "singleton.h"
 #include "thread.h"
+#include "rcu.h"
+
+/*
+ * 编译期的最低日志级别, 1~5对应DEBUG~FATAL, 由CMake的SYLAR_MIN_LOG_LEVEL设置
+ * 低于它的日志语句条件恒为false, 整条语句(包括参数求值)被编译器去掉
+ * */
+#ifndef SYLAR_MIN_LOG_LEVEL
+#define SYLAR_MIN_LOG_LEVEL 1
+#endif
+
+// 先比较编译期级别, 再读一次logger的原子级别
+#define SYLAR_LOG_ENABLED(logger, level) \
+	((level) >= SYLAR_MIN_LOG_LEVEL && (logger)->isEnabled(level))
 
 #define SYLAR_LOG_LEVEL(logger, level) \
-	if ((logger)->getLevel() <= (level)) \
-           sylar::LogEventWarp(std::make_shared<sylar::LogEvent>(logger, level, __FILE__, __LINE__, 0, \
-           sylar::GetThreadId(), sylar::GetFiberId(), time(nullptr), sylar::Thread::GetName())).getSS()
+	if (SYLAR_LOG_ENABLED(logger, level)) \
+           sylar::LogEventWarp(logger, level, __FILE__, __LINE__).getSS()
 
 #define SYLAR_LOG_DEBUG(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::DEBUG)
 #define SYLAR_LOG_INFO(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::INFO)
@@ -33,9 +53,8 @@
 #define SYLAR_LOG_FATAL(logger) SYLAR_LOG_LEVEL(logger, sylar::LogLevel::FATAL)
 
 #define SYLAR_LOG_FMT_LEVEL(logger, level, fmt, ...) \
-	if (logger->getLevel() <= level) \
-		sylar::LogEventWarp(std::make_shared<sylar::LogEvent>(logger, level, __FILE__, __LINE__, 0, \
-           sylar::GetThreadId(), sylar::GetFiberId(), time(nullptr), sylar::Thread::GetName())).getEvent()->format(fmt, __VA_ARGS__)
+	if (SYLAR_LOG_ENABLED(logger, level)) \
+		sylar::LogEventWarp(logger, level, __FILE__, __LINE__).getEvent()->format(fmt, __VA_ARGS__)
 
 #define SYLAR_LOG_FMT_DEBUG(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::DEBUG, fmt, __VA_ARGS__)
 #define SYLAR_LOG_FMT_INFO(logger, fmt, ...) SYLAR_LOG_FMT_LEVEL(logger, sylar::LogLevel::INFO, fmt, __VA_ARGS__)
@@ -66,45 +85,202 @@ class LogLevel {
   static LogLevel::Level fromString(const std::string& str);
 };
 
+// 日志内容的streambuf, 先写定长的内联缓冲, 写满后转到m_spill, m_spill复用时保留容量
+class LogStreamBuf : public std::streambuf {
+ public:
+  static constexpr size_t kInlineSize = 512;
+
+  LogStreamBuf();
+  void reset();
+  const char* data() const;
+  size_t size() const;
+
+ protected:
+  int_type overflow(int_type ch) override;
+  std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+ private:
+  char m_inline[kInlineSize];
+  std::string m_spill;
+  bool m_spilled = false;
+};
+
 class LogEvent {
  public:
   using ptr = std::shared_ptr<LogEvent>;
+  LogEvent();
   LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char* file, int32_t line, uint32_t elapse, uint32_t thread_id,
-		   uint32_t fiber_id, uint32_t time, std::string  thread_name);
+		   uint32_t fiber_id, uint32_t time, const std::string& thread_name);
+  LogEvent(const LogEvent&) = delete;
+  LogEvent& operator=(const LogEvent&) = delete;
+
+  /*
+   * 复用事件时重新填写, 清空内容; time_us: 微秒时间戳, m_time由它得到
+   * logger和thread_name只保存指针, 不复制也不增加引用计数, 调用方保证在事件使用期间有效
+   * (LogEventWarp用宏参数里的logger和Thread::GetName())
+   * */
+  void reset(Logger* logger, LogLevel::Level level, const char* file, int32_t line, uint32_t elapse, uint32_t thread_id,
+             uint32_t fiber_id, uint64_t time_us, const std::string& thread_name);
+  // 复用事件时占用, 事件已被占用(比如嵌套的日志调用还在用)返回false
+  bool tryAcquire() {return !m_inUse.exchange(true, std::memory_order_acquire);}
+  // 复用前清掉logger, 并解除占用
+  void release() {
+    m_logger = nullptr;
+    m_inUse.store(false, std::memory_order_release);
+  }
+
   const char* getFile() const {return m_file;}
   int32_t getLine() const {return m_line;}
   uint32_t  getElapse() const {return m_elapse;}
   uint32_t  getThreadId() const {return m_threadId;}
   uint32_t getFiberId() const {return m_fiberId;}
   uint32_t getTime() const {return m_time;}
-  std::string getContent() const {return m_ss.str();}
-  std::stringstream& getSS() {return m_ss;}
-  std::shared_ptr<Logger> getLogger() const {return m_logger;}
+  uint64_t getTimeUs() const {return m_timeUs;}
+  std::string getContent() const {return std::string(m_buf.data(), m_buf.size());}
+  // 不复制的内容访问
+  const char* getContentData() const {return m_buf.data();}
+  size_t getContentSize() const {return m_buf.size();}
+  std::ostream& getSS() {return m_ss;}
+  Logger* getLogger() const {return m_logger;}
   LogLevel::Level getLevel() const {return m_level;}
-  const std::string& getThreadName() const {return m_threadName;}
+  const std::string& getThreadName() const {return *m_threadName;}
   void format(const char* fmt, ...);
   void format(const char* fmt, va_list list);
+
+  // 结构化字段, 由kv()写入
+  struct Field {
+    std::string_view key;
+    char type = 's'; // 's'字符串 'n'数字 'b'布尔
+    std::string_view value;
+  };
+  void addField(std::string_view key, char type, std::string_view value);
+  bool hasFields() const {return !m_fields.empty();}
+  // 从pos开始取下一个字段, pos从0开始, 没有了返回false
+  bool nextField(size_t& pos, Field& field) const;
+  // getSS()的pword(StreamIndex())指向事件本身, kv()据此找到事件
+  static int StreamIndex();
  private:
   const char* m_file = nullptr;  // 文件名
   int32_t m_line = 0;            // 行号
   uint32_t m_elapse = 0;         // 程序启动开始到现在的毫秒数
   uint32_t m_threadId = 0;       // 线程ＩＤ
   uint32_t m_fiberId = 0;        // 携程ＩＤ
-  uint32_t m_time;               // 时间戳
-  std::string m_threadName;      // 线程名称
-  std::stringstream m_ss;
-  std::shared_ptr<Logger> m_logger;
-  LogLevel::Level m_level;
+  uint32_t m_time = 0;           // 时间戳
+  uint64_t m_timeUs = 0;         // 微秒时间戳(GetMonotonicWallUS)
+  const std::string* m_threadName; // 线程名称, 复用的事件指向线程局部的名字, 不复制
+  LogStreamBuf m_buf;
+  std::ostream m_ss;
+  Logger* m_logger = nullptr;
+  // 公开的构造函数保存的副本, 事件可能比传入的参数活得久; 复用的事件不用
+  std::shared_ptr<Logger> m_ownLogger;
+  std::string m_ownThreadName;
+  LogLevel::Level m_level = LogLevel::UNKNOW;
+  // 字段依次编码为: 类型(1) key长度(1) key value长度(4) value, 复用时保留容量
+  std::string m_fields;
+  std::atomic<bool> m_inUse {false}; // 被复用的事件是否正在使用
+};
+
+/*
+ * 结构化字段: SYLAR_LOG_INFO(g_logger) << "accept" << sylar::kv("fd", fd);
+ * 写到日志事件的流时作为字段保存, json/logfmt格式器单独输出, 文本格式的%m在内容后面追加 key=value
+ * 写到其他ostream时直接输出 key=value
+ * */
+template <typename T>
+struct LogKV {
+  const char* key;
+  const T& value;
 };
 
+template <typename T>
+inline LogKV<T> kv(const char* key, const T& value) {
+  return LogKV<T>{key, value};
+}
+
+std::ostream& PutLogField(std::ostream& os, const char* key, char type, std::string_view value);
+
+template <typename T>
+std::ostream& operator<<(std::ostream& os, const LogKV<T>& f) {
+  char buf[32];
+  if constexpr (std::is_same<T, bool>::value) {
+    return PutLogField(os, f.key, 'b', f.value ? "true" : "false");
+  } else if constexpr (std::is_same<T, char>::value) {
+    return PutLogField(os, f.key, 's', std::string_view(&f.value, 1));
+  } else if constexpr (std::is_enum<T>::value) {
+    return os << kv(f.key, (typename std::underlying_type<T>::type)f.value);
+  } else if constexpr (std::is_integral<T>::value) {
+    auto r = std::to_chars(buf, buf + sizeof(buf), f.value);
+    return PutLogField(os, f.key, 'n', std::string_view(buf, r.ptr - buf));
+  } else if constexpr (std::is_floating_point<T>::value) {
+    // JSON里没有NaN和Infinity, 按字符串输出
+    if (!std::isfinite(f.value)) {
+      return PutLogField(os, f.key, 's', std::isnan(f.value) ? "NaN" : (f.value > 0 ? "Infinity" : "-Infinity"));
+    }
+    auto r = std::to_chars(buf, buf + sizeof(buf), (double)f.value);
+    return PutLogField(os, f.key, 'n', std::string_view(buf, r.ptr - buf));
+  } else if constexpr (std::is_pointer<typename std::decay<T>::type>::value
+                       && std::is_convertible<const T&, const char*>::value) {
+    const char* s = f.value;
+    return PutLogField(os, f.key, 's', s ? s : "(null)");
+  } else if constexpr (std::is_convertible<const T&, std::string_view>::value) {
+    return PutLogField(os, f.key, 's', std::string_view(f.value));
+  } else {
+    // 其他类型用它的operator<<转成字符串
+    std::ostringstream ss;
+    ss << f.value;
+    return PutLogField(os, f.key, 's', ss.str());
+  }
+}
+
+/*
+ * 一条日志语句的生命周期
+ * 事件从线程局部的事件池中取, 池中的事件和内容缓冲都复用, 稳定状态下打日志不分配内存
+ * 池中事件用完(嵌套打日志, 或者协程在语句中途切换)时才在堆上创建
+ * */
 class LogEventWarp {
  public:
+  // suppressed: 限流丢掉的条数, 不为0时追加到日志内容末尾
+  LogEventWarp(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const char* file, int32_t line,
+               uint64_t suppressed = 0);
   explicit LogEventWarp(LogEvent::ptr p);
   ~LogEventWarp();
-  std::stringstream& getSS();
-  LogEvent::ptr getEvent() {return m_event;}
+  std::ostream& getSS();
+  const LogEvent::ptr& getEvent() const {return m_event;}
  private:
   LogEvent::ptr m_event;
+  // 宏参数里的logger, 在整个表达式结束前有效; 从事件构造时为空
+  const std::shared_ptr<Logger>* m_logger = nullptr;
+  uint64_t m_suppressed = 0;
+};
+
+// 格式化日志用的追加函数, 直接写std::string, 不经过ostream
+struct LogWriter {
+  static void AppendUInt(std::string& out, uint64_t v) {
+    char buf[24];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr - buf);
+  }
+
+  static void AppendInt(std::string& out, int64_t v) {
+    char buf[24];
+    auto r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr - buf);
+  }
+
+  // 按strftime的格式追加本地时间
+  static void AppendTime(std::string& out, const char* fmt, time_t t);
+  // 同上, 每个线程按id缓存格式化好的结果, 同一秒内直接复制; id由NextTimeFormatId分配, 每种格式一个
+  static void AppendTime(std::string& out, uint64_t id, const char* fmt, time_t t);
+  static uint64_t NextTimeFormatId();
+
+  // 追加定宽补零的整数, 用于毫秒/微秒部分
+  static void AppendPadded(std::string& out, uint32_t v, int width) {
+    char buf[10];
+    for (int i = width - 1; i >= 0; --i) {
+      buf[i] = '0' + v % 10;
+      v /= 10;
+    }
+    out.append(buf, width);
+  }
 };
 
 // 日志模式器
@@ -112,12 +288,18 @@ class LogFormatter {
  public:
   using ptr = std::shared_ptr<LogFormatter>;
   explicit LogFormatter(const std::string& pattern);
+  virtual ~LogFormatter() = default;
   void init();
   bool isError() const {return m_error;}
   const std::string& getPattern() const {return m_pattern;}
 
+  // 按配置创建格式器: "json"和"logfmt"是结构化格式, 其他按模式串解析
+  static LogFormatter::ptr Create(const std::string& pattern);
+
   // %t \t  %threadId %m %n
-  std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+  std::string format(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
+  // 追加到out后面, out复用时不分配内存; StaticLogFormatter重写为编译期展开的版本
+  virtual void format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event);
 
  public:
   class FormatItem {
@@ -125,7 +307,7 @@ class LogFormatter {
 	using ptr = std::shared_ptr<FormatItem>;
 	explicit FormatItem(const std::string& fmt = "") {}
     virtual ~FormatItem() = default;
-	virtual void format(std::ostream& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+	virtual void format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) = 0;
   };
 
  private:
@@ -136,6 +318,8 @@ class LogFormatter {
 
 
 // 日志输出地
+struct BinaryLogRecord;
+
 class LogAppender {
   friend class Logger;
  public:
@@ -143,13 +327,25 @@ class LogAppender {
   using MutexType = SpinLock;
   virtual ~LogAppender() = default;
 
-  virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+  virtual void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) = 0;
+  // 二进制日志(SYLAR_LOG_BIN), 默认还原成文本后调用log, BinaryFileLogAppender直接保存原始参数
+  virtual void logBinary(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const BinaryLogRecord& record);
   virtual std::string toYamlString() = 0;
+  // 把缓冲的日志写出, 有缓冲的appender重写
+  virtual void flush() {}
+
+  // 刷新所有注册了退出时刷新的appender
+  static void FlushAll();
 
   void setFormatter(LogFormatter::ptr val);
   LogFormatter::ptr getFormatter();
   LogLevel::Level getLevel() const {return m_level;}
   void setLevel(LogLevel::Level level) {m_level = level;}
+ protected:
+  // 有缓冲的appender构造时注册, 析构时注销, 进程退出时统一flush
+  static void RegisterFlushAtExit(LogAppender* appender);
+  static void UnregisterFlushAtExit(LogAppender* appender);
+
  protected:
   LogLevel::Level m_level = LogLevel::DEBUG;
   LogFormatter::ptr m_formatter;
@@ -165,20 +361,27 @@ class LogAppender {
   using MutexType = SpinLock;
 
   explicit Logger(std::string  name = "root");
+  ~Logger();
 
   void log(LogLevel::Level level, const LogEvent::ptr& event);
+  void logBinary(LogLevel::Level level, const BinaryLogRecord& record);
+  // self是调用方手里指向本日志器的shared_ptr, 传给appender, 省掉每条日志的shared_from_this()
+  void log(LogLevel::Level level, const LogEvent::ptr& event, const Logger::ptr& self);
+  void logBinary(LogLevel::Level level, const BinaryLogRecord& record, const Logger::ptr& self);
 
-  void debug(LogEvent::ptr event);
-  void info(LogEvent::ptr event);
-  void warn(LogEvent::ptr event);
-  void error(LogEvent::ptr event);
-  void fatal(LogEvent::ptr event);
+  void debug(const LogEvent::ptr& event);
+  void info(const LogEvent::ptr& event);
+  void warn(const LogEvent::ptr& event);
+  void error(const LogEvent::ptr& event);
+  void fatal(const LogEvent::ptr& event);
 
   void addAppender(LogAppender::ptr appender);
   void deleteAppender(LogAppender::ptr appender);
   void clearAppender();
-  LogLevel::Level getLevel() const {return m_level;}
-  void setLevel(LogLevel::Level level) {m_level = level;}
+  // 级别会被配置线程修改, 读写都是relaxed的原子操作, 日志宏里只有这一次读
+  LogLevel::Level getLevel() const {return m_level.load(std::memory_order_relaxed);}
+  void setLevel(LogLevel::Level level) {m_level.store(level, std::memory_order_relaxed);}
+  bool isEnabled(LogLevel::Level level) const {return level >= m_level.load(std::memory_order_relaxed);}
   std::string getName() const {return m_name;}
 
   void setFormatter(LogFormatter::ptr val);
@@ -189,9 +392,10 @@ class LogAppender {
 
  private:
   std::string m_name;          // 日志名称
-  LogLevel::Level m_level;     // 日志级别
-  MutexType m_mutex;
-  std::list<LogAppender::ptr> m_appenders; // Appender集合
+  std::atomic<LogLevel::Level> m_level;     // 日志级别
+  MutexType m_mutex;  // 串行化对appender集合和formatter的修改, 写日志不加锁
+  // Appender集合, 修改时整个替换, 旧的集合交给Rcu回收; 写日志在读侧临界区里遍历
+  std::atomic<const std::vector<LogAppender::ptr>*> m_appenders;
   LogFormatter::ptr m_logformatter;
   Logger::ptr m_root;
 };
@@ -200,23 +404,118 @@ class LogAppender {
 class StdoutLogAppender : public LogAppender {
  public:
   using ptr = std::shared_ptr<StdoutLogAppender>;
-  void log(std::shared_ptr<Logger> logger, LogLevel::Level level, const LogEvent::ptr event) override;
+  void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
   std::string toYamlString() override;
 };
 
-// 输出到文件的appender
+/*
+ * 输出到文件的appender
+ * 可以按大小或者按时间切分: 写日志时发现需要切分, 把当前文件原子地改名为"文件名.年月日-时分秒"再打开新文件,
+ * 旧文件的关闭在释放锁之后; 压缩和清理旧文件交给LogRotator的后台线程
+ * */
 class FileLogAppender : public LogAppender {
  public:
   using ptr = std::shared_ptr<FileLogAppender>;
   explicit FileLogAppender(const std::string& filename);
-  void log(std::shared_ptr<Logger> logger, LogLevel::Level level, const LogEvent::ptr event) override;
+  void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
 
   std::string toYamlString() override;
-  // 重新打开文件,打开成功返回true
+  // 重新打开文件(追加),打开成功返回true
   bool reopen();
+  // 立即切分, 成功返回true
+  bool rotate();
+
+  // 文件超过bytes字节时切分, 0表示不按大小切分
+  void setMaxSize(uint64_t bytes);
+  // 每seconds秒切分一次, 按本地时间对齐(3600整点, 86400零点), 0表示不按时间切分
+  void setRotateInterval(uint32_t seconds);
+  // 最多保留的切分文件个数, 0表示不清理
+  void setMaxFiles(uint32_t count);
+  // 切分出来的文件是否gzip压缩
+  void setCompress(bool v);
+ private:
+  // 需要持有m_mutex, 旧的文件流交换到old, 由调用者在释放锁之后关闭
+  bool rotateLocked(time_t now, std::ofstream& old, std::string& rotated);
+  void submitRotated(const std::string& rotated);
  private:
   std::string m_filename;
   std::ofstream m_fileoutstream;
+  uint64_t m_fileSize = 0;
+  uint64_t m_maxSize = 0;
+  uint32_t m_rotateInterval = 0;
+  time_t m_nextRotate = 0;
+  uint32_t m_maxFiles = 0;
+  bool m_compress = false;
+};
+
+/*
+ * 异步输出到文件的appender
+ * 每个写日志的线程一个单生产者单消费者的环形缓冲, 调用线程格式化后放入缓冲即返回, 不等磁盘
+ * 后台线程批量取出, 用writev写入文件; 不同线程的日志按线程成批写入, 线程之间不保证时间顺序
+ * 缓冲满时按overflow处理: BLOCK等待空位, DROP直接丢弃, COUNT丢弃并在文件中记录丢弃的条数
+ * FATAL日志同步刷新, 进程退出时刷新所有异步appender
+ * */
+class AsyncLogAppender : public LogAppender {
+ public:
+  using ptr = std::shared_ptr<AsyncLogAppender>;
+
+  enum Overflow {
+    BLOCK = 0,
+    DROP,
+    COUNT
+  };
+
+  static const char* OverflowToString(Overflow overflow);
+  // 不认识的字符串返回BLOCK
+  static Overflow OverflowFromString(const std::string& str);
+
+  // capacity: 每个线程的缓冲条数, 向上取整到2的幂
+  explicit AsyncLogAppender(const std::string& filename, size_t capacity = 8192, Overflow overflow = BLOCK);
+  ~AsyncLogAppender() override;
+  void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
+
+  std::string toYamlString() override;
+  // 重新打开文件(追加),打开成功返回true
+  bool reopen();
+  // 把已经放入缓冲的日志全部写入文件后返回
+  void flush() override;
+
+  uint64_t getDropped() const {return m_dropped;}
+  size_t getCapacity() const {return m_capacity;}
+  Overflow getOverflow() const {return m_overflow;}
+
+ private:
+  struct Ring;
+  struct ThreadRings;
+  static thread_local ThreadRings t_rings;
+
+  Ring* getRing();
+  // 缓冲满时block为true等待空位, 否则丢弃
+  bool push(const std::string& line, bool block);
+  // 取出所有缓冲中的日志写入文件, 返回写入的条数
+  size_t drain();
+  void flushLoop();
+
+ private:
+  uint64_t m_id;
+  std::string m_filename;
+  size_t m_capacity;
+  Overflow m_overflow;
+  int m_fd = -1;
+  // 消费端同一时间只能有一个(后台线程或者flush的调用者)
+  Mutex m_drainMutex;
+  Mutex m_ringMutex;
+  std::vector<std::shared_ptr<Ring>> m_rings;
+  std::vector<std::shared_ptr<Ring>> m_drainRings;
+  std::atomic<uint64_t> m_dropped {0};
+  uint64_t m_reportedDropped = 0;
+  std::atomic<bool> m_stop {false};
+  // 缓冲由空变为非空时通知后台线程
+  Semaphore m_dataSem;
+  // 缓冲满而阻塞的生产者在m_spaceSem上等待, drain()按m_blocked的个数唤醒
+  Semaphore m_spaceSem;
+  std::atomic<int> m_blocked {0};
+  Thread::ptr m_thread;
 };
 
 class LoggerManager {
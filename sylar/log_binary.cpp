@@ -0,0 +1,670 @@
+#include "log_binary.h"
+#include "config.h"
+
+#include <cstdio>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sylar {
+
+constexpr char BinaryLog::kMagic[];
+
+/*
+ * 进程退出时全局对象的析构顺序不确定, 登记表不释放
+ * 调用点登记后不再修改, 存放在固定大小的原子指针数组里, 登记时加锁写一次, 读的时候不加锁
+ * */
+struct BinarySiteRegistry {
+  Mutex mutex;
+  std::atomic<uint32_t> count {0};
+  std::atomic<const BinaryLogSite*> sites[BinaryLog::kMaxSites] = {};
+};
+
+static BinarySiteRegistry& SiteRegistry() {
+  static auto registry = new BinarySiteRegistry;
+  return *registry;
+}
+
+uint32_t BinaryLog::Register(LogLevel::Level level, const char* file, int32_t line, const char* fmt, const char* types) {
+  auto& r = SiteRegistry();
+  Mutex::Lock lock(r.mutex);
+  uint32_t id = r.count.load(std::memory_order_relaxed) + 1;
+  if (id > kMaxSites) {
+    std::cout << "BinaryLog too many sites, drop " << file << ":" << line << std::endl;
+    return 0;
+  }
+  auto site = new BinaryLogSite;
+  site->id = id;
+  site->level = level;
+  site->file = file;
+  site->line = line;
+  site->fmt = fmt;
+  site->types = types;
+  r.sites[id - 1].store(site, std::memory_order_release);
+  r.count.store(id, std::memory_order_release);
+  return id;
+}
+
+const BinaryLogSite* BinaryLog::GetSite(uint32_t id) {
+  if (id == 0 || id > kMaxSites) {
+    return nullptr;
+  }
+  return SiteRegistry().sites[id - 1].load(std::memory_order_acquire);
+}
+
+uint32_t BinaryLog::GetSiteCount() {
+  return SiteRegistry().count.load(std::memory_order_acquire);
+}
+
+std::string& BinaryLog::Buffer() {
+  static thread_local std::string t_buffer;
+  t_buffer.clear();
+  return t_buffer;
+}
+
+template <typename T>
+static bool ReadRaw(const char*& p, const char* end, T& v) {
+  if ((size_t)(end - p) < sizeof(T)) {
+    return false;
+  }
+  memcpy(&v, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+template <typename T>
+static void AppendPrintf(std::string& out, const std::string& spec, T v) {
+  char buf[128];
+  int n = snprintf(buf, sizeof(buf), spec.c_str(), v);
+  if (n < 0) {
+    return;
+  }
+  if ((size_t)n < sizeof(buf)) {
+    out.append(buf, n);
+    return;
+  }
+  size_t pos = out.size();
+  out.resize(pos + n + 1);
+  snprintf(&out[pos], n + 1, spec.c_str(), v);
+  out.resize(pos + n);
+}
+
+static bool IsIntConv(char c) {
+  return strchr("diouxXc", c) != nullptr;
+}
+
+bool BinaryLog::Format(std::string& out, const char* fmt, const char* types, const char* payload, size_t size) {
+  const char* p = payload;
+  const char* end = payload + size;
+  bool ok = true;
+  std::string spec;
+  while (*fmt) {
+    if (*fmt != '%') {
+      const char* lit = fmt;
+      while (*fmt && *fmt != '%') {
+        ++fmt;
+      }
+      out.append(lit, fmt - lit);
+      continue;
+    }
+    if (fmt[1] == '%') {
+      out.push_back('%');
+      fmt += 2;
+      continue;
+    }
+    // %[flags][width][.precision][length]conv, 长度修饰按实际存的类型重新生成
+    spec = "%";
+    ++fmt;
+    while (*fmt && strchr("-+ #0", *fmt)) {
+      spec.push_back(*fmt++);
+    }
+    while (*fmt && ((*fmt >= '0' && *fmt <= '9') || *fmt == '.')) {
+      spec.push_back(*fmt++);
+    }
+    while (*fmt && strchr("hlLqjzt", *fmt)) {
+      ++fmt;
+    }
+    char conv = *fmt;
+    if (!conv) {
+      break;
+    }
+    ++fmt;
+
+    char type = *types;
+    if (type) {
+      ++types;
+    }
+    bool good = true;
+    switch (type) {
+      case 'i':
+      case 'u': {
+        uint32_t v = 0;
+        good = ReadRaw(p, end, v);
+        if (good && IsIntConv(conv)) {
+          if (type == 'i') {
+            AppendPrintf(out, spec + conv, (int32_t)v);
+          } else {
+            AppendPrintf(out, spec + conv, v);
+          }
+        } else if (good && strchr("eEfFgGaA", conv)) {
+          AppendPrintf(out, spec + conv, type == 'i' ? (double)(int32_t)v : (double)v);
+        } else {
+          good = false;
+        }
+        break;
+      }
+      case 'l':
+      case 'U': {
+        uint64_t v = 0;
+        good = ReadRaw(p, end, v);
+        if (good && IsIntConv(conv) && conv != 'c') {
+          if (type == 'l') {
+            AppendPrintf(out, spec + "ll" + conv, (long long)v);
+          } else {
+            AppendPrintf(out, spec + "ll" + conv, (unsigned long long)v);
+          }
+        } else if (good && strchr("eEfFgGaA", conv)) {
+          AppendPrintf(out, spec + conv, type == 'l' ? (double)(int64_t)v : (double)v);
+        } else {
+          good = false;
+        }
+        break;
+      }
+      case 'd': {
+        double v = 0;
+        good = ReadRaw(p, end, v);
+        if (good && strchr("eEfFgGaA", conv)) {
+          AppendPrintf(out, spec + conv, v);
+        } else if (good && IsIntConv(conv) && conv != 'c') {
+          AppendPrintf(out, spec + "ll" + conv, (long long)v);
+        } else {
+          good = false;
+        }
+        break;
+      }
+      case 's': {
+        uint16_t len = 0;
+        good = ReadRaw(p, end, len) && (size_t)(end - p) >= len;
+        if (good && conv == 's') {
+          std::string str(p, len);
+          AppendPrintf(out, spec + conv, str.c_str());
+        } else {
+          good = false;
+        }
+        if ((size_t)(end - p) >= len) {
+          p += len;
+        }
+        break;
+      }
+      case 'p': {
+        uint64_t v = 0;
+        good = ReadRaw(p, end, v);
+        if (good && conv == 'p') {
+          AppendPrintf(out, spec + conv, (void*)(uintptr_t)v);
+        } else {
+          good = false;
+        }
+        break;
+      }
+      default:
+        good = false;
+        break;
+    }
+    if (!good) {
+      out.append("<bad arg>");
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// 没有重写logBinary的appender: 当场还原成文本
+void LogAppender::logBinary(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const BinaryLogRecord& record) {
+  const BinaryLogSite* site = BinaryLog::GetSite(record.site);
+  if (!site) {
+    return;
+  }
+  static thread_local LogEvent::ptr t_event = std::make_shared<LogEvent>();
+  static thread_local std::string t_text;
+  // 嵌套调用时事件还在用
+  LogEvent::ptr event = t_event->tryAcquire() ? t_event : std::make_shared<LogEvent>();
+  event->reset(logger.get(), level, site->file, site->line, 0, record.threadId, record.fiberId,
+               record.timeUs, Thread::GetName());
+  t_text.clear();
+  BinaryLog::Format(t_text, site->fmt, site->types, record.payload, record.size);
+  event->getSS().write(t_text.data(), t_text.size());
+  log(logger, level, event);
+  event->release();
+}
+
+bool BinaryLogReader::open(const std::string& path) {
+  m_in.open(path, std::ios::binary | std::ios::ate);
+  if (!m_in) {
+    m_error = "open " + path + " fail";
+    return false;
+  }
+  m_fileSize = m_in.tellg();
+  m_in.seekg(0);
+  char magic[sizeof(BinaryLog::kMagic) - 1];
+  uint32_t version = 0;
+  if (!read(magic, sizeof(magic)) || memcmp(magic, BinaryLog::kMagic, sizeof(magic))
+      || !read(&version, sizeof(version)) || version != BinaryLog::kVersion) {
+    m_error = path + " is not a sylar binary log";
+    return false;
+  }
+  return true;
+}
+
+bool BinaryLogReader::read(void* buf, size_t size) {
+  return (bool)m_in.read((char*)buf, size);
+}
+
+uint64_t BinaryLogReader::remaining() {
+  std::streamoff pos = m_in.tellg();
+  return pos < 0 || (uint64_t)pos > m_fileSize ? 0 : m_fileSize - pos;
+}
+
+bool BinaryLogReader::next(std::string& line) {
+  while (true) {
+    uint8_t type = 0;
+    if (!read(&type, 1)) {
+      return false;
+    }
+    line.clear();
+    if (type == BinaryLog::SITE_RECORD) {
+      uint32_t id = 0, level = 0;
+      int32_t line_no = 0;
+      uint16_t file_len = 0, fmt_len = 0, types_len = 0;
+      if (!read(&id, 4) || !read(&level, 4) || !read(&line_no, 4)
+          || !read(&file_len, 2) || !read(&fmt_len, 2) || !read(&types_len, 2)) {
+        m_error = "truncated site record";
+        return false;
+      }
+      if ((uint64_t)file_len + fmt_len + types_len > remaining()) {
+        m_error = "truncated site record";
+        return false;
+      }
+      Site& site = m_sites[id];
+      site.level = (LogLevel::Level)level;
+      site.line = line_no;
+      site.file.resize(file_len);
+      site.fmt.resize(fmt_len);
+      site.types.resize(types_len);
+      if (!read(&site.file[0], file_len) || !read(&site.fmt[0], fmt_len) || !read(&site.types[0], types_len)) {
+        m_error = "truncated site record";
+        return false;
+      }
+      continue;
+    } else if (type == BinaryLog::EVENT_RECORD) {
+      uint32_t site_id = 0, thread_id = 0, fiber_id = 0, size = 0;
+      uint64_t time_us = 0;
+      uint8_t level = 0, name_len = 0;
+      char name[256];
+      if (!read(&site_id, 4) || !read(&level, 1) || !read(&time_us, 8) || !read(&thread_id, 4) || !read(&fiber_id, 4)
+          || !read(&name_len, 1) || !read(&size, 4) || !read(name, name_len)) {
+        m_error = "truncated event record";
+        return false;
+      }
+      // 长度损坏时不按它分配内存
+      if (size > remaining()) {
+        m_error = "bad event record length " + std::to_string(size);
+        return false;
+      }
+      m_payload.resize(size);
+      if (!read(&m_payload[0], size)) {
+        m_error = "truncated event record";
+        return false;
+      }
+      auto it = m_sites.find(site_id);
+      if (it == m_sites.end()) {
+        m_error = "unknown site " + std::to_string(site_id);
+        return false;
+      }
+      const Site& site = it->second;
+      LogWriter::AppendTime(line, "%Y-%m-%d %H:%M:%S", time_us / 1000000);
+      line.push_back('.');
+      LogWriter::AppendPadded(line, time_us % 1000000, 6);
+      line.push_back('\t');
+      LogWriter::AppendUInt(line, thread_id);
+      line.push_back('\t');
+      LogWriter::AppendUInt(line, fiber_id);
+      line.append("\t[");
+      line.append(LogLevel::toString((LogLevel::Level)level));
+      line.append("]\t[");
+      line.append(name, name_len);
+      line.append("]\t");
+      line.append(site.file);
+      line.push_back(':');
+      LogWriter::AppendInt(line, site.line);
+      line.push_back('\t');
+      BinaryLog::Format(line, site.fmt.c_str(), site.types.c_str(), m_payload.data(), m_payload.size());
+      return true;
+    } else if (type == BinaryLog::TEXT_RECORD) {
+      uint32_t size = 0;
+      if (!read(&size, 4)) {
+        m_error = "truncated text record";
+        return false;
+      }
+      if (size > remaining()) {
+        m_error = "bad text record length " + std::to_string(size);
+        return false;
+      }
+      line.resize(size);
+      if (!read(&line[0], size)) {
+        m_error = "truncated text record";
+        return false;
+      }
+      while (!line.empty() && line.back() == '\n') {
+        line.pop_back();
+      }
+      return true;
+    }
+    m_error = "bad record type " + std::to_string(type);
+    return false;
+  }
+}
+
+struct BinaryFileLogAppender::Buffer {
+  explicit Buffer(size_t size) {
+    data.reserve(size);
+    spare.reserve(size);
+  }
+
+  // 只有所属线程和刷新时加锁
+  SpinLock mutex;
+  std::string data;
+  // 写文件时和data交换, 由持有m_fileMutex的一方使用
+  std::string spare;
+  // appender已经析构, 线程下次建新缓冲时从自己的表中删掉
+  std::atomic<bool> dead {false};
+};
+
+struct BinaryFileLogAppender::ThreadBuffers {
+  uint64_t lastId = 0;
+  Buffer* last = nullptr;
+  std::unordered_map<uint64_t, std::shared_ptr<Buffer>> buffers;
+};
+
+thread_local BinaryFileLogAppender::ThreadBuffers BinaryFileLogAppender::t_buffers;
+
+static std::atomic<uint64_t> s_binary_appender_id {0};
+
+static void WriteFully(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cout << "BinaryFileLogAppender write fail, errno=" << errno << " errstr=" << strerror(errno) << std::endl;
+      return;
+    }
+    data += n;
+    size -= n;
+  }
+}
+
+BinaryFileLogAppender::BinaryFileLogAppender(const std::string& filename, size_t buffer_size)
+    : m_id(++s_binary_appender_id),
+      m_filename(filename),
+      m_bufferSize(std::max<size_t>(buffer_size, 4096)) {
+  if (!reopen()) {
+    std::cout << "BinaryFileLogAppender open " << m_filename << " fail, errno=" << errno
+              << " errstr=" << strerror(errno) << std::endl;
+  }
+  RegisterFlushAtExit(this);
+  m_thread.reset(new Thread(std::bind(&BinaryFileLogAppender::flushLoop, this), "binary_log"));
+}
+
+BinaryFileLogAppender::~BinaryFileLogAppender() {
+  UnregisterFlushAtExit(this);
+  m_stop = true;
+  m_flushSem.notify();
+  if (m_thread) {
+    m_thread->join();
+  }
+  flush();
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+  // 线程表里还引用着缓冲, 先释放内存, 剩下的空壳由线程回收
+  Mutex::Lock lock(m_bufferMutex);
+  for (auto& buffer : m_buffers) {
+    std::string().swap(buffer->data);
+    std::string().swap(buffer->spare);
+    buffer->dead.store(true, std::memory_order_release);
+  }
+}
+
+BinaryFileLogAppender::Buffer* BinaryFileLogAppender::getBuffer() {
+  ThreadBuffers& t = t_buffers;
+  if (t.lastId == m_id) {
+    return t.last;
+  }
+  auto& buffer = t.buffers[m_id];
+  if (!buffer) {
+    // 新建缓冲时顺便删掉已经析构的appender留下的缓冲, 配置重载不会让表一直变大
+    for (auto it = t.buffers.begin(); it != t.buffers.end();) {
+      if (it->second && it->second->dead.load(std::memory_order_acquire)) {
+        if (t.last == it->second.get()) {
+          t.lastId = 0;
+          t.last = nullptr;
+        }
+        it = t.buffers.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    buffer = std::make_shared<Buffer>(m_bufferSize);
+    Mutex::Lock lock(m_bufferMutex);
+    m_buffers.push_back(buffer);
+  }
+  t.lastId = m_id;
+  t.last = buffer.get();
+  return t.last;
+}
+
+void BinaryFileLogAppender::append(const char* head, size_t head_size, const char* name, size_t name_size,
+                                   const char* body, size_t body_size) {
+  Buffer* buffer = getBuffer();
+  size_t total = head_size + name_size + body_size;
+  buffer->mutex.lock();
+  if (buffer->data.size() + total > m_bufferSize && !buffer->data.empty()) {
+    // 缓冲满了, 由写日志的线程自己写文件
+    buffer->mutex.unlock();
+    {
+      Mutex::Lock lock(m_fileMutex);
+      writeBuffer(*buffer);
+    }
+    buffer->mutex.lock();
+  }
+  size_t before = buffer->data.size();
+  buffer->data.append(head, head_size);
+  buffer->data.append(name, name_size);
+  buffer->data.append(body, body_size);
+  bool half = before < m_bufferSize / 2 && buffer->data.size() >= m_bufferSize / 2;
+  buffer->mutex.unlock();
+  if (half) {
+    m_flushSem.notify();
+  }
+}
+
+void BinaryFileLogAppender::logBinary(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const BinaryLogRecord& record) {
+  if (level < m_level) {
+    return;
+  }
+  const std::string& name = logger->getName();
+  uint8_t name_len = name.size() > 255 ? 255 : name.size();
+  char head[1 + 4 + 1 + 8 + 4 + 4 + 1 + 4];
+  char* p = head;
+  *p++ = BinaryLog::EVENT_RECORD;
+  memcpy(p, &record.site, 4);
+  p += 4;
+  *p++ = (uint8_t)level;
+  memcpy(p, &record.timeUs, 8);
+  p += 8;
+  memcpy(p, &record.threadId, 4);
+  p += 4;
+  memcpy(p, &record.fiberId, 4);
+  p += 4;
+  *p++ = name_len;
+  memcpy(p, &record.size, 4);
+  append(head, sizeof(head), name.data(), name_len, record.payload, record.size);
+  if (level == LogLevel::FATAL) {
+    flush();
+  }
+}
+
+void BinaryFileLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+  if (level < m_level) {
+    return;
+  }
+  LogFormatter::ptr formatter;
+  {
+    MutexType::Lock lock(m_mutex);
+    formatter = m_formatter;
+  }
+  static thread_local std::string t_text;
+  t_text.clear();
+  formatter->format(t_text, logger, level, event);
+  uint32_t size = t_text.size();
+  char head[1 + 4];
+  head[0] = BinaryLog::TEXT_RECORD;
+  memcpy(head + 1, &size, 4);
+  append(head, sizeof(head), nullptr, 0, t_text.data(), t_text.size());
+  if (level == LogLevel::FATAL) {
+    flush();
+  }
+}
+
+void BinaryFileLogAppender::writeBuffer(Buffer& buffer) {
+  {
+    SpinLock::Lock lock(buffer.mutex);
+    buffer.data.swap(buffer.spare);
+  }
+  if (buffer.spare.empty() || m_fd < 0) {
+    buffer.spare.clear();
+    return;
+  }
+  // 交换之后再取调用点个数, 缓冲中引用的调用点都已经登记
+  uint32_t count = BinaryLog::GetSiteCount();
+  m_sitesBuffer.clear();
+  for (uint32_t id = m_sitesWritten + 1; id <= count; ++id) {
+    const BinaryLogSite* site = BinaryLog::GetSite(id);
+    uint16_t file_len = strlen(site->file);
+    uint16_t fmt_len = strlen(site->fmt);
+    uint16_t types_len = strlen(site->types);
+    uint32_t level = site->level;
+    m_sitesBuffer.push_back((char)BinaryLog::SITE_RECORD);
+    m_sitesBuffer.append((const char*)&site->id, 4);
+    m_sitesBuffer.append((const char*)&level, 4);
+    m_sitesBuffer.append((const char*)&site->line, 4);
+    m_sitesBuffer.append((const char*)&file_len, 2);
+    m_sitesBuffer.append((const char*)&fmt_len, 2);
+    m_sitesBuffer.append((const char*)&types_len, 2);
+    m_sitesBuffer.append(site->file, file_len);
+    m_sitesBuffer.append(site->fmt, fmt_len);
+    m_sitesBuffer.append(site->types, types_len);
+  }
+  m_sitesWritten = count;
+  if (!m_sitesBuffer.empty()) {
+    WriteFully(m_fd, m_sitesBuffer.data(), m_sitesBuffer.size());
+  }
+  WriteFully(m_fd, buffer.spare.data(), buffer.spare.size());
+  buffer.spare.clear();
+}
+
+void BinaryFileLogAppender::flush() {
+  Mutex::Lock lock(m_fileMutex);
+  auto& buffers = m_flushBuffers;
+  {
+    Mutex::Lock lock2(m_bufferMutex);
+    buffers = m_buffers;
+  }
+  for (auto& i : buffers) {
+    writeBuffer(*i);
+  }
+  buffers.clear();
+
+  // 回收已经退出的线程留下的空缓冲
+  Mutex::Lock lock2(m_bufferMutex);
+  m_buffers.erase(std::remove_if(m_buffers.begin(), m_buffers.end(), [](const std::shared_ptr<Buffer>& buffer) {
+      if (buffer.use_count() != 1) {
+        return false;
+      }
+      SpinLock::Lock lock3(buffer->mutex);
+      return buffer->data.empty();
+    }), m_buffers.end());
+}
+
+void BinaryFileLogAppender::flushLoop() {
+  while (!m_stop) {
+    m_flushSem.waitFor(100);
+    if (m_stop) {
+      break;
+    }
+    flush();
+  }
+}
+
+bool BinaryFileLogAppender::reopen() {
+  Mutex::Lock lock(m_fileMutex);
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+  // 追加打开: 重启和配置重载不清掉旧日志, 被替换的appender还在写同一个文件时记录也不会互相覆盖
+  m_fd = open(m_filename.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (m_fd < 0) {
+    return false;
+  }
+  // 调用点的定义重新写一遍, 解码时同一个调用点可以重复定义
+  m_sitesWritten = 0;
+  struct stat st {};
+  if (fstat(m_fd, &st) == 0 && st.st_size != 0) {
+    // 旧版本写的文件不能接着追加, 改名留给旧的解码工具, 重新建一个文件
+    char magic[sizeof(BinaryLog::kMagic) - 1];
+    uint32_t version = 0;
+    if (pread(m_fd, magic, sizeof(magic), 0) != (ssize_t)sizeof(magic)
+        || memcmp(magic, BinaryLog::kMagic, sizeof(magic))
+        || pread(m_fd, &version, sizeof(version), sizeof(magic)) != (ssize_t)sizeof(version)
+        || version != BinaryLog::kVersion) {
+      std::string old_name = m_filename + ".old";
+      std::cout << "BinaryFileLogAppender " << m_filename << " has another format, move it to "
+                << old_name << std::endl;
+      close(m_fd);
+      if (rename(m_filename.c_str(), old_name.c_str())) {
+        m_fd = -1;
+        return false;
+      }
+      m_fd = open(m_filename.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+      if (m_fd < 0) {
+        return false;
+      }
+      st.st_size = 0;
+    }
+  }
+  if (st.st_size == 0) {
+    uint32_t version = BinaryLog::kVersion;
+    WriteFully(m_fd, BinaryLog::kMagic, sizeof(BinaryLog::kMagic) - 1);
+    WriteFully(m_fd, (const char*)&version, sizeof(version));
+  }
+  return true;
+}
+
+std::string BinaryFileLogAppender::toYamlString() {
+  MutexType::Lock lock(m_mutex);
+  YAML::Node node;
+  node["type"] = "BinaryFileLogAppender";
+  node["file"] = m_filename;
+  if (m_level != LogLevel::UNKNOW)
+	node["level"] = LogLevel::toString(m_level);
+  if (m_formatter && m_hasFormatter) {
+    node["formatter"] = m_formatter->getPattern();
+  }
+  std::stringstream ss;
+  ss << node;
+  return ss.str();
+}
+
+}
@@ -0,0 +1,285 @@
+#ifndef SYLAR_SYLAR_LOG_BINARY_H_
+#define SYLAR_SYLAR_LOG_BINARY_H_
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <type_traits>
+#include <unordered_map>
+
+#include "log.h"
+
+/*
+ * 二进制日志
+ * 每个调用点第一次执行时登记格式串和参数类型, 得到一个id; 之后只把原始参数复制进线程局部的缓冲, 不做文本格式化
+ * 格式串必须是字符串常量, 用printf的语法, 不支持宽度和精度写成'*'
+ * 参数支持整数, 枚举, 浮点数, const char*, std::string和指针
+ * 写到BinaryFileLogAppender时保存原始参数, 用tools/log_decoder还原成文本; 其他appender收到时当场还原成文本
+ * */
+#define SYLAR_LOG_BIN(logger, level, fmt, ...) \
+	if (SYLAR_LOG_ENABLED(logger, level)) \
+		sylar::BinaryLog::Log([]{}, logger, level, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+
+#define SYLAR_LOG_BIN_DEBUG(logger, fmt, ...) SYLAR_LOG_BIN(logger, sylar::LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#define SYLAR_LOG_BIN_INFO(logger, fmt, ...) SYLAR_LOG_BIN(logger, sylar::LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define SYLAR_LOG_BIN_WARN(logger, fmt, ...) SYLAR_LOG_BIN(logger, sylar::LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define SYLAR_LOG_BIN_ERROR(logger, fmt, ...) SYLAR_LOG_BIN(logger, sylar::LogLevel::ERROR, fmt, ##__VA_ARGS__)
+
+namespace sylar {
+
+// 一条二进制日志, payload按登记的参数类型依次存放
+struct BinaryLogRecord {
+  uint32_t site = 0;
+  uint64_t timeUs = 0;
+  uint32_t threadId = 0;
+  uint32_t fiberId = 0;
+  const char* payload = nullptr;
+  uint32_t size = 0;
+};
+
+// 调用点登记的信息
+struct BinaryLogSite {
+  uint32_t id = 0;
+  LogLevel::Level level = LogLevel::UNKNOW;
+  const char* file = nullptr;
+  int32_t line = 0;
+  const char* fmt = nullptr;
+  const char* types = nullptr;
+};
+
+namespace binary_detail {
+
+template <typename T>
+struct AlwaysFalse {
+  static constexpr bool value = false;
+};
+
+template <typename T>
+inline void PutRaw(std::string& out, T v) {
+  out.append((const char*)&v, sizeof(v));
+}
+
+inline void PutString(std::string& out, const char* s, size_t len) {
+  uint16_t n = len > 0xffff ? 0xffff : len;
+  PutRaw(out, n);
+  out.append(s, n);
+}
+
+/*
+ * 参数类型编码
+ * i/u: 不超过4字节的有符号/无符号整数, 存4字节
+ * l/U: 8字节的有符号/无符号整数
+ * d: 浮点数, 存double
+ * s: 字符串, 2字节长度 + 内容
+ * p: 指针, 存8字节
+ * */
+template <typename T, typename Enable = void>
+struct BinaryArg {
+  static_assert(AlwaysFalse<T>::value, "SYLAR_LOG_BIN: unsupported argument type");
+};
+
+template <typename T>
+struct BinaryArg<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+  static constexpr bool kSmall = sizeof(T) <= 4;
+  static constexpr char code = kSmall ? (std::is_signed<T>::value ? 'i' : 'u')
+                                      : (std::is_signed<T>::value ? 'l' : 'U');
+  using Stored = typename std::conditional<kSmall,
+      typename std::conditional<std::is_signed<T>::value, int32_t, uint32_t>::type,
+      typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type>::type;
+  static void Put(std::string& out, T v) {PutRaw(out, (Stored)v);}
+};
+
+template <typename T>
+struct BinaryArg<T, typename std::enable_if<std::is_enum<T>::value>::type>
+    : public BinaryArg<typename std::underlying_type<T>::type> {
+  static void Put(std::string& out, T v) {
+    BinaryArg<typename std::underlying_type<T>::type>::Put(out, (typename std::underlying_type<T>::type)v);
+  }
+};
+
+template <typename T>
+struct BinaryArg<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  static constexpr char code = 'd';
+  static void Put(std::string& out, T v) {PutRaw(out, (double)v);}
+};
+
+template <>
+struct BinaryArg<const char*> {
+  static constexpr char code = 's';
+  static void Put(std::string& out, const char* v) {
+    if (!v) {
+      v = "(null)";
+    }
+    PutString(out, v, strlen(v));
+  }
+};
+
+template <>
+struct BinaryArg<char*> : public BinaryArg<const char*> {};
+
+template <>
+struct BinaryArg<std::string> {
+  static constexpr char code = 's';
+  static void Put(std::string& out, const std::string& v) {PutString(out, v.data(), v.size());}
+};
+
+template <typename T>
+struct BinaryArg<T*, typename std::enable_if<!std::is_same<typename std::remove_cv<T>::type, char>::value>::type> {
+  static constexpr char code = 'p';
+  static void Put(std::string& out, T* v) {PutRaw(out, (uint64_t)(uintptr_t)v);}
+};
+
+template <typename... Args>
+struct ArgTypes {
+  static constexpr char value[] = {BinaryArg<typename std::decay<Args>::type>::code..., '\0'};
+};
+
+}
+
+class BinaryLog {
+ public:
+  /*
+   * 文件格式: 文件头kMagic(8字节) + 4字节版本, 之后是一条条记录, 第一个字节是记录类型, 整数按本机字节序
+   * SITE_RECORD: id(4) level(4) line(4) file长度(2) fmt长度(2) types长度(2) file fmt types
+   * EVENT_RECORD: site(4) level(1) timeUs(8) threadId(4) fiberId(4) logger名长度(1) payload长度(4) logger名 payload
+   * TEXT_RECORD: 长度(4) 文本
+   * 同一个调用点可以用运行时的级别调用(SYLAR_LOG_BIN), 级别按每条记录保存, SITE_RECORD中的是第一次调用时的级别
+   * */
+  static constexpr char kMagic[] = "SYLARBIN";
+  static constexpr uint32_t kVersion = 2;
+  enum RecordType {
+    SITE_RECORD = 1,
+    EVENT_RECORD = 2,
+    TEXT_RECORD = 3
+  };
+
+  // 最多登记的调用点个数
+  static constexpr uint32_t kMaxSites = 16384;
+  // 登记调用点, 返回id, 每个调用点只调用一次; 超过kMaxSites返回0, 该调用点不输出
+  static uint32_t Register(LogLevel::Level level, const char* file, int32_t line, const char* fmt, const char* types);
+  // 已登记的调用点, id不存在时返回nullptr
+  static const BinaryLogSite* GetSite(uint32_t id);
+  static uint32_t GetSiteCount();
+
+  /*
+   * 按格式串和参数类型把payload还原成文本, 追加到out
+   * 参数和格式串对不上时在对应位置输出<bad arg>, 返回false
+   * */
+  static bool Format(std::string& out, const char* fmt, const char* types, const char* payload, size_t size);
+
+  // SYLAR_LOG_BIN展开后调用, tag是调用点上的lambda, 让每个调用点有自己的静态id
+  template <typename Tag, typename... Args>
+  static void Log(Tag, const std::shared_ptr<Logger>& logger, LogLevel::Level level,
+                  const char* file, int32_t line, const char* fmt, const Args&... args) {
+    static const uint32_t s_id = Register(level, file, line, fmt, binary_detail::ArgTypes<Args...>::value);
+    if (!s_id) {
+      return;
+    }
+    std::string& buf = Buffer();
+    (void)buf;
+    (binary_detail::BinaryArg<typename std::decay<Args>::type>::Put(buf, args), ...);
+    BinaryLogRecord record;
+    record.site = s_id;
+    record.timeUs = GetMonotonicWallUS();
+    record.threadId = GetThreadId();
+    record.fiberId = GetFiberId();
+    record.payload = buf.data();
+    record.size = buf.size();
+    logger->logBinary(level, record, logger);
+  }
+
+ private:
+  // 线程局部的参数缓冲, 复用时保留容量
+  static std::string& Buffer();
+};
+
+// 读取BinaryFileLogAppender写的文件, 逐条还原成文本
+class BinaryLogReader {
+ public:
+  // 打开文件并检查文件头
+  bool open(const std::string& path);
+  // 读出下一条记录, 还原成一行文本(不含换行), 文件结束或者出错返回false
+  bool next(std::string& line);
+  // 出错时的原因, 正常读完时为空
+  const std::string& getError() const {return m_error;}
+
+ private:
+  struct Site {
+    LogLevel::Level level = LogLevel::UNKNOW;
+    int32_t line = 0;
+    std::string file;
+    std::string fmt;
+    std::string types;
+  };
+
+  bool read(void* buf, size_t size);
+  // 文件中还没有读的字节数, 用来检查记录里的长度
+  uint64_t remaining();
+
+ private:
+  std::ifstream m_in;
+  uint64_t m_fileSize = 0;
+  std::unordered_map<uint32_t, Site> m_sites;
+  std::string m_payload;
+  std::string m_error;
+};
+
+/*
+ * 二进制日志文件
+ * 每个写日志的线程一块缓冲(只有本线程和刷新时加锁, 基本没有竞争), 写满或者后台线程每100ms写入文件
+ * 缓冲超过一半时提前唤醒后台线程, 尽量不让写日志的线程自己写文件
+ * 文件中先写调用点的定义, 再写引用它的记录, 文件自包含, 可以离线还原
+ * 普通的文本日志按appender的formatter格式化后作为文本记录写入
+ * */
+class BinaryFileLogAppender : public LogAppender {
+ public:
+  using ptr = std::shared_ptr<BinaryFileLogAppender>;
+
+  // buffer_size: 每个线程的缓冲大小
+  explicit BinaryFileLogAppender(const std::string& filename, size_t buffer_size = 64 * 1024);
+  ~BinaryFileLogAppender() override;
+
+  void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
+  void logBinary(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const BinaryLogRecord& record) override;
+  std::string toYamlString() override;
+  void flush() override;
+  // 重新打开文件(追加, 空文件先写文件头),打开成功返回true
+  bool reopen();
+
+ private:
+  struct Buffer;
+  struct ThreadBuffers;
+  static thread_local ThreadBuffers t_buffers;
+
+  Buffer* getBuffer();
+  // 把一条记录追加到本线程的缓冲
+  void append(const char* head, size_t head_size, const char* name, size_t name_size, const char* body, size_t body_size);
+  // 把一个线程的缓冲写入文件, 需要持有m_fileMutex
+  void writeBuffer(Buffer& buffer);
+  void flushLoop();
+
+ private:
+  uint64_t m_id;
+  std::string m_filename;
+  size_t m_bufferSize;
+  int m_fd = -1;
+  // 已经写入文件的调用点个数(调用点id从1开始连续分配)
+  uint32_t m_sitesWritten = 0;
+  std::string m_sitesBuffer;
+  Mutex m_fileMutex;
+  Mutex m_bufferMutex;
+  std::vector<std::shared_ptr<Buffer>> m_buffers;
+  std::vector<std::shared_ptr<Buffer>> m_flushBuffers;
+  std::atomic<bool> m_stop {false};
+  // 后台线程每100ms或者被唤醒(停止, 某个缓冲过半)时写文件
+  Semaphore m_flushSem;
+  Thread::ptr m_thread;
+};
+
+}
+
+#endif //SYLAR_SYLAR_LOG_BINARY_H_
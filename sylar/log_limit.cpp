@@ -0,0 +1,89 @@
+#include "log_limit.h"
+#include "config.h"
+
+#include <time.h>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static ConfigVar<uint64_t>::ptr g_log_rate_limit_rate =
+    Config::Lookup<uint64_t>("log.rate_limit.rate", 10,
+                             "lines per second allowed for each rate limited log site, 0 means unlimited");
+
+static ConfigVar<uint64_t>::ptr g_log_rate_limit_burst =
+    Config::Lookup<uint64_t>("log.rate_limit.burst", 20,
+                             "max burst of lines for each rate limited log site");
+
+static std::atomic<uint64_t> s_rate {0};
+static std::atomic<uint64_t> s_burst {1};
+
+struct _LogLimitIniter {
+  _LogLimitIniter() {
+    s_rate = *g_log_rate_limit_rate->getValue();
+    s_burst = *g_log_rate_limit_burst->getValue();
+    g_log_rate_limit_rate->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+        SYLAR_LOG_INFO(g_logger) << "log rate limit changed from " << old_value << " to " << new_value;
+        s_rate = new_value;
+      });
+    g_log_rate_limit_burst->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+        SYLAR_LOG_INFO(g_logger) << "log rate limit burst changed from " << old_value << " to " << new_value;
+        s_burst = new_value;
+      });
+  }
+};
+
+static _LogLimitIniter s_log_limit_initer;
+
+// 限流只关心时间间隔, 用单调时钟, 不受改系统时间影响
+static uint64_t MonotonicUS() {
+  timespec ts {};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+bool LogEveryMs::allow(uint64_t ms, uint64_t& suppressed) {
+  uint64_t now = MonotonicUS();
+  uint64_t last = m_last.load(std::memory_order_relaxed);
+  // CAS失败说明别的线程刚放行了一条
+  if ((last && now - last < ms * 1000)
+      || !m_last.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
+uint64_t LogRateLimiter::GetRate() {
+  return s_rate.load(std::memory_order_relaxed);
+}
+
+uint64_t LogRateLimiter::GetBurst() {
+  return s_burst.load(std::memory_order_relaxed);
+}
+
+bool LogRateLimiter::allow(uint64_t& suppressed) {
+  uint64_t rate = GetRate();
+  if (rate) {
+    uint64_t burst = std::max<uint64_t>(GetBurst(), 1);
+    uint64_t interval = std::max<uint64_t>(1000000 / rate, 1);
+    uint64_t now = MonotonicUS();
+    uint64_t tat = m_tat.load(std::memory_order_relaxed);
+    while (true) {
+      // 桶里的令牌数 = (now + interval * burst - tat) / interval
+      uint64_t next = std::max(tat, now) + interval;
+      if (next - now > interval * burst) {
+        m_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      if (m_tat.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+  }
+  suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+  return true;
+}
+
+}
@@ -0,0 +1,120 @@
+#ifndef SYLAR_SYLAR_LOG_LIMIT_H_
+#define SYLAR_SYLAR_LOG_LIMIT_H_
+
+#include <cstdint>
+#include <atomic>
+
+#include "log.h"
+
+/*
+ * 按调用点采样和限流的日志
+ * 每个调用点一份静态状态(用调用点上的lambda区分), 状态只用原子变量, 不加锁
+ * 被丢掉的条数在下一条输出的日志末尾报告: "(suppressed N)"
+ * 级别不够的日志不计数
+ * */
+#define SYLAR_LOG_SITE_STATE(type) \
+	[]() -> type& { static type s_state; return s_state; }()
+
+#define SYLAR_LOG_LIMITED(logger, level, cond) \
+	if (uint64_t sylar_suppressed_ = 0; SYLAR_LOG_ENABLED(logger, level) && (cond)) \
+		sylar::LogEventWarp(logger, level, __FILE__, __LINE__, sylar_suppressed_).getSS()
+
+// 每n条输出一条
+#define SYLAR_LOG_EVERY_N(logger, level, n) \
+	SYLAR_LOG_LIMITED(logger, level, SYLAR_LOG_SITE_STATE(sylar::LogEveryN).allow(n, sylar_suppressed_))
+// 每ms毫秒最多输出一条
+#define SYLAR_LOG_EVERY_MS(logger, level, ms) \
+	SYLAR_LOG_LIMITED(logger, level, SYLAR_LOG_SITE_STATE(sylar::LogEveryMs).allow(ms, sylar_suppressed_))
+// 只输出前n条
+#define SYLAR_LOG_FIRST_N(logger, level, n) \
+	SYLAR_LOG_LIMITED(logger, level, SYLAR_LOG_SITE_STATE(sylar::LogFirstN).allow(n, sylar_suppressed_))
+// 令牌桶限流, 速率和桶大小由配置log.rate_limit决定
+#define SYLAR_LOG_RATE_LIMITED(logger, level) \
+	SYLAR_LOG_LIMITED(logger, level, SYLAR_LOG_SITE_STATE(sylar::LogRateLimiter).allow(sylar_suppressed_))
+
+#define SYLAR_LOG_DEBUG_EVERY_N(logger, n) SYLAR_LOG_EVERY_N(logger, sylar::LogLevel::DEBUG, n)
+#define SYLAR_LOG_INFO_EVERY_N(logger, n) SYLAR_LOG_EVERY_N(logger, sylar::LogLevel::INFO, n)
+#define SYLAR_LOG_WARN_EVERY_N(logger, n) SYLAR_LOG_EVERY_N(logger, sylar::LogLevel::WARN, n)
+#define SYLAR_LOG_ERROR_EVERY_N(logger, n) SYLAR_LOG_EVERY_N(logger, sylar::LogLevel::ERROR, n)
+
+#define SYLAR_LOG_DEBUG_EVERY_MS(logger, ms) SYLAR_LOG_EVERY_MS(logger, sylar::LogLevel::DEBUG, ms)
+#define SYLAR_LOG_INFO_EVERY_MS(logger, ms) SYLAR_LOG_EVERY_MS(logger, sylar::LogLevel::INFO, ms)
+#define SYLAR_LOG_WARN_EVERY_MS(logger, ms) SYLAR_LOG_EVERY_MS(logger, sylar::LogLevel::WARN, ms)
+#define SYLAR_LOG_ERROR_EVERY_MS(logger, ms) SYLAR_LOG_EVERY_MS(logger, sylar::LogLevel::ERROR, ms)
+
+#define SYLAR_LOG_DEBUG_FIRST_N(logger, n) SYLAR_LOG_FIRST_N(logger, sylar::LogLevel::DEBUG, n)
+#define SYLAR_LOG_INFO_FIRST_N(logger, n) SYLAR_LOG_FIRST_N(logger, sylar::LogLevel::INFO, n)
+#define SYLAR_LOG_WARN_FIRST_N(logger, n) SYLAR_LOG_FIRST_N(logger, sylar::LogLevel::WARN, n)
+#define SYLAR_LOG_ERROR_FIRST_N(logger, n) SYLAR_LOG_FIRST_N(logger, sylar::LogLevel::ERROR, n)
+
+#define SYLAR_LOG_DEBUG_LIMITED(logger) SYLAR_LOG_RATE_LIMITED(logger, sylar::LogLevel::DEBUG)
+#define SYLAR_LOG_INFO_LIMITED(logger) SYLAR_LOG_RATE_LIMITED(logger, sylar::LogLevel::INFO)
+#define SYLAR_LOG_WARN_LIMITED(logger) SYLAR_LOG_RATE_LIMITED(logger, sylar::LogLevel::WARN)
+#define SYLAR_LOG_ERROR_LIMITED(logger) SYLAR_LOG_RATE_LIMITED(logger, sylar::LogLevel::ERROR)
+
+namespace sylar {
+
+// 每n条放行一条, 放行时suppressed为上次放行之后丢掉的条数
+class LogEveryN {
+ public:
+  bool allow(uint64_t n, uint64_t& suppressed) {
+    uint64_t c = m_count.fetch_add(1, std::memory_order_relaxed);
+    if (n <= 1) {
+      return true;
+    }
+    if (c % n) {
+      return false;
+    }
+    suppressed = c ? n - 1 : 0;
+    return true;
+  }
+
+ private:
+  std::atomic<uint64_t> m_count {0};
+};
+
+// 只放行前n条, 之后的不再输出, 也就不报告丢掉的条数
+class LogFirstN {
+ public:
+  bool allow(uint64_t n, uint64_t& suppressed) {
+    if (m_count.load(std::memory_order_relaxed) >= n) {
+      return false;
+    }
+    return m_count.fetch_add(1, std::memory_order_relaxed) < n;
+  }
+
+ private:
+  std::atomic<uint64_t> m_count {0};
+};
+
+// 每ms毫秒最多放行一条
+class LogEveryMs {
+ public:
+  bool allow(uint64_t ms, uint64_t& suppressed);
+
+ private:
+  // 上次放行的时间(单调时钟, 微秒), 0表示还没有放行过
+  std::atomic<uint64_t> m_last {0};
+  std::atomic<uint64_t> m_suppressed {0};
+};
+
+/*
+ * 令牌桶, 用GCRA实现: 只维护一个理论到达时间, 一次CAS完成取令牌
+ * 每个调用点每秒补充log.rate_limit.rate个令牌, 最多攒log.rate_limit.burst个; rate为0时不限流
+ * */
+class LogRateLimiter {
+ public:
+  bool allow(uint64_t& suppressed);
+
+  // 当前配置的速率和桶大小
+  static uint64_t GetRate();
+  static uint64_t GetBurst();
+
+ private:
+  std::atomic<uint64_t> m_tat {0};
+  std::atomic<uint64_t> m_suppressed {0};
+};
+
+}
+
+#endif //SYLAR_SYLAR_LOG_LIMIT_H_
@@ -0,0 +1,473 @@
+#include "log_mmap.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <yaml-cpp/yaml.h>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include "thread.h"
+
+namespace sylar {
+
+struct MmapFileLogAppender::Chunk {
+  char* addr = nullptr;
+  uint64_t base = 0;   // 映射窗口在文件中的偏移
+  size_t size = 0;
+  uint64_t synced = 0; // 已经msync到的文件偏移, 需要持有appender的m_mutex
+
+  ~Chunk() {
+    if (addr) {
+      munmap(addr, size);
+    }
+  }
+};
+
+static const size_t kPageSize = sysconf(_SC_PAGESIZE);
+
+// 一个文件的映射和写入位置, 路径相同的appender共用
+struct MmapFileLogAppender::File {
+  using ptr = std::shared_ptr<File>;
+  // 待msync的文件范围[from, to)
+  struct SyncRange {
+    std::shared_ptr<Chunk> chunk;
+    uint64_t from;
+    uint64_t to;
+  };
+
+  File(const std::string& filename, size_t chunk_size, uint64_t sync_interval_ms);
+  ~File();
+
+  // 取路径对应的文件, 没有打开过就打开
+  static ptr Get(const std::string& filename, size_t chunk_size, uint64_t sync_interval_ms);
+  // 释放appender持有的引用, 最后一个引用释放时截断关闭文件
+  static void Release(ptr& file);
+
+  void write(const char* data, size_t size);
+  void flush();
+  bool reopen();
+
+  // 以下需要持有m_mutex
+  // 截断关闭文件, 需要msync的范围放到ranges中, 在锁外执行
+  void closeLocked(std::vector<SyncRange>& ranges);
+  // 映射从m_size所在的页开始的一个chunk
+  bool mapLocked();
+  void writeLocked(const char* data, size_t size);
+  // 取出需要msync的范围, 在锁外执行
+  void collectSyncLocked(std::vector<SyncRange>& ranges);
+
+  void syncLoop();
+  static void Sync(const std::vector<SyncRange>& ranges);
+
+  // 进程退出时全局对象的析构顺序不确定, 这两个对象不释放
+  // 文件的引用只在持有这个锁时释放, 查找和最后一个引用释放时的截断关闭是串行的,
+  // 新appender不会在旧文件截断之前映射同一个文件
+  static Mutex& RegistryMutex();
+  static std::unordered_map<std::string, std::weak_ptr<File>>& Registry();
+
+  // 崩溃处理函数里要截断的文件, 固定大小, 信号处理函数中不能加锁
+  static constexpr int kMaxCrashFiles = 32;
+  static std::atomic<File*> s_crashFiles[kMaxCrashFiles];
+
+  std::string m_filename;
+  size_t m_chunkSize;
+  uint64_t m_syncInterval;
+  // 扩展文件和映射窗口(posix_fallocate, mmap)会在锁内阻塞, 用互斥锁不用自旋锁
+  Mutex m_mutex;
+  // 串行化reopen, 找文件结尾的pread在m_mutex外做
+  Mutex m_reopenMutex;
+  // 崩溃处理函数会读fd和长度, 用原子变量
+  std::atomic<int> m_fd {-1};
+  std::atomic<uint64_t> m_size {0};
+  std::atomic<uint64_t> m_dropped {0};
+  std::shared_ptr<Chunk> m_chunk;
+  // 换下来还没有msync完的窗口
+  std::vector<std::shared_ptr<Chunk>> m_retired;
+  int m_slot = -1;
+  std::atomic<bool> m_stop {false};
+  Thread::ptr m_thread;
+};
+
+std::atomic<MmapFileLogAppender::File*> MmapFileLogAppender::File::s_crashFiles[kMaxCrashFiles];
+
+static const int kCrashSignals[] = {SIGSEGV, SIGBUS, SIGABRT, SIGFPE, SIGILL};
+static struct sigaction s_old_actions[NSIG];
+
+// 线程的信号备用栈, 协程栈溢出触发SIGSEGV时崩溃处理函数仍然有栈可用
+struct CrashAltStack {
+  void* stack = nullptr;
+
+  CrashAltStack() {
+    stack_t old {};
+    if (sigaltstack(nullptr, &old) == 0 && !(old.ss_flags & SS_DISABLE)) {
+      return; // 线程已经设置了备用栈
+    }
+    size_t size = std::max<size_t>(SIGSTKSZ, 64 * 1024);
+    stack = malloc(size);
+    stack_t ss {};
+    ss.ss_sp = stack;
+    ss.ss_size = size;
+    if (sigaltstack(&ss, nullptr)) {
+      free(stack);
+      stack = nullptr;
+    }
+  }
+
+  ~CrashAltStack() {
+    if (stack) {
+      stack_t ss {};
+      ss.ss_flags = SS_DISABLE;
+      sigaltstack(&ss, nullptr);
+      free(stack);
+    }
+  }
+};
+
+// 写日志的线程第一次调用时设置备用栈
+static void EnsureCrashAltStack() {
+  static thread_local CrashAltStack t_alt_stack;
+  (void)t_alt_stack;
+}
+
+Mutex& MmapFileLogAppender::File::RegistryMutex() {
+  static auto mutex = new Mutex;
+  return *mutex;
+}
+
+std::unordered_map<std::string, std::weak_ptr<MmapFileLogAppender::File>>& MmapFileLogAppender::File::Registry() {
+  static auto files = new std::unordered_map<std::string, std::weak_ptr<File>>;
+  return *files;
+}
+
+MmapFileLogAppender::File::File(const std::string& filename, size_t chunk_size, uint64_t sync_interval_ms)
+    : m_filename(filename),
+      m_chunkSize(chunk_size),
+      m_syncInterval(sync_interval_ms) {
+  if (!reopen()) {
+    std::cout << "MmapFileLogAppender open " << m_filename << " fail, errno=" << errno
+              << " errstr=" << strerror(errno) << std::endl;
+  }
+  for (int i = 0; i < kMaxCrashFiles; ++i) {
+    File* expected = nullptr;
+    if (s_crashFiles[i].compare_exchange_strong(expected, this)) {
+      m_slot = i;
+      break;
+    }
+  }
+  m_thread.reset(new Thread(std::bind(&File::syncLoop, this), "mmap_log"));
+}
+
+MmapFileLogAppender::File::~File() {
+  m_stop = true;
+  if (m_thread) {
+    m_thread->join();
+  }
+  if (m_slot >= 0) {
+    s_crashFiles[m_slot] = nullptr;
+  }
+  std::vector<SyncRange> ranges;
+  {
+    Mutex::Lock lock(m_mutex);
+    closeLocked(ranges);
+  }
+  Sync(ranges);
+}
+
+MmapFileLogAppender::File::ptr MmapFileLogAppender::File::Get(const std::string& filename, size_t chunk_size,
+                                                              uint64_t sync_interval_ms) {
+  Mutex::Lock lock(RegistryMutex());
+  auto& weak = Registry()[filename];
+  ptr file = weak.lock();
+  if (!file) {
+    file = std::make_shared<File>(filename, chunk_size, sync_interval_ms);
+    weak = file;
+  }
+  return file;
+}
+
+void MmapFileLogAppender::File::Release(ptr& file) {
+  if (!file) {
+    return;
+  }
+  Mutex::Lock lock(RegistryMutex());
+  auto& files = Registry();
+  auto it = files.find(file->m_filename);
+  // 最后一个引用时在这里析构, 截断关闭完成之后才会有新的appender打开这个路径
+  file.reset();
+  if (it != files.end() && it->second.expired()) {
+    files.erase(it);
+  }
+}
+
+void MmapFileLogAppender::File::write(const char* data, size_t size) {
+  Mutex::Lock lock(m_mutex);
+  if (m_fd >= 0) {
+    writeLocked(data, size);
+  }
+}
+
+void MmapFileLogAppender::File::writeLocked(const char* data, size_t size) {
+  uint64_t offset = m_size.load(std::memory_order_relaxed);
+  while (size) {
+    if (!m_chunk || offset >= m_chunk->base + m_chunk->size) {
+      if (!mapLocked()) {
+        ++m_dropped;
+        return;
+      }
+    }
+    size_t n = std::min<uint64_t>(size, m_chunk->base + m_chunk->size - offset);
+    memcpy(m_chunk->addr + (offset - m_chunk->base), data, n);
+    data += n;
+    size -= n;
+    offset += n;
+    m_size.store(offset, std::memory_order_release);
+  }
+}
+
+bool MmapFileLogAppender::File::mapLocked() {
+  uint64_t size = m_size;
+  // 窗口从当前长度所在的页开始, 和上一个窗口可能共用一页, MAP_SHARED下看到的是同一份页缓存
+  uint64_t base = size / kPageSize * kPageSize;
+  // 先分配磁盘空间, 否则磁盘满时写映射区域会收到SIGBUS
+  int rt = posix_fallocate(m_fd, base, m_chunkSize);
+  if (rt) {
+    std::cout << "MmapFileLogAppender extend " << m_filename << " fail, errno=" << rt
+              << " errstr=" << strerror(rt) << std::endl;
+    return false;
+  }
+  void* addr = mmap(nullptr, m_chunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, base);
+  if (addr == MAP_FAILED) {
+    std::cout << "MmapFileLogAppender mmap " << m_filename << " fail, errno=" << errno
+              << " errstr=" << strerror(errno) << std::endl;
+    return false;
+  }
+  auto chunk = std::make_shared<Chunk>();
+  chunk->addr = (char*)addr;
+  chunk->base = base;
+  chunk->size = m_chunkSize;
+  chunk->synced = size;
+  if (m_chunk) {
+    m_retired.push_back(m_chunk);
+  }
+  m_chunk = chunk;
+  return true;
+}
+
+void MmapFileLogAppender::File::collectSyncLocked(std::vector<SyncRange>& ranges) {
+  uint64_t size = m_size;
+  for (auto& i : m_retired) {
+    uint64_t end = std::min<uint64_t>(size, i->base + i->size);
+    if (end > i->synced) {
+      ranges.push_back({i, i->synced, end});
+    }
+  }
+  m_retired.clear();
+  if (m_chunk && size > m_chunk->synced) {
+    ranges.push_back({m_chunk, m_chunk->synced, size});
+    m_chunk->synced = size;
+  }
+}
+
+void MmapFileLogAppender::File::Sync(const std::vector<SyncRange>& ranges) {
+  for (auto& i : ranges) {
+    // msync的起始地址要按页对齐
+    uint64_t from = i.from / kPageSize * kPageSize;
+    msync(i.chunk->addr + (from - i.chunk->base), i.to - from, MS_SYNC);
+  }
+}
+
+void MmapFileLogAppender::File::flush() {
+  std::vector<SyncRange> ranges;
+  {
+    Mutex::Lock lock(m_mutex);
+    collectSyncLocked(ranges);
+  }
+  Sync(ranges);
+}
+
+void MmapFileLogAppender::File::syncLoop() {
+  uint64_t last = GetCurrentMS();
+  std::vector<SyncRange> ranges;
+  while (!m_stop) {
+    // 小步睡眠, 关闭时不用等一个完整的周期
+    usleep(10 * 1000);
+    uint64_t now = GetCurrentMS();
+    if (now - last < m_syncInterval) {
+      continue;
+    }
+    last = now;
+    {
+      Mutex::Lock lock(m_mutex);
+      collectSyncLocked(ranges);
+    }
+    // msync在锁外做, 持有窗口的引用, 写日志的线程换了窗口也不会被munmap
+    Sync(ranges);
+    ranges.clear();
+  }
+}
+
+void MmapFileLogAppender::File::closeLocked(std::vector<SyncRange>& ranges) {
+  int fd = m_fd;
+  if (fd < 0) {
+    return;
+  }
+  // 范围里持有窗口的引用, 锁外msync完之后才munmap; 截断只去掉m_size之后的部分, 不影响要msync的内容
+  collectSyncLocked(ranges);
+  m_chunk.reset();
+  // 去掉预分配但没有写的部分
+  if (ftruncate(fd, m_size)) {
+    std::cout << "MmapFileLogAppender truncate " << m_filename << " fail, errno=" << errno
+              << " errstr=" << strerror(errno) << std::endl;
+  }
+  m_fd = -1;
+  close(fd);
+}
+
+bool MmapFileLogAppender::File::reopen() {
+  Mutex::Lock reopen_lock(m_reopenMutex);
+  std::vector<SyncRange> ranges;
+  {
+    Mutex::Lock lock(m_mutex);
+    closeLocked(ranges);
+  }
+  Sync(ranges);
+  ranges.clear();
+
+  // 关闭到重新映射之间写的日志被丢弃(m_fd为-1)
+  int fd = open(m_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  // 被kill -9或者断电时来不及截断, 文件末尾是预分配的0, 从后往前找到最后一个非0字节
+  struct stat st {};
+  fstat(fd, &st);
+  uint64_t end = st.st_size;
+  std::vector<char> buf(64 * 1024);
+  while (end) {
+    size_t n = std::min<uint64_t>(end, buf.size());
+    if (pread(fd, buf.data(), n, end - n) != (ssize_t)n) {
+      break;
+    }
+    size_t i = n;
+    while (i && !buf[i - 1]) {
+      --i;
+    }
+    if (i) {
+      end = end - n + i;
+      break;
+    }
+    end -= n;
+  }
+  if (end != (uint64_t)st.st_size && ftruncate(fd, end)) {
+    close(fd);
+    return false;
+  }
+  Mutex::Lock lock(m_mutex);
+  m_size = end;
+  m_fd = fd;
+  return mapLocked();
+}
+
+MmapFileLogAppender::MmapFileLogAppender(const std::string& filename, size_t chunk_size, uint64_t sync_interval_ms)
+    : m_filename(filename),
+      m_chunkSize((std::max<size_t>(chunk_size, 64 * 1024) + kPageSize - 1) / kPageSize * kPageSize),
+      m_syncInterval(sync_interval_ms ? sync_interval_ms : 1000) {
+  InstallCrashHandler();
+  EnsureCrashAltStack();
+  m_file = File::Get(m_filename, m_chunkSize, m_syncInterval);
+  RegisterFlushAtExit(this);
+}
+
+MmapFileLogAppender::~MmapFileLogAppender() {
+  UnregisterFlushAtExit(this);
+  File::Release(m_file);
+}
+
+void MmapFileLogAppender::log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+  if (level < m_level || m_file->m_fd < 0) {
+    return;
+  }
+  EnsureCrashAltStack();
+  static thread_local std::string t_text;
+  t_text.clear();
+  {
+    MutexType::Lock lock(m_mutex);
+    m_formatter->format(t_text, logger, level, event);
+  }
+  m_file->write(t_text.data(), t_text.size());
+  if (level == LogLevel::FATAL) {
+    flush();
+  }
+}
+
+void MmapFileLogAppender::flush() {
+  m_file->flush();
+}
+
+bool MmapFileLogAppender::reopen() {
+  return m_file->reopen();
+}
+
+uint64_t MmapFileLogAppender::getSize() const {
+  return m_file->m_size;
+}
+
+uint64_t MmapFileLogAppender::getDropped() const {
+  return m_file->m_dropped;
+}
+
+std::string MmapFileLogAppender::toYamlString() {
+  MutexType::Lock lock(m_mutex);
+  YAML::Node node;
+  node["type"] = "MmapFileLogAppender";
+  node["file"] = m_filename;
+  node["chunk_size"] = m_chunkSize;
+  node["sync_interval"] = m_syncInterval;
+  if (m_level != LogLevel::UNKNOW)
+	node["level"] = LogLevel::toString(m_level);
+  if (m_formatter && m_hasFormatter) {
+    node["formatter"] = m_formatter->getPattern();
+  }
+  std::stringstream ss;
+  ss << node;
+  return ss.str();
+}
+
+void MmapFileLogAppender::InstallCrashHandler() {
+  static std::once_flag s_once;
+  std::call_once(s_once, []() {
+      struct sigaction sa {};
+      sa.sa_handler = OnCrash;
+      sa.sa_flags = SA_ONSTACK; // 在备用栈上运行, 栈溢出时也能截断
+      sigemptyset(&sa.sa_mask);
+      for (int sig : kCrashSignals) {
+        sigaction(sig, &sa, &s_old_actions[sig]);
+      }
+    });
+}
+
+void MmapFileLogAppender::OnCrash(int sig) {
+  // 只用异步信号安全的调用: 内容已经在页缓存里, 截断掉预分配的空白即可
+  int saved = errno;
+  for (auto& i : File::s_crashFiles) {
+    File* file = i.load();
+    if (!file) {
+      continue;
+    }
+    int fd = file->m_fd.load();
+    if (fd >= 0) {
+      ftruncate(fd, file->m_size.load());
+    }
+  }
+  // 恢复原来的处理方式, 重新发出信号, 处理函数返回后按原来的方式处理(默认是产生core)
+  sigaction(sig, &s_old_actions[sig], nullptr);
+  raise(sig);
+  errno = saved;
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef SYLAR_SYLAR_LOG_MMAP_H_
+#define SYLAR_SYLAR_LOG_MMAP_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "log.h"
+
+namespace sylar {
+
+/*
+ * 写到mmap映射的文件区域的appender, 每条日志只有一次memcpy, 没有write系统调用
+ * 文件按chunk_size预先分配并映射, 写满后再扩展一个chunk, 换到新的映射窗口
+ * 后台线程每隔sync_interval_ms把新写的部分msync到磁盘
+ * 映射是MAP_SHARED的, 进程崩溃时已写入的内容都在页缓存里, 不会丢;
+ * 崩溃信号(SIGSEGV/SIGBUS/SIGABRT/SIGFPE/SIGILL)的处理函数把文件截断到实际写入的长度, 去掉预分配的空白, 再交给原来的处理方式
+ * 处理函数在备用栈上运行(SA_ONSTACK), 写日志的线程第一次写时设置自己的备用栈, 协程栈溢出时也能截断
+ * 正常关闭时同样截断; 重新打开时找到最后一个非0字节接着写
+ * 同一个路径的文件只有一个属主: 路径相同的appender共用同一份文件和映射(比如配置重载时新旧appender同时存在),
+ * 最后一个appender析构时才截断关闭, 不会截掉别的appender还在写的映射区域
+ * 文件由第一个打开它的appender的chunk_size和sync_interval_ms决定
+ * */
+class MmapFileLogAppender : public LogAppender {
+ public:
+  using ptr = std::shared_ptr<MmapFileLogAppender>;
+
+  explicit MmapFileLogAppender(const std::string& filename, size_t chunk_size = 16 * 1024 * 1024,
+                               uint64_t sync_interval_ms = 1000);
+  ~MmapFileLogAppender() override;
+
+  void log(const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
+  std::string toYamlString() override;
+  // 同步msync已写入的内容
+  void flush() override;
+  // 重新打开文件,打开成功返回true; 共用这个文件的appender一起换到新打开的文件
+  bool reopen();
+
+  // 已经写入文件的字节数(包括共用这个文件的其他appender写的)
+  uint64_t getSize() const;
+  // 扩展文件失败(磁盘满)丢掉的日志条数
+  uint64_t getDropped() const;
+
+ private:
+  struct Chunk;
+  struct File;
+
+  static void InstallCrashHandler();
+  static void OnCrash(int sig);
+
+ private:
+  std::string m_filename;
+  size_t m_chunkSize;
+  uint64_t m_syncInterval;
+  std::shared_ptr<File> m_file;
+};
+
+}
+
+#endif //SYLAR_SYLAR_LOG_MMAP_H_
@@ -0,0 +1,165 @@
+#ifndef SYLAR_SYLAR_LOG_PATTERN_H_
+#define SYLAR_SYLAR_LOG_PATTERN_H_
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#include "log.h"
+#include "log_structured.h"
+
+namespace sylar {
+
+namespace pattern_detail {
+
+constexpr bool IsAlpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// 从i开始的字面量的结尾('%'或者字符串结尾)
+constexpr size_t LiteralEnd(const char* p, size_t i) {
+  while (p[i] && p[i] != '%') {
+    ++i;
+  }
+  return i;
+}
+
+// %后面的名字的结尾
+constexpr size_t NameEnd(const char* p, size_t i) {
+  while (IsAlpha(p[i])) {
+    ++i;
+  }
+  return i;
+}
+
+// '{'之后对应的'}'的位置, 没有时返回字符串结尾
+constexpr size_t BraceEnd(const char* p, size_t i) {
+  while (p[i] && p[i] != '}') {
+    ++i;
+  }
+  return i;
+}
+
+constexpr bool NameIs(const char* p, size_t begin, size_t end, const char* name) {
+  size_t i = 0;
+  for (; begin + i < end; ++i) {
+    if (!name[i] || name[i] != p[begin + i]) {
+      return false;
+    }
+  }
+  return !name[i];
+}
+
+// 模式串的子串, 以'\0'结尾, 给strftime用
+template <const char* P, size_t B, typename Seq>
+struct SubString;
+
+template <const char* P, size_t B, size_t... Is>
+struct SubString<P, B, std::index_sequence<Is...>> {
+  static constexpr char value[] = {P[B + Is]..., '\0'};
+};
+
+template <const char* P, size_t B, size_t E>
+constexpr const char* DateFormat() {
+  if constexpr (B == E) {
+    return "%Y-%m-%d %H:%M:%S";
+  } else {
+    return SubString<P, B, std::make_index_sequence<E - B>>::value;
+  }
+}
+
+template <typename T>
+struct AlwaysFalse {
+  static constexpr bool value = false;
+};
+
+/*
+ * 从模式串P的第I个字符开始展开
+ * 每一项在编译期确定, 生成一串直接调用LogWriter的代码, 没有虚函数和中间的ostream
+ * 支持的项和LogFormatter一致: %m %p %r %c %t %n %d{fmt} %f %l %T %F %N %ms %us %%
+ * */
+template <const char* P, size_t I>
+struct FusedFormat {
+  static void format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent& event) {
+    if constexpr (P[I] == '\0') {
+      return;
+    } else if constexpr (P[I] != '%') {
+      constexpr size_t end = LiteralEnd(P, I);
+      out.append(P + I, end - I);
+      FusedFormat<P, end>::format(out, logger, level, event);
+    } else if constexpr (P[I + 1] == '%') {
+      out.push_back('%');
+      FusedFormat<P, I + 2>::format(out, logger, level, event);
+    } else {
+      constexpr size_t name_end = NameEnd(P, I + 1);
+      constexpr bool has_arg = P[name_end] == '{';
+      constexpr size_t arg_end = has_arg ? BraceEnd(P, name_end + 1) : name_end;
+      static_assert(!has_arg || P[arg_end] == '}', "log pattern: missing '}'");
+      constexpr size_t next = has_arg ? arg_end + 1 : name_end;
+
+      if constexpr (NameIs(P, I + 1, name_end, "m")) {
+        out.append(event.getContentData(), event.getContentSize());
+        if (event.hasFields()) {
+          LogEscape::AppendLogfmtFields(out, event);
+        }
+      } else if constexpr (NameIs(P, I + 1, name_end, "p")) {
+        out.append(LogLevel::toString(level));
+      } else if constexpr (NameIs(P, I + 1, name_end, "r")) {
+        LogWriter::AppendUInt(out, event.getElapse());
+      } else if constexpr (NameIs(P, I + 1, name_end, "c")) {
+        out.append(event.getLogger()->getName());
+      } else if constexpr (NameIs(P, I + 1, name_end, "t")) {
+        LogWriter::AppendUInt(out, event.getThreadId());
+      } else if constexpr (NameIs(P, I + 1, name_end, "n")) {
+        out.push_back('\n');
+      } else if constexpr (NameIs(P, I + 1, name_end, "d")) {
+        static const uint64_t s_id = LogWriter::NextTimeFormatId();
+        LogWriter::AppendTime(out, s_id, DateFormat<P, has_arg ? name_end + 1 : 0, has_arg ? arg_end : 0>(),
+                              event.getTime());
+      } else if constexpr (NameIs(P, I + 1, name_end, "f")) {
+        out.append(event.getFile());
+      } else if constexpr (NameIs(P, I + 1, name_end, "l")) {
+        LogWriter::AppendInt(out, event.getLine());
+      } else if constexpr (NameIs(P, I + 1, name_end, "T")) {
+        out.push_back('\t');
+      } else if constexpr (NameIs(P, I + 1, name_end, "F")) {
+        LogWriter::AppendUInt(out, event.getFiberId());
+      } else if constexpr (NameIs(P, I + 1, name_end, "N")) {
+        out.append(event.getThreadName());
+      } else if constexpr (NameIs(P, I + 1, name_end, "ms")) {
+        LogWriter::AppendPadded(out, event.getTimeUs() / 1000 % 1000, 3);
+      } else if constexpr (NameIs(P, I + 1, name_end, "us")) {
+        LogWriter::AppendPadded(out, event.getTimeUs() % 1000000, 6);
+      } else {
+        static_assert(AlwaysFalse<std::integral_constant<size_t, I>>::value, "log pattern: unknown format item");
+      }
+      FusedFormat<P, next>::format(out, logger, level, event);
+    }
+  }
+};
+
+}
+
+/*
+ * 编译期展开的日志模式器
+ * 模式串必须是有静态存储期的constexpr字符数组:
+ *   static constexpr char kPattern[] = "%d%T%t%T%m%n";
+ *   appender->setFormatter(std::make_shared<sylar::StaticLogFormatter<kPattern>>());
+ * 模式串写错在编译期报错; 基类仍然解析一遍, getPattern和配置输出不受影响
+ * */
+template <const char* P>
+class StaticLogFormatter : public LogFormatter {
+ public:
+  using ptr = std::shared_ptr<StaticLogFormatter>;
+
+  StaticLogFormatter() : LogFormatter(P) {}
+
+  using LogFormatter::format;
+  void format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override {
+    pattern_detail::FusedFormat<P, 0>::format(out, logger, level, *event);
+  }
+};
+
+}
+
+#endif //SYLAR_SYLAR_LOG_PATTERN_H_
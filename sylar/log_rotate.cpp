@@ -0,0 +1,223 @@
+#include "log_rotate.h"
+#include "log.h"
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+LogRotator::LogRotator() {
+  m_thread.reset(new Thread(std::bind(&LogRotator::run, this), "log_rotate"));
+}
+
+LogRotator::~LogRotator() {
+  // 退出前把已经提交的任务做完
+  m_stop = true;
+  m_semaphore.notify();
+  m_thread->join();
+}
+
+std::string LogRotator::RotatedName(const std::string& filename, time_t now) {
+  tm tmp {};
+  localtime_r(&now, &tmp);
+  char buf[32];
+  strftime(buf, sizeof(buf), ".%Y%m%d-%H%M%S", &tmp);
+  std::string base = filename + buf;
+  std::string name = base;
+  struct stat st {};
+  for (int i = 1; !stat(name.c_str(), &st) || !stat((name + ".gz").c_str(), &st); ++i) {
+    name = base + "." + std::to_string(i);
+  }
+  return name;
+}
+
+time_t LogRotator::NextRotateTime(time_t now, uint32_t interval) {
+  if (!interval) {
+    return 0;
+  }
+  tm tmp {};
+  localtime_r(&now, &tmp);
+  time_t offset = tmp.tm_gmtoff;
+  return ((now + offset) / interval + 1) * interval - offset;
+}
+
+uint64_t LogRotator::ParseSize(const std::string& str) {
+  char* end = nullptr;
+  uint64_t v = strtoull(str.c_str(), &end, 10);
+  if (end == str.c_str()) {
+    return 0;
+  }
+  switch (*end) {
+    case 'k':
+    case 'K':
+      return v << 10;
+    case 'm':
+    case 'M':
+      return v << 20;
+    case 'g':
+    case 'G':
+      return v << 30;
+    case '\0':
+      return v;
+    default:
+      return 0;
+  }
+}
+
+void LogRotator::submit(const std::string& filename, const std::string& rotated, bool compress, uint32_t max_files) {
+  if (!compress && !max_files) {
+    return;
+  }
+  Task task;
+  task.filename = filename;
+  task.rotated = rotated;
+  task.compress = compress;
+  task.maxFiles = max_files;
+  {
+    MutexType::Lock lock(m_mutex);
+    m_tasks.push_back(std::move(task));
+    ++m_submitted;
+  }
+  m_semaphore.notify();
+}
+
+void LogRotator::wait() {
+  Semaphore sem;
+  {
+    MutexType::Lock lock(m_mutex);
+    if (m_finished >= m_submitted) {
+      return;
+    }
+    m_waiters.emplace_back(m_submitted, &sem);
+  }
+  sem.wait();
+}
+
+void LogRotator::run() {
+  while (true) {
+    m_semaphore.wait();
+    while (true) {
+      Task task;
+      {
+        MutexType::Lock lock(m_mutex);
+        if (m_tasks.empty()) {
+          break;
+        }
+        task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+      }
+      if (task.compress) {
+        compress(task.rotated);
+      }
+      if (task.maxFiles) {
+        cleanup(task.filename, task.maxFiles);
+      }
+      // 唤醒等待的任务都已经完成的调用者
+      MutexType::Lock lock(m_mutex);
+      ++m_finished;
+      for (auto it = m_waiters.begin(); it != m_waiters.end();) {
+        if (it->first <= m_finished) {
+          it->second->notify();
+          it = m_waiters.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+    if (m_stop) {
+      break;
+    }
+  }
+}
+
+bool LogRotator::compress(const std::string& path) {
+  FILE* in = fopen(path.c_str(), "rb");
+  if (!in) {
+    if (errno == ENOENT) {
+      // 排队期间已经被保留个数清理掉了
+      return false;
+    }
+    SYLAR_LOG_ERROR(g_logger) << "log rotate: open " << path << " fail, errno=" << errno;
+    return false;
+  }
+  // 先写临时文件, 完成后改名, 不会留下半个.gz
+  std::string tmp = path + ".gz.tmp";
+  gzFile out = gzopen(tmp.c_str(), "wb");
+  if (!out) {
+    SYLAR_LOG_ERROR(g_logger) << "log rotate: gzopen " << tmp << " fail";
+    fclose(in);
+    return false;
+  }
+  bool ok = true;
+  char buf[64 * 1024];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    if (gzwrite(out, buf, n) != (int)n) {
+      ok = false;
+      break;
+    }
+  }
+  fclose(in);
+  if (gzclose(out) != Z_OK) {
+    ok = false;
+  }
+  if (!ok || rename(tmp.c_str(), (path + ".gz").c_str())) {
+    SYLAR_LOG_ERROR(g_logger) << "log rotate: compress " << path << " fail";
+    unlink(tmp.c_str());
+    return false;
+  }
+  unlink(path.c_str());
+  return true;
+}
+
+void LogRotator::cleanup(const std::string& filename, uint32_t max_files) {
+  size_t pos = filename.rfind('/');
+  std::string dir = pos == std::string::npos ? "." : filename.substr(0, pos);
+  std::string prefix = (pos == std::string::npos ? filename : filename.substr(pos + 1)) + ".";
+
+  DIR* d = opendir(dir.c_str());
+  if (!d) {
+    return;
+  }
+  // 只认RotatedName生成的文件: 前缀.年月日-时分秒[.序号][.gz], 按时间和序号排序
+  std::vector<std::tuple<std::string, uint64_t, std::string>> files;
+  while (dirent* e = readdir(d)) {
+    std::string name = e->d_name;
+    if (name.size() < prefix.size() + 15 || name.compare(0, prefix.size(), prefix)
+        || !std::all_of(name.begin() + prefix.size(), name.begin() + prefix.size() + 8, ::isdigit)
+        || name[prefix.size() + 8] != '-') {
+      continue;
+    }
+    if (name.size() > 4 && !name.compare(name.size() - 4, 4, ".tmp")) {
+      continue;
+    }
+    std::string stamp = name.substr(prefix.size(), 15);
+    uint64_t seq = 0;
+    size_t rest = prefix.size() + 15;
+    if (rest < name.size() && name[rest] == '.' && rest + 1 < name.size() && isdigit(name[rest + 1])) {
+      seq = strtoull(name.c_str() + rest + 1, nullptr, 10);
+    }
+    files.emplace_back(stamp, seq, dir + "/" + name);
+  }
+  closedir(d);
+
+  if (files.size() <= max_files) {
+    return;
+  }
+  std::sort(files.begin(), files.end());
+  for (size_t i = 0; i < files.size() - max_files; ++i) {
+    const std::string& path = std::get<2>(files[i]);
+    if (unlink(path.c_str()) && errno != ENOENT) {
+      SYLAR_LOG_ERROR(g_logger) << "log rotate: remove " << path << " fail, errno=" << errno;
+    }
+  }
+}
+
+}
@@ -0,0 +1,73 @@
+#ifndef SYLAR_SYLAR_LOG_ROTATE_H_
+#define SYLAR_SYLAR_LOG_ROTATE_H_
+
+#include <ctime>
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <atomic>
+
+#include "singleton.h"
+#include "thread.h"
+
+namespace sylar {
+
+/*
+ * 日志切分的后台工作线程
+ * 文件的改名和重新打开由FileLogAppender在写日志时完成(只有两次系统调用)
+ * 压缩(gzip)和按个数清理旧文件放在这个线程里做, 不阻塞写日志的线程
+ * */
+class LogRotator {
+ public:
+  using MutexType = Mutex;
+
+  LogRotator();
+  ~LogRotator();
+
+  // 切分后的文件名: 原文件名.年月日-时分秒, 同一秒切分多次时再加.序号
+  static std::string RotatedName(const std::string& filename, time_t now);
+  // now之后的下一个切分时间, 按本地时间对齐到interval的整数倍(整点, 零点)
+  static time_t NextRotateTime(time_t now, uint32_t interval);
+  // 解析大小, 支持K/M/G后缀, 如"100M"; 格式不对返回0
+  static uint64_t ParseSize(const std::string& str);
+
+  /*
+   * 提交切分出来的文件
+   * compress: 压缩成rotated.gz并删除原文件
+   * max_files: filename的切分文件最多保留几个, 多出的按文件名中的时间和序号从旧到新删除, 0表示不清理
+   * */
+  void submit(const std::string& filename, const std::string& rotated, bool compress, uint32_t max_files);
+
+  // 等待已经提交的任务全部完成
+  void wait();
+
+ private:
+  struct Task {
+    std::string filename;
+    std::string rotated;
+    bool compress = false;
+    uint32_t maxFiles = 0;
+  };
+
+  void run();
+  bool compress(const std::string& path);
+  void cleanup(const std::string& filename, uint32_t max_files);
+
+ private:
+  MutexType m_mutex;
+  std::list<Task> m_tasks;
+  Semaphore m_semaphore;
+  uint64_t m_submitted = 0;
+  uint64_t m_finished = 0;
+  // 等待的调用者: 要等到的完成数和唤醒它的信号量
+  std::list<std::pair<uint64_t, Semaphore*>> m_waiters;
+  std::atomic<bool> m_stop {false};
+  Thread::ptr m_thread;
+};
+
+typedef Singleton<LogRotator> LogRotatorMgr;
+
+}
+
+#endif //SYLAR_SYLAR_LOG_ROTATE_H_
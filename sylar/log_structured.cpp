@@ -0,0 +1,204 @@
+#include "log_structured.h"
+
+#include <cstring>
+
+namespace sylar {
+
+static constexpr uint64_t kOnes = 0x0101010101010101ULL;
+static constexpr uint64_t kHighs = 0x8080808080808080ULL;
+
+// 有字节为0时结果非0
+static inline uint64_t HasZero(uint64_t v) {
+  return (v - kOnes) & ~v & kHighs;
+}
+
+static inline uint64_t HasByte(uint64_t v, uint8_t c) {
+  return HasZero(v ^ (kOnes * c));
+}
+
+// 有字节小于0x20(控制字符)时结果非0, 高位为1的字节(UTF-8)不算
+static inline uint64_t HasControl(uint64_t v) {
+  return (v - kOnes * 0x20) & ~v & kHighs;
+}
+
+static inline uint64_t Load8(const char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline bool JsonNeedEscape(char c) {
+  return (unsigned char)c < 0x20 || c == '"' || c == '\\';
+}
+
+static inline bool LogfmtNeedQuote(char c) {
+  return JsonNeedEscape(c) || c == ' ' || c == '=';
+}
+
+static void AppendEscaped(std::string& out, char c) {
+  static const char kHex[] = "0123456789abcdef";
+  switch (c) {
+    case '"':
+      out.append("\\\"", 2);
+      break;
+    case '\\':
+      out.append("\\\\", 2);
+      break;
+    case '\n':
+      out.append("\\n", 2);
+      break;
+    case '\r':
+      out.append("\\r", 2);
+      break;
+    case '\t':
+      out.append("\\t", 2);
+      break;
+    default: {
+      char buf[6] = {'\\', 'u', '0', '0', kHex[(unsigned char)c >> 4], kHex[c & 0xf]};
+      out.append(buf, sizeof(buf));
+      break;
+    }
+  }
+}
+
+void LogEscape::AppendJson(std::string& out, std::string_view s) {
+  const char* p = s.data();
+  size_t n = s.size();
+  // [run, i)是还没有复制的不需要转义的字节
+  size_t run = 0;
+  size_t i = 0;
+  while (i < n) {
+    if (i + 8 <= n) {
+      uint64_t v = Load8(p + i);
+      if (!(HasControl(v) | HasByte(v, '"') | HasByte(v, '\\'))) {
+        i += 8;
+        continue;
+      }
+    }
+    // 这8个字节(或者结尾不足8个)里有要转义的, 逐个处理
+    size_t end = std::min(i + 8, n);
+    for (; i < end; ++i) {
+      if (JsonNeedEscape(p[i])) {
+        out.append(p + run, i - run);
+        AppendEscaped(out, p[i]);
+        run = i + 1;
+      }
+    }
+  }
+  out.append(p + run, n - run);
+}
+
+void LogEscape::AppendLogfmt(std::string& out, std::string_view s) {
+  const char* p = s.data();
+  size_t n = s.size();
+  bool quote = n == 0;
+  size_t i = 0;
+  for (; !quote && i + 8 <= n; i += 8) {
+    uint64_t v = Load8(p + i);
+    quote = HasControl(v) | HasByte(v, '"') | HasByte(v, '\\') | HasByte(v, ' ') | HasByte(v, '=');
+  }
+  for (; !quote && i < n; ++i) {
+    quote = LogfmtNeedQuote(p[i]);
+  }
+  if (!quote) {
+    out.append(p, n);
+    return;
+  }
+  out.push_back('"');
+  AppendJson(out, s);
+  out.push_back('"');
+}
+
+void LogEscape::AppendJsonValue(std::string& out, char type, std::string_view value) {
+  if (type == 's') {
+    out.push_back('"');
+    AppendJson(out, value);
+    out.push_back('"');
+  } else {
+    out.append(value.data(), value.size());
+  }
+}
+
+void LogEscape::AppendLogfmtFields(std::string& out, const LogEvent& event) {
+  size_t pos = 0;
+  LogEvent::Field field;
+  while (event.nextField(pos, field)) {
+    out.push_back(' ');
+    out.append(field.key.data(), field.key.size());
+    out.push_back('=');
+    AppendLogfmt(out, field.value);
+  }
+}
+
+// 两种格式器共用的时间: 本地时间, ISO 8601, 微秒
+static void AppendIsoTime(std::string& out, const LogEvent& event) {
+  static const uint64_t s_id = LogWriter::NextTimeFormatId();
+  LogWriter::AppendTime(out, s_id, "%Y-%m-%dT%H:%M:%S", event.getTime());
+  out.push_back('.');
+  LogWriter::AppendPadded(out, event.getTimeUs() % 1000000, 6);
+}
+
+JsonLogFormatter::JsonLogFormatter()
+    : LogFormatter("json") {
+}
+
+void JsonLogFormatter::format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+  out.append("{\"time\":\"");
+  AppendIsoTime(out, *event);
+  out.append("\",\"level\":\"");
+  out.append(LogLevel::toString(level));
+  out.append("\",\"logger\":\"");
+  LogEscape::AppendJson(out, event->getLogger()->getName());
+  out.append("\",\"file\":\"");
+  LogEscape::AppendJson(out, event->getFile());
+  out.append("\",\"line\":");
+  LogWriter::AppendInt(out, event->getLine());
+  out.append(",\"thread\":");
+  LogWriter::AppendUInt(out, event->getThreadId());
+  out.append(",\"thread_name\":\"");
+  LogEscape::AppendJson(out, event->getThreadName());
+  out.append("\",\"fiber\":");
+  LogWriter::AppendUInt(out, event->getFiberId());
+  out.append(",\"msg\":\"");
+  LogEscape::AppendJson(out, std::string_view(event->getContentData(), event->getContentSize()));
+  out.push_back('"');
+
+  size_t pos = 0;
+  LogEvent::Field field;
+  while (event->nextField(pos, field)) {
+    out.append(",\"");
+    LogEscape::AppendJson(out, field.key);
+    out.append("\":");
+    LogEscape::AppendJsonValue(out, field.type, field.value);
+  }
+  out.append("}\n");
+}
+
+LogfmtLogFormatter::LogfmtLogFormatter()
+    : LogFormatter("logfmt") {
+}
+
+void LogfmtLogFormatter::format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) {
+  out.append("time=");
+  AppendIsoTime(out, *event);
+  out.append(" level=");
+  out.append(LogLevel::toString(level));
+  out.append(" logger=");
+  LogEscape::AppendLogfmt(out, event->getLogger()->getName());
+  out.append(" file=");
+  LogEscape::AppendLogfmt(out, event->getFile());
+  out.append(" line=");
+  LogWriter::AppendInt(out, event->getLine());
+  out.append(" thread=");
+  LogWriter::AppendUInt(out, event->getThreadId());
+  out.append(" thread_name=");
+  LogEscape::AppendLogfmt(out, event->getThreadName());
+  out.append(" fiber=");
+  LogWriter::AppendUInt(out, event->getFiberId());
+  out.append(" msg=");
+  LogEscape::AppendLogfmt(out, std::string_view(event->getContentData(), event->getContentSize()));
+  LogEscape::AppendLogfmtFields(out, *event);
+  out.push_back('\n');
+}
+
+}
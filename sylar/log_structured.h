@@ -0,0 +1,57 @@
+#ifndef SYLAR_SYLAR_LOG_STRUCTURED_H_
+#define SYLAR_SYLAR_LOG_STRUCTURED_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "log.h"
+
+namespace sylar {
+
+// 结构化日志的转义, 一次检查8个字节, 没有要转义的字符时整段复制
+struct LogEscape {
+  // 追加JSON字符串的内容(不含两边的引号), 转义 " \ 和控制字符; 非ASCII字节原样输出
+  static void AppendJson(std::string& out, std::string_view s);
+  // 追加logfmt的值, 含空格, '=', '"', '\'或控制字符以及空串时加引号
+  static void AppendLogfmt(std::string& out, std::string_view s);
+  // 按字段类型追加: JSON中字符串加引号, 数字和布尔原样输出
+  static void AppendJsonValue(std::string& out, char type, std::string_view value);
+  // 追加事件的所有字段, 每个字段前面加一个空格: " key=value"
+  static void AppendLogfmtFields(std::string& out, const LogEvent& event);
+};
+
+/*
+ * 每条日志输出一行JSON:
+ * {"time":"2021-09-25T10:00:00.123456","level":"INFO","logger":"root","file":"a.cpp","line":1,
+ *  "thread":1,"thread_name":"main","fiber":0,"msg":"...", kv()的字段...}
+ * 配置中formatter写json即可使用
+ * */
+class JsonLogFormatter : public LogFormatter {
+ public:
+  using ptr = std::shared_ptr<JsonLogFormatter>;
+
+  JsonLogFormatter();
+
+  using LogFormatter::format;
+  void format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
+};
+
+/*
+ * 每条日志输出一行logfmt:
+ * time=2021-09-25T10:00:00.123456 level=INFO logger=root file=a.cpp line=1 thread=1 thread_name=main fiber=0 msg="..." kv()的字段...
+ * 配置中formatter写logfmt即可使用
+ * */
+class LogfmtLogFormatter : public LogFormatter {
+ public:
+  using ptr = std::shared_ptr<LogfmtLogFormatter>;
+
+  LogfmtLogFormatter();
+
+  using LogFormatter::format;
+  void format(std::string& out, const std::shared_ptr<Logger>& logger, LogLevel::Level level, const LogEvent::ptr& event) override;
+};
+
+}
+
+#endif //SYLAR_SYLAR_LOG_STRUCTURED_H_
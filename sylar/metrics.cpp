@@ -0,0 +1,182 @@
+#include "metrics.h"
+#include "config.h"
+#include "fiber.h"
+#include "log.h"
+#include "util.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static ConfigVar<uint64_t>::ptr g_metrics_dump_interval =
+    Config::Lookup<uint64_t>("metrics.dump_interval_ms", 0,
+                             "log a metrics snapshot this often, 0 means disabled");
+
+static std::atomic<uint64_t> s_dump_interval_ms {0};
+
+struct _MetricsIniter {
+  _MetricsIniter() {
+    s_dump_interval_ms = *g_metrics_dump_interval->getValue();
+    g_metrics_dump_interval->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+        SYLAR_LOG_INFO(g_logger) << "metrics dump interval changed from "
+            << old_value << " to " << new_value;
+        s_dump_interval_ms = new_value;
+        if (new_value) {
+          MetricsMgr::GetInstance()->startDump();
+        }
+      });
+  }
+};
+
+static _MetricsIniter s_metrics_initer;
+
+struct MetricsManager::ThreadCountersHolder {
+  ThreadCounters* counters = nullptr;
+
+  ~ThreadCountersHolder() {
+    if (counters) {
+      MetricsMgr::GetInstance()->retireThread(counters);
+    }
+  }
+};
+
+thread_local MetricsManager::ThreadCountersHolder MetricsManager::t_counters;
+
+const char* MetricsManager::CounterName(Counter c) {
+  switch (c) {
+#define XX(name, str) \
+    case name: \
+      return #str;
+    XX(TASKS_RUN, tasks_run);
+    XX(EPOLL_WAITS, epoll_waits);
+    XX(EPOLL_EVENTS, epoll_events);
+    XX(TICKLES, tickles);
+    XX(TIMERS_EXPIRED, timers_expired);
+#undef XX
+    default:
+      return "unknown";
+  }
+}
+
+std::string MetricsManager::Snapshot::toString() const {
+  std::stringstream ss;
+  ss << "fibers=" << fibers;
+  for (int i = 0; i < COUNTER_COUNT; ++i) {
+    ss << " " << CounterName((Counter)i) << "=" << counters[i];
+  }
+  if (counters[EPOLL_WAITS]) {
+    ss << " events_per_wait=" << std::fixed << std::setprecision(2)
+       << (double)counters[EPOLL_EVENTS] / counters[EPOLL_WAITS];
+  }
+  for (auto& i : schedulers) {
+    ss << std::endl << "    scheduler[" << i.name << "]"
+       << " threads=" << i.threads
+       << " active=" << i.activeThreads
+       << " idle=" << i.idleThreads
+       << " queue=" << i.queueDepth
+       << " rejected=" << i.rejected
+       << " dropped=" << i.dropped
+       << " pending_events=" << i.pendingEvents
+       << " timers=" << i.timers;
+  }
+  return ss.str();
+}
+
+MetricsManager::MetricsManager() {
+}
+
+MetricsManager::~MetricsManager() {
+  m_stop = true;
+  if (m_dumpThread) {
+    m_dumpThread->join();
+  }
+}
+
+void MetricsManager::Add(Counter c, uint64_t n) {
+  ThreadCounters* counters = t_counters.counters;
+  if (!counters) {
+    counters = MetricsMgr::GetInstance()->registerThread();
+    t_counters.counters = counters;
+  }
+  // 只有本线程写, 不需要原子的读改写
+  std::atomic<uint64_t>& v = counters->values[c];
+  v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+MetricsManager::ThreadCounters* MetricsManager::registerThread() {
+  auto counters = new ThreadCounters;
+  MutexType::Lock lock(m_mutex);
+  m_threads.push_back(counters);
+  return counters;
+}
+
+void MetricsManager::retireThread(ThreadCounters* counters) {
+  MutexType::Lock lock(m_mutex);
+  for (int i = 0; i < COUNTER_COUNT; ++i) {
+    m_retired[i] += counters->values[i].load(std::memory_order_relaxed);
+  }
+  m_threads.remove(counters);
+  delete counters;
+}
+
+MetricsManager::Snapshot MetricsManager::snapshot() {
+  Snapshot snap;
+  snap.timeMs = GetCurrentMS();
+  snap.fibers = Fiber::TotalFibers();
+
+  MutexType::Lock lock(m_mutex);
+  for (int i = 0; i < COUNTER_COUNT; ++i) {
+    snap.counters[i] = m_retired[i];
+  }
+  for (auto t : m_threads) {
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+      snap.counters[i] += t->values[i].load(std::memory_order_relaxed);
+    }
+  }
+  for (auto s : m_schedulers) {
+    Scheduler::Stats stats;
+    s->getStats(stats);
+    snap.schedulers.push_back(std::move(stats));
+  }
+  return snap;
+}
+
+void MetricsManager::addScheduler(Scheduler* scheduler) {
+  MutexType::Lock lock(m_mutex);
+  m_schedulers.insert(scheduler);
+  lock.unlock();
+  startDump();
+}
+
+void MetricsManager::delScheduler(Scheduler* scheduler) {
+  MutexType::Lock lock(m_mutex);
+  m_schedulers.erase(scheduler);
+}
+
+void MetricsManager::startDump() {
+  MutexType::Lock lock(m_mutex);
+  if (m_dumpThread || !s_dump_interval_ms) {
+    return;
+  }
+  m_dumpThread.reset(new Thread(std::bind(&MetricsManager::dump, this), "metrics"));
+}
+
+void MetricsManager::dump() {
+  uint64_t last = GetCurrentMS();
+  while (!m_stop) {
+    // 小步睡眠, 进程退出时不用等一个完整的周期
+    usleep(100 * 1000);
+    uint64_t interval = s_dump_interval_ms;
+    uint64_t now = GetCurrentMS();
+    if (!interval || now - last < interval) {
+      continue;
+    }
+    last = now;
+    SYLAR_LOG_INFO(g_logger) << "metrics: " << snapshot().toString();
+  }
+}
+
+}
@@ -0,0 +1,90 @@
+#ifndef SYLAR_SYLAR_METRICS_H_
+#define SYLAR_SYLAR_METRICS_H_
+
+#include <memory>
+#include <list>
+#include <set>
+#include <vector>
+#include <string>
+#include <atomic>
+
+#include "singleton.h"
+#include "thread.h"
+#include "scheduler.h"
+
+namespace sylar {
+
+/*
+ * 运行时指标
+ * 计数器每个线程一份, 只由所属线程写入(relaxed的load + store, 没有锁和原子读改写), 可以在生产环境常开
+ * 快照时汇总所有线程的计数器, 并收集已启动调度器的队列深度, 线程数, 等待事件数, 定时器数等状态
+ * metrics.dump_interval_ms大于0时后台线程定期把快照打到system日志
+ * */
+class MetricsManager {
+ public:
+  using MutexType = Mutex;
+
+  enum Counter {
+    TASKS_RUN = 0, // 调度器执行的任务数(协程的一次切入)
+    EPOLL_WAITS, // epoll_wait调用次数
+    EPOLL_EVENTS, // epoll_wait返回的IO事件数, 不含tickle
+    TICKLES, // 写tickle管道唤醒idle线程的次数
+    TIMERS_EXPIRED, // 到期的定时器回调数
+    COUNTER_COUNT
+  };
+
+  static const char* CounterName(Counter c);
+
+  struct Snapshot {
+    uint64_t timeMs = 0;
+    uint64_t counters[COUNTER_COUNT] = {0};
+    uint64_t fibers = 0; // 存活的协程数
+    std::vector<Scheduler::Stats> schedulers;
+
+    std::string toString() const;
+  };
+
+  MetricsManager();
+  ~MetricsManager();
+
+  // 当前线程的计数器加n
+  static void Add(Counter c, uint64_t n = 1);
+
+  Snapshot snapshot();
+
+  // 调度器start时加入, stop时移除
+  void addScheduler(Scheduler* scheduler);
+  void delScheduler(Scheduler* scheduler);
+
+  // 启动定期输出的线程, metrics.dump_interval_ms为0时什么也不做
+  void startDump();
+
+ private:
+  // 按缓存行对齐, 不同线程的计数器不会伪共享
+  struct alignas(64) ThreadCounters {
+    std::atomic<uint64_t> values[COUNTER_COUNT] = {};
+  };
+  // 线程退出时注销计数器
+  struct ThreadCountersHolder;
+  static thread_local ThreadCountersHolder t_counters;
+
+  ThreadCounters* registerThread();
+  // 线程退出时把计数累加到m_retired
+  void retireThread(ThreadCounters* counters);
+  void dump();
+
+ private:
+  MutexType m_mutex;
+  std::list<ThreadCounters*> m_threads;
+  uint64_t m_retired[COUNTER_COUNT] = {0};
+  std::set<Scheduler*> m_schedulers;
+
+  Thread::ptr m_dumpThread;
+  std::atomic<bool> m_stop {false};
+};
+
+typedef Singleton<MetricsManager> MetricsMgr;
+
+}
+
+#endif //SYLAR_SYLAR_METRICS_H_
@@ -0,0 +1,155 @@
+#ifndef SYLAR_SYLAR_PARALLEL_H_
+#define SYLAR_SYLAR_PARALLEL_H_
+
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include "fiber_sync.h"
+#include "scheduler.h"
+#include "thread.h"
+#include "watchdog.h"
+
+namespace sylar {
+
+// parallel_for的共享状态, 参与者从chunk游标上领取[begin + i * grain, begin + (i + 1) * grain)
+template <typename Index, typename F>
+struct ParallelContext {
+  using MutexType = Mutex;
+
+  ParallelContext(Index b, Index e, Index g, size_t n, F& f)
+      : begin(b), end(e), grain(g), chunks(n), fn(f) {}
+
+  // 领取并执行块, 直到全部被领取
+  void work() {
+    while (true) {
+      size_t i = next++;
+      if (i >= chunks) {
+        return;
+      }
+      if (!failed) {
+        Index b = begin + (Index)(i * grain);
+        Index e = (end - b) > grain ? b + grain : end;
+        try {
+          fn(b, e);
+        } catch (...) {
+          MutexType::Lock lock(mutex);
+          if (!exception) {
+            exception = std::current_exception();
+          }
+          failed = true;
+        }
+      }
+      if (++done == chunks) {
+        MutexType::Lock lock(mutex);
+        if (waiter) {
+          waiter->notify();
+        }
+      }
+      // 块之间是让出点, 长时间的并行计算不会饿死同一线程上的其他协程
+      check_preempt();
+    }
+  }
+
+  // 等待所有块执行完毕
+  void wait() {
+    FiberWaiter::ptr w;
+    {
+      MutexType::Lock lock(mutex);
+      if (done == chunks) {
+        return;
+      }
+      w = std::make_shared<FiberWaiter>();
+      waiter = w;
+    }
+    w->wait();
+  }
+
+  const Index begin;
+  const Index end;
+  const Index grain;
+  const size_t chunks;
+  // 所有块完成前调用者不会返回, 辅助任务在块领取完后不再访问fn, 所以这里保存引用即可
+  F& fn;
+
+  std::atomic<size_t> next {0};
+  std::atomic<size_t> done {0};
+  std::atomic<bool> failed {false};
+  MutexType mutex;
+  std::exception_ptr exception;
+  FiberWaiter::ptr waiter;
+};
+
+/*
+ * 在调度器的工作线程上并行执行fn(b, e), [b, e)是[begin, end)中长度不超过grain的一段
+ * 调用者也参与计算; 块是动态领取的, 先做完的参与者会多领, 负载自动均衡
+ * 在调度协程中等待其他参与者时挂起协程而不阻塞线程
+ * fn抛出的第一个异常在所有块结束后重新抛出, 之后还没开始的块不再执行
+ * scheduler为空时使用当前调度器, 当前也没有调度器时在调用者线程串行执行
+ * */
+template <typename Index, typename F>
+void parallel_for(Index begin, Index end, Index grain, F fn, Scheduler* scheduler = nullptr) {
+  static_assert(std::is_integral<Index>::value, "parallel_for needs an integral index");
+  if (!(begin < end)) {
+    return;
+  }
+  if (grain <= 0) {
+    grain = 1;
+  }
+  size_t chunks = (size_t)((end - begin - 1) / grain) + 1;
+  if (!scheduler) {
+    scheduler = Scheduler::GetThis();
+  }
+
+  auto ctx = std::make_shared<ParallelContext<Index, F>>(begin, end, grain, chunks, fn);
+  if (scheduler && chunks > 1) {
+    size_t helpers = std::min(scheduler->getThreadCount(), chunks - 1);
+    std::vector<std::function<void()>> tasks;
+    tasks.reserve(helpers);
+    for (size_t i = 0; i < helpers; ++i) {
+      tasks.push_back([ctx]() {ctx->work();});
+    }
+    scheduler->schedule(tasks.begin(), tasks.end());
+  }
+  ctx->work();
+  ctx->wait();
+  if (ctx->exception) {
+    std::rethrow_exception(ctx->exception);
+  }
+}
+
+/*
+ * 并行归约: 每一段的结果为map(b, e), 再按区间顺序用reduce合并, 初始值为identity
+ * reduce只需要满足结合律, 结果与串行执行一致
+ * */
+template <typename Index, typename T, typename Map, typename Reduce>
+T parallel_reduce(Index begin, Index end, Index grain, T identity,
+                  Map map, Reduce reduce, Scheduler* scheduler = nullptr) {
+  if (!(begin < end)) {
+    return identity;
+  }
+  if (grain <= 0) {
+    grain = 1;
+  }
+  size_t chunks = (size_t)((end - begin - 1) / grain) + 1;
+  // 每一段单独一个槽位, 不同线程写不同下标不会冲突(std::vector<bool>按位存放, 不能直接用)
+  std::vector<std::optional<T>> partial(chunks);
+  parallel_for(begin, end, grain, [&](Index b, Index e) {
+      partial[(size_t)((b - begin) / grain)].emplace(map(b, e));
+    }, scheduler);
+
+  T result = identity;
+  for (auto& i : partial) {
+    result = reduce(result, *i);
+  }
+  return result;
+}
+
+}
+
+#endif //SYLAR_SYLAR_PARALLEL_H_
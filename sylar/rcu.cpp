@@ -0,0 +1,131 @@
+#include "rcu.h"
+#include "log.h"
+#include "thread.h"
+#include "macro.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace sylar {
+
+// 槽位的状态放在一个原子字里: 低16位是嵌套深度, 高位是进入时的epoch, 深度为0表示不在临界区
+static constexpr uint64_t kDepthBits = 16;
+static constexpr uint64_t kDepthMask = (1ull << kDepthBits) - 1;
+
+// 每个线程独占一个, 按缓存行对齐, 读者之间不共享写
+struct alignas(64) Rcu::Slot {
+  std::atomic<uint64_t> word {0};
+  std::atomic<bool> owned {false};
+};
+
+namespace {
+
+struct Retired {
+  void* ptr;
+  void (*deleter)(void*);
+  uint64_t epoch; // 退休时的epoch, 登记的epoch比它大的读者看不到这个对象
+};
+
+struct RcuRegistry {
+  Mutex mutex;
+  std::vector<Rcu::Slot*> slots;  // 只增不减, 线程退出后槽位给新线程复用
+  std::vector<Retired> retired;
+};
+
+RcuRegistry& GetRegistry() {
+  static RcuRegistry* s_registry = new RcuRegistry;
+  return *s_registry;
+}
+
+std::atomic<uint64_t> s_epoch {1};
+
+struct SlotHolder {
+  Rcu::Slot* slot = nullptr;
+  ~SlotHolder() {
+    if (slot) {
+      slot->owned.store(false, std::memory_order_release);
+    }
+  }
+};
+
+thread_local SlotHolder t_slot;
+
+Rcu::Slot* GetSlot() {
+  Rcu::Slot* slot = t_slot.slot;
+  if (slot) {
+    return slot;
+  }
+  RcuRegistry& reg = GetRegistry();
+  Mutex::Lock lock(reg.mutex);
+  for (auto s : reg.slots) {
+    if (!s->owned.load(std::memory_order_acquire)) {
+      slot = s;
+      break;
+    }
+  }
+  if (!slot) {
+    slot = new Rcu::Slot;
+    reg.slots.push_back(slot);
+  }
+  slot->owned.store(true, std::memory_order_release);
+  t_slot.slot = slot;
+  return slot;
+}
+
+}
+
+Rcu::ReadGuard::ReadGuard()
+	: m_slot(GetSlot()) {
+  // 只有槽位被换了线程的协程同时使用时CAS才会失败, 次数有界
+  uint64_t w = m_slot->word.load(std::memory_order_relaxed);
+  uint64_t nw;
+  do {
+    SYLAR_ASSERT((w & kDepthMask) != kDepthMask);
+    nw = (w & kDepthMask) ? w + 1 : ((s_epoch.load() << kDepthBits) | 1);
+  } while (!m_slot->word.compare_exchange_weak(w, nw));
+}
+
+Rcu::ReadGuard::~ReadGuard() {
+  if (!m_slot) {
+    return;
+  }
+  uint64_t w = m_slot->word.load(std::memory_order_relaxed);
+  uint64_t nw;
+  do {
+    nw = (w & kDepthMask) == 1 ? 0 : w - 1;
+  } while (!m_slot->word.compare_exchange_weak(w, nw));
+}
+
+void Rcu::Retire(void* p, void (*deleter)(void*)) {
+  // 调用方已经换上了新版本, 之后登记的epoch都大于这里取到的值, 那些读者只能读到新版本
+  uint64_t epoch = s_epoch.fetch_add(1);
+  std::vector<Retired> ready;
+  {
+    RcuRegistry& reg = GetRegistry();
+    Mutex::Lock lock(reg.mutex);
+    reg.retired.push_back({p, deleter, epoch});
+    uint64_t min_epoch = UINT64_MAX;
+    for (auto s : reg.slots) {
+      uint64_t w = s->word.load();
+      if (w & kDepthMask) {
+        min_epoch = std::min(min_epoch, w >> kDepthBits);
+      }
+    }
+    auto it = std::partition(reg.retired.begin(), reg.retired.end(),
+                             [min_epoch](const Retired& r) {return r.epoch >= min_epoch;});
+    ready.assign(it, reg.retired.end());
+    reg.retired.erase(it, reg.retired.end());
+  }
+  // 在锁外释放, 析构函数里可能再进入读侧临界区或者退休别的对象
+  for (auto& r : ready) {
+    r.deleter(r.ptr);
+  }
+}
+
+size_t Rcu::GetPendingCount() {
+  RcuRegistry& reg = GetRegistry();
+  Mutex::Lock lock(reg.mutex);
+  return reg.retired.size();
+}
+
+}
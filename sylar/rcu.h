@@ -0,0 +1,46 @@
+#ifndef SYLAR_SYLAR_RCU_H_
+#define SYLAR_SYLAR_RCU_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+
+namespace sylar {
+
+/*
+ * 读多写少数据的延迟回收(基于epoch)
+ * 读者进入临界区时在本线程的槽位上登记当前epoch: 一次原子读和一次对自己缓存行的CAS, 不加锁也不等待
+ * 写者换上新版本后把旧版本交给Retire, 所有在此之前进入的读者都离开后才释放, 写者不会阻塞
+ * 临界区可以嵌套; 跨协程切换(换了线程)也是安全的, 只是会推迟回收, 所以不要长时间持有
+ * */
+class Rcu {
+ public:
+  struct Slot;
+
+  // 读侧临界区, 析构时离开
+  class ReadGuard {
+   public:
+    ReadGuard();
+    ~ReadGuard();
+    ReadGuard(ReadGuard&& other) noexcept : m_slot(other.m_slot) {other.m_slot = nullptr;}
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+    ReadGuard& operator=(ReadGuard&&) = delete;
+   private:
+    Slot* m_slot; // 进入时的槽位, 离开时用同一个, 协程换了线程也不会错
+  };
+
+  // p已经不能被新的读者看到, 等读者都离开后delete
+  template<typename T>
+  static void Retire(const T* p) {
+    Retire(const_cast<T*>(p), [](void* v) {delete static_cast<T*>(v);});
+  }
+  static void Retire(void* p, void (*deleter)(void*));
+
+  // 已经退休还没有释放的对象个数
+  static size_t GetPendingCount();
+};
+
+}
+
+#endif
@@ -6,11 +6,80 @@
 #include "log.h"
 #include "macro.h"
 #include "hook.h"
+#include "config.h"
+#include "watchdog.h"
+#include "metrics.h"
 
 namespace sylar {
 
 static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 
+static ConfigVar<uint32_t>::ptr g_scheduler_starvation_limit =
+    Config::Lookup<uint32_t>("scheduler.starvation_limit", 16,
+                             "times a non-empty lower priority queue can be skipped");
+
+static ConfigVar<uint64_t>::ptr g_scheduler_queue_capacity =
+    Config::Lookup<uint64_t>("scheduler.queue_capacity", 0,
+                             "max pending tasks of a scheduler, 0 means unbounded");
+
+static ConfigVar<std::string>::ptr g_scheduler_overflow_policy =
+    Config::Lookup<std::string>("scheduler.overflow_policy", "block",
+                                "what to do when the queue is full: block, reject or drop_oldest");
+
+static ConfigVar<std::string>::ptr g_scheduler_cpu_affinity =
+    Config::Lookup<std::string>("scheduler.cpu_affinity", "",
+                                "pin worker threads: empty (no pinning), cpu, numa or a cpu list like 0-3,8");
+
+// 队列满时的处理策略
+enum OverflowPolicy {
+  OVERFLOW_BLOCK, // 挂起提交任务的协程直到队列有空位
+  OVERFLOW_REJECT, // 拒绝新任务
+  OVERFLOW_DROP_OLDEST // 丢弃最早的后台任务, 没有可丢弃的任务时拒绝
+};
+
+static OverflowPolicy ParseOverflowPolicy(const std::string& v) {
+  if (v == "reject") {
+    return OVERFLOW_REJECT;
+  } else if (v == "drop_oldest") {
+    return OVERFLOW_DROP_OLDEST;
+  } else if (v != "block") {
+    SYLAR_LOG_ERROR(g_logger) << "unknown scheduler.overflow_policy: " << v << ", use block";
+  }
+  return OVERFLOW_BLOCK;
+}
+
+static std::atomic<uint32_t> s_starvation_limit {16};
+static std::atomic<size_t> s_queue_capacity {0};
+static std::atomic<OverflowPolicy> s_overflow_policy {OVERFLOW_BLOCK};
+
+struct _SchedulerIniter {
+  _SchedulerIniter() {
+    s_starvation_limit.store(*g_scheduler_starvation_limit->getValue(), std::memory_order_relaxed);
+    g_scheduler_starvation_limit->addListener([](const uint32_t& old_value, const uint32_t& new_value) {
+        SYLAR_LOG_INFO(g_logger) << "scheduler starvation limit changed from "
+            << old_value << " to " << new_value;
+        s_starvation_limit.store(new_value, std::memory_order_relaxed);
+      });
+
+    s_queue_capacity.store(*g_scheduler_queue_capacity->getValue(), std::memory_order_relaxed);
+    g_scheduler_queue_capacity->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+        SYLAR_LOG_INFO(g_logger) << "scheduler queue capacity changed from "
+            << old_value << " to " << new_value;
+        s_queue_capacity.store(new_value, std::memory_order_relaxed);
+      });
+
+    s_overflow_policy.store(ParseOverflowPolicy(*g_scheduler_overflow_policy->getValue()),
+                            std::memory_order_relaxed);
+    g_scheduler_overflow_policy->addListener([](const std::string& old_value, const std::string& new_value) {
+        SYLAR_LOG_INFO(g_logger) << "scheduler overflow policy changed from "
+            << old_value << " to " << new_value;
+        s_overflow_policy.store(ParseOverflowPolicy(new_value), std::memory_order_relaxed);
+      });
+  }
+};
+
+static _SchedulerIniter s_scheduler_initer;
+
 static thread_local Scheduler* t_scheduler = nullptr; // 协程调度器指针
 static thread_local Fiber* t_fiber = nullptr; // 标识当前的协程
 
@@ -62,12 +131,15 @@ void sylar::Scheduler::start() {
 
   m_threads.resize(m_threadCount);
   for (size_t i = 0; i < m_threadCount; ++i) {
-    m_threads[i].reset(new Thread(std::bind(&Scheduler::run, this),
-								  m_name + "_" + std::to_string(i)));
+    m_threads[i].reset(new Thread([this, i]() {
+        pinWorker(i);
+        run();
+      }, m_name + "_" + std::to_string(i)));
     m_threadIds.push_back(m_threads[i]->getId());
   }
 
   lock.unlock();
+  MetricsMgr::GetInstance()->addScheduler(this);
 
    // if (m_rootFiber) {
    //   m_rootFiber->call();
@@ -76,6 +148,7 @@ void sylar::Scheduler::start() {
 }
 
 void sylar::Scheduler::stop() {
+  MetricsMgr::GetInstance()->delScheduler(this);
   m_autoStop = true;
   if (m_rootFiber &&
   m_threadCount == 0 &&
@@ -131,8 +204,42 @@ void sylar::Scheduler::stop() {
 }
 
 
+void Scheduler::pinWorker(size_t index) {
+  std::string conf = *g_scheduler_cpu_affinity->getValue();
+  if (conf.empty() || conf == "none") {
+    return;
+  }
+  std::vector<int> cpus;
+  if (conf == "numa") {
+    // 工作线程轮流分到各个节点, 线程可以在节点内的cpu之间迁移
+    auto nodes = GetNumaNodeCpus();
+    if (!nodes.empty()) {
+      cpus = nodes[index % nodes.size()];
+    } else {
+      cpus = GetAvailableCpus();
+    }
+  } else {
+    std::vector<int> list = conf == "cpu" ? GetAvailableCpus() : ParseCpuList(conf);
+    if (list.empty()) {
+      SYLAR_LOG_ERROR(g_logger) << "invalid scheduler.cpu_affinity: " << conf;
+      return;
+    }
+    // 每个工作线程绑定一个cpu, 线程比cpu多时轮流复用
+    cpus.push_back(list[index % list.size()]);
+  }
+  if (cpus.empty() || !Thread::SetAffinity(cpus)) {
+    return;
+  }
+
+  std::stringstream ss;
+  for (size_t i = 0; i < cpus.size(); ++i) {
+    ss << (i ? "," : "") << cpus[i];
+  }
+  SYLAR_LOG_INFO(g_logger) << m_name << " worker " << index << " pinned to cpu " << ss.str();
+}
+
 void Scheduler::run() {
-  SYLAR_LOG_INFO(g_logger) << "enter run function";
+  SYLAR_LOG_DEBUG(g_logger) << "enter run function";
   set_hook_enable(true);
   Fiber::GetThis();
   setThis();
@@ -140,6 +247,8 @@ void Scheduler::run() {
     t_fiber = Fiber::GetThis().get();
   }
 
+  WatchdogMgr::GetInstance()->attach();
+
   Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this))); // idle线程，没有任务时
   Fiber::ptr cb_fiber;
 
@@ -148,51 +257,57 @@ void Scheduler::run() {
     ft.reset();
     bool tickle_me = false;
     bool is_active = false;
+	FiberWaiter::ptr admit_waiter;
+	std::vector<FiberWaiter::ptr> depth_waiters;
 	{
 	  // 从消息队列中取出当前线程可以执行的任务
 	  MutexType::Lock lock(m_mutex);
-	  auto it = m_fibers.begin();
-	  while (it != m_fibers.end()) {
-	    if (it->threadId != -1 && it->threadId != GetThreadId()) {
-	      // 当前协程指定了自己的线程，且不是当前线程，不进行处理
-	      ++it;
-	      tickle_me = true; // 发出信号自己处理不了
-		  continue;
-	    }
-
-		SYLAR_ASSERT(it->fiber || it->cb); // 调度的要么是协程，要么是回调函数
-	    if (it->fiber && it->fiber->getState() == Fiber::EXEC) {
-	      // it协程正在执行(可能被其他线程),不处理
-	      ++it;
-		  continue;
-	    }
-
-	    ft = *it; // 当前任务给ft
-	    m_fibers.erase(it); // 把it任务从消息队列里面删除掉
+	  if (takeTaskNoLock(ft, tickle_me)) {
 		++m_activeThreadCount; // 激活的线程加一
 		is_active = true;
-		break;
+		admit_waiter = popAdmitWaiterNoLock();
+		if (!m_depthWaiters.empty()) {
+		  popDepthWaitersNoLock(depth_waiters);
+		}
 	  }
 	}
+	if (admit_waiter) {
+	  admit_waiter->notify(); // 队列有空位了, 唤醒一个被阻塞的提交者
+	}
+	for (auto& i : depth_waiters) {
+	  i->notify(); // 队列深度降下来了, 唤醒等待的协程(如暂停accept的协程)
+	}
 
 	if (tickle_me) {
 	  tickle(); // 唤醒其他线程,有任务在等待
 	}
 
-	if (ft.fiber && ft.fiber->getState() != Fiber::TERM && ft.fiber->getState() != Fiber::EXCEPT) {
+	if (ft.fiber) {
+	  // 等上一个执行它的线程切换出来
+	  ft.fiber->lockContext();
+	  if (ft.fiber->getState() == Fiber::TERM || ft.fiber->getState() == Fiber::EXCEPT) {
+	    ft.fiber->unlockContext();
+	    ft.reset();
+	  }
+	}
+	if (ft.fiber) {
 	  // 使用协程对象
+	  MetricsManager::Add(MetricsManager::TASKS_RUN);
+	  WatchdogManager::BeginTask(ft.fiber.get());
 	  ft.fiber->swapIn(); // 将其唤醒
+	  WatchdogManager::EndTask();
 	  --m_activeThreadCount; // 激活的线程加一
 
 	  // 这里ft->fiber协程已经退出
 
 	  if (ft.fiber->getState() == Fiber::READY) {
-	    // 可以继续执行，添加进队列
-		schedule(ft.fiber);
+	    // 可以继续执行，按原来的优先级添加进队列
+		scheduleInternal(ft.fiber, ft.priority);
 	  } else if (ft.fiber->getState() != Fiber::TERM && ft.fiber->getState() != Fiber::EXCEPT) {
 	    // 无法继续执行，但又没有退出，进入ＨOLD状态
 	    ft.fiber->setState(Fiber::HOLD);
 	  }
+	  ft.fiber->unlockContext();
 	  ft.reset();
 	} else if (ft.cb) {
 	  // 使用回调函数
@@ -203,18 +318,27 @@ void Scheduler::run() {
 	    // cb_fiber指针以前没有值
 	    cb_fiber.reset(new Fiber(ft.cb));
 	  }
+	  cb_fiber->setCreateSite(ft.site); // 创建位置记为提交任务的地方, 而不是这里
+	  Priority cb_priority = ft.priority;
 	  ft.reset(); // 重置ft
+	  cb_fiber->lockContext();
+	  MetricsManager::Add(MetricsManager::TASKS_RUN);
+	  WatchdogManager::BeginTask(cb_fiber.get());
 	  cb_fiber->swapIn();
+	  WatchdogManager::EndTask();
 	  --m_activeThreadCount;
 
 	  // 执行回来
 	  if (cb_fiber->getState() == Fiber::READY) {
-		schedule(cb_fiber);
+		scheduleInternal(cb_fiber, cb_priority);
+		cb_fiber->unlockContext();
 		cb_fiber.reset();
 	  } else if (cb_fiber->getState() == Fiber::TERM || cb_fiber->getState() == Fiber::EXCEPT) {
 	    cb_fiber->reset(nullptr);
+	    cb_fiber->unlockContext();
 	  } else {
 	    cb_fiber->setState(Fiber::HOLD);
+	    cb_fiber->unlockContext();
 	    cb_fiber.reset();
 	  }
 	} else {
@@ -237,6 +361,167 @@ void Scheduler::run() {
 	  }
 	}
   }
+  WatchdogMgr::GetInstance()->detach();
+}
+
+bool Scheduler::takeTaskNoLock(FiberAndThread& ft, bool& tickle_me) {
+  // 先看被饿着的低优先级队列, 再按优先级从高到低
+  int order[PRIORITY_COUNT * 2];
+  int n = 0;
+  uint32_t limit = s_starvation_limit.load(std::memory_order_relaxed);
+  for (int p = PRIORITY_COUNT - 1; p > HIGH; --p) {
+    if (m_skipped[p] >= limit) {
+      order[n++] = p;
+    }
+  }
+  for (int p = HIGH; p < PRIORITY_COUNT; ++p) {
+    order[n++] = p;
+  }
+
+  for (int k = 0; k < n; ++k) {
+    int p = order[k];
+    auto& tasks = m_fibers[p];
+    auto it = tasks.begin();
+    while (it != tasks.end()) {
+      if (it->threadId != -1 && it->threadId != GetThreadId()) {
+        // 当前协程指定了自己的线程，且不是当前线程，不进行处理
+        ++it;
+        tickle_me = true; // 发出信号自己处理不了
+        continue;
+      }
+
+      SYLAR_ASSERT(it->fiber || it->cb); // 调度的要么是协程，要么是回调函数
+      if (it->fiber && it->fiber->getState() == Fiber::EXEC) {
+        // it协程正在执行(可能被其他线程),不处理
+        ++it;
+        continue;
+      }
+
+      ft = *it; // 当前任务给ft
+      tasks.erase(it); // 把it任务从消息队列里面删除掉
+      --m_queueDepth[p];
+      m_skipped[p] = 0;
+      for (int q = p + 1; q < PRIORITY_COUNT; ++q) {
+        if (!m_fibers[q].empty()) {
+          ++m_skipped[q];
+        }
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+FiberWaiter::ptr Scheduler::popAdmitWaiterNoLock() {
+  if (m_admitWaiters.empty()) {
+    return nullptr;
+  }
+  size_t capacity = s_queue_capacity.load(std::memory_order_relaxed);
+  if (capacity && getQueueDepth() >= capacity) {
+    return nullptr;
+  }
+  auto waiter = m_admitWaiters.front();
+  m_admitWaiters.pop_front();
+  return waiter;
+}
+
+void Scheduler::popDepthWaitersNoLock(std::vector<FiberWaiter::ptr>& waiters) {
+  size_t depth = getQueueDepth();
+  for (auto it = m_depthWaiters.begin(); it != m_depthWaiters.end();) {
+    if (depth <= it->first) {
+      waiters.push_back(std::move(it->second));
+      it = m_depthWaiters.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool Scheduler::waitQueueDepth(size_t depth, const FiberWaiter::ptr& waiter) {
+  MutexType::Lock lock(m_mutex);
+  if (getQueueDepth() <= depth) {
+    return false;
+  }
+  m_depthWaiters.emplace_back(depth, waiter);
+  return true;
+}
+
+bool Scheduler::admitNoLock(MutexType::Lock& lock, bool& need_tickle) {
+  while (true) {
+    size_t capacity = s_queue_capacity.load(std::memory_order_relaxed);
+    if (!capacity || getQueueDepth() < capacity) {
+      return true;
+    }
+    switch (s_overflow_policy.load(std::memory_order_relaxed)) {
+      case OVERFLOW_DROP_OLDEST:
+        if (dropOldestNoLock()) {
+          return true;
+        }
+        // 没有可以丢弃的后台任务, 拒绝
+        [[fallthrough]];
+      case OVERFLOW_REJECT:
+        ++m_rejectedCount;
+        errno = EAGAIN;
+        return false;
+      case OVERFLOW_BLOCK:
+        break;
+    }
+    if (GetThis() == this && !FiberWaiter::CanYield()) {
+      // 调度线程的主协程不能挂起, 挂起会让这个线程停止消费队列
+      return true;
+    }
+    auto waiter = std::make_shared<FiberWaiter>();
+    m_admitWaiters.push_back(waiter);
+    lock.unlock();
+    if (need_tickle) {
+      // 批量提交时已经入队的任务还没有通知调度线程, 不通知就没有线程来腾出空位
+      tickle();
+      need_tickle = false;
+    }
+    waiter->wait();
+    lock.lock();
+  }
+}
+
+bool Scheduler::dropOldestNoLock() {
+  auto& tasks = m_fibers[BACKGROUND];
+  for (auto it = tasks.begin(); it != tasks.end(); ++it) {
+    // 只丢弃还没有开始执行的回调, 被挂起的协程丢掉就再也恢复不了了
+    if (it->cb) {
+      tasks.erase(it);
+      --m_queueDepth[BACKGROUND];
+      ++m_droppedCount;
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t Scheduler::getQueueDepth() const {
+  size_t depth = 0;
+  for (auto& i : m_queueDepth) {
+    depth += i;
+  }
+  return depth;
+}
+
+void Scheduler::getStats(Stats& stats) {
+  stats.name = m_name;
+  stats.threads = getThreadCount();
+  stats.activeThreads = m_activeThreadCount;
+  stats.idleThreads = m_idleThreadCount;
+  stats.queueDepth = getQueueDepth();
+  stats.rejected = m_rejectedCount;
+  stats.dropped = m_droppedCount;
+}
+
+bool Scheduler::hasTasksNoLock() const {
+  for (auto& i : m_fibers) {
+    if (!i.empty()) {
+      return true;
+    }
+  }
+  return false;
 }
 
 void Scheduler::setThis() {
@@ -245,18 +530,18 @@ void Scheduler::setThis() {
 
 bool Scheduler::stopping() {
   MutexType::Lock lock(m_mutex);
-  return m_autoStop && m_stopping && m_fibers.empty() && m_activeThreadCount == 0;
+  return m_autoStop && m_stopping && !hasTasksNoLock() && m_activeThreadCount == 0;
 }
 
 void Scheduler::idle() {
-  SYLAR_LOG_INFO(g_logger) << "idle";
+  SYLAR_LOG_DEBUG(g_logger) << "idle";
   while (!stopping()) {
     Fiber::YieldToHold();
   }
 }
 
 void sylar::Scheduler::tickle() {
-  SYLAR_LOG_INFO(g_logger) << "tickle";
+  SYLAR_LOG_DEBUG(g_logger) << "tickle";
 }
 
 }
@@ -7,9 +7,13 @@
 
 #include <memory>
 #include <list>
+#include <atomic>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "fiber.h"
+#include "fiber_sync.h"
 
 namespace sylar {
 
@@ -18,10 +22,23 @@ class Scheduler {
   using ptr = std::shared_ptr<Scheduler>;
   using MutexType = Mutex;
 
+  /*
+   * 任务优先级, 每个优先级一个队列, 先执行高优先级队列中的任务
+   * 低优先级队列被连续跳过scheduler.starvation_limit次后会先执行一次, 防止饿死
+   * */
+  enum Priority {
+    HIGH = 0, // 延迟敏感的任务, IO事件唤醒的协程默认使用
+    NORMAL = 1, // 默认优先级
+    BACKGROUND = 2, // 后台任务
+    PRIORITY_COUNT = 3
+  };
+
   explicit Scheduler(size_t threads = 1, bool use_caller = true, const std::string& name = "");
   virtual ~Scheduler();
 
   const std::string& getName() const {return m_name;}
+  // 执行任务的线程数(包括use_caller的线程)
+  size_t getThreadCount() const {return m_threadCount + (m_rootThread != -1 ? 1 : 0);}
 
   static Scheduler* GetThis();
   static Fiber* GetMainFiber();
@@ -29,12 +46,54 @@ class Scheduler {
   void start();
   void stop();
 
+  /*
+   * 提交任务, 队列满时按scheduler.overflow_policy处理, 被拒绝时返回false并设置errno为EAGAIN
+   * 协程(Fiber::ptr)是被挂起后恢复执行的, 不受队列容量限制
+   * 不内联, 用返回地址记录提交任务的位置, 协程转储时作为回调协程的创建位置
+   * */
+  template <typename FiberOrCb>
+  __attribute__((noinline)) bool schedule(FiberOrCb fc, int threadId = -1) {
+    return scheduleAt(fc, NORMAL, threadId, __builtin_return_address(0));
+  }
+
+  template <typename FiberOrCb>
+  __attribute__((noinline)) bool schedule(FiberOrCb fc, Priority priority, int threadId = -1) {
+    return scheduleAt(fc, priority, threadId, __builtin_return_address(0));
+  }
+
+  /*
+   * 批量提交, 每个任务单独做容量检查, 超出容量的部分按scheduler.overflow_policy处理
+   * 有任务被拒绝时停止提交后面的任务并返回false, 已经提交的任务保留在队列中
+   * */
+  template <typename InputIterator>
+  __attribute__((noinline)) bool schedule(InputIterator begin, InputIterator end, Priority priority = NORMAL) {
+    void* site = __builtin_return_address(0);
+    bool need_tickle = false;
+    bool admitted = true;
+	{
+	  MutexType::Lock lock(m_mutex);
+	  while (begin != end) {
+	    if (!IsFiber<decltype(*begin)>::value && !admitNoLock(lock, need_tickle)) {
+	      admitted = false;
+	      break;
+	    }
+	    need_tickle = scheduleNoLock(*begin, -1, priority, site) || need_tickle;
+	    ++begin;
+	  }
+	}
+	if (need_tickle) {
+	  tickle();
+	}
+    return admitted;
+  }
+
+  // 调度框架内部产生的任务(IO事件和定时器的回调, 协程恢复), 不受队列容量限制
   template <typename FiberOrCb>
-  void schedule(FiberOrCb fc, int threadId = -1) {
+  void scheduleInternal(FiberOrCb fc, Priority priority = NORMAL, int threadId = -1, void* site = nullptr) {
     bool need_tickle = false;
 	{
 	  MutexType::Lock lock(m_mutex);
-	  need_tickle = scheduleNoLock(fc, threadId);
+	  need_tickle = scheduleNoLock(fc, threadId, priority, site);
 	}
 	if (need_tickle) {
 	  tickle();
@@ -42,12 +101,12 @@ class Scheduler {
   }
 
   template <typename InputIterator>
-  void schedule(InputIterator begin, InputIterator end) {
+  void scheduleInternal(InputIterator begin, InputIterator end, Priority priority = NORMAL, void* site = nullptr) {
     bool need_tickle = false;
 	{
 	  MutexType::Lock lock(m_mutex);
 	  while (begin != end) {
-	    need_tickle = scheduleNoLock(*begin, -1) || need_tickle;
+	    need_tickle = scheduleNoLock(*begin, -1, priority, site) || need_tickle;
 	    ++begin;
 	  }
 	}
@@ -55,6 +114,39 @@ class Scheduler {
 	  tickle();
 	}
   }
+
+  // 某个优先级队列中等待执行的任务数
+  size_t getQueueDepth(Priority priority) const {return m_queueDepth[priority];}
+  // 所有队列中等待执行的任务数
+  size_t getQueueDepth() const;
+  // 正在执行任务的线程数
+  size_t getActiveThreadCount() const {return m_activeThreadCount;}
+  // 在idle中等待任务的线程数
+  size_t getIdleThreadCount() const {return m_idleThreadCount;}
+  // 因为队列满被拒绝的任务数
+  uint64_t getRejectedCount() const {return m_rejectedCount;}
+  /*
+   * 队列中等待执行的任务数超过depth时登记waiter, 调度线程取出任务使它降到depth以下时唤醒
+   * 返回false表示不需要等待, waiter没有登记
+   * */
+  bool waitQueueDepth(size_t depth, const std::shared_ptr<FiberWaiter>& waiter);
+  // 为了给新任务腾位置被丢弃的后台任务数
+  uint64_t getDroppedCount() const {return m_droppedCount;}
+
+  // 调度器状态, 用于指标快照
+  struct Stats {
+    std::string name;
+    size_t threads = 0;
+    size_t activeThreads = 0;
+    size_t idleThreads = 0;
+    size_t queueDepth = 0;
+    uint64_t rejected = 0;
+    uint64_t dropped = 0;
+    size_t pendingEvents = 0; // IOManager中等待触发的IO事件数
+    size_t timers = 0; // IOManager中的定时器数
+  };
+  virtual void getStats(Stats& stats);
+
  protected:
   virtual void tickle();
   void run();
@@ -65,24 +157,68 @@ class Scheduler {
 
   bool hasIdleThreads() {return m_idleThreadCount > 0;}
  private:
+  template <typename T>
+  struct IsFiber {
+    using Type = typename std::decay<T>::type;
+    static constexpr bool value = std::is_same<Type, Fiber::ptr>::value
+        || std::is_same<Type, Fiber::ptr*>::value;
+  };
+
+  /*
+   * 按scheduler.cpu_affinity绑定第index个工作线程, 在线程入口处调用
+   * 之后idle协程, 回调协程的栈等线程私有的内存都在绑定后的线程上第一次访问, 由内核分配在本地NUMA节点
+   * */
+  void pinWorker(size_t index);
+  /*
+   * 队列容量检查, 需要持有m_mutex, 返回true时仍然持有锁, 调用者在同一个临界区内入队; 返回false表示任务被拒绝
+   * 阻塞策略下解锁并挂起提交任务的协程, 挂起前need_tickle为true时先唤醒调度线程, 被唤醒后加锁重新检查
+   * */
+  bool admitNoLock(MutexType::Lock& lock, bool& need_tickle);
+  // 丢弃最早的一个后台回调任务
+  bool dropOldestNoLock();
+
+  template <typename FiberOrCb>
+  bool scheduleAt(FiberOrCb fc, Priority priority, int threadId, void* site) {
+    bool need_tickle = false;
+	{
+	  // 容量检查和入队在同一个临界区内, 并发的提交者不会一起越过容量
+	  MutexType::Lock lock(m_mutex);
+	  if (!IsFiber<FiberOrCb>::value && !admitNoLock(lock, need_tickle)) {
+	    return false;
+	  }
+	  need_tickle = scheduleNoLock(fc, threadId, priority, site);
+	}
+	if (need_tickle) {
+	  tickle();
+	}
+    return true;
+  }
+
   template <typename FiberOrCb>
-  bool scheduleNoLock(FiberOrCb fc, int threadId) {
+  bool scheduleNoLock(FiberOrCb fc, int threadId, Priority priority, void* site) {
     /*
      * need_tickle为true表示以前没有任何的任务，即0　-> 1
      * */
-    bool need_tickle = m_fibers.empty();
+    bool need_tickle = !hasTasksNoLock();
     FiberAndThread ft(fc, threadId);
+    ft.site = site;
+    ft.priority = priority;
     if (ft.fiber || ft.cb) {
-      m_fibers.push_back(ft);
+      m_fibers[priority].push_back(ft);
+      ++m_queueDepth[priority];
     }
     return need_tickle;
   }
 
+  bool hasTasksNoLock() const;
+
  private:
   struct FiberAndThread {
     Fiber::ptr fiber;
     std::function<void()> cb;
     int threadId;
+    void* site = nullptr; // 提交任务的代码地址
+    Priority priority = NORMAL; // 所在的队列, 协程让出后按同样的优先级重新入队
 
     FiberAndThread(Fiber::ptr f, int thr)
       : fiber(std::move(f)), threadId(thr) {}
@@ -105,13 +241,28 @@ class Scheduler {
       fiber = nullptr;
       cb = nullptr;
       threadId = -1;
+      site = nullptr;
+      priority = NORMAL;
     }
   };
 
+  // 按优先级取出一个当前线程可以执行的任务, tickle_me表示有只能由其他线程执行的任务
+  bool takeTaskNoLock(FiberAndThread& ft, bool& tickle_me);
+  // 队列有空位时取出一个等待的提交者, 需要在解锁后唤醒
+  std::shared_ptr<FiberWaiter> popAdmitWaiterNoLock();
+  // 取出队列深度已经降到登记值以下的等待者, 需要在解锁后唤醒
+  void popDepthWaitersNoLock(std::vector<std::shared_ptr<FiberWaiter>>& waiters);
+
  private:
   MutexType m_mutex;
   std::vector<Thread::ptr> m_threads; // 线程池
-  std::list<FiberAndThread> m_fibers; // 任务队列
+  std::list<FiberAndThread> m_fibers[PRIORITY_COUNT]; // 任务队列, 每个优先级一个
+  uint32_t m_skipped[PRIORITY_COUNT] = {0}; // 队列非空却被跳过的次数
+  std::atomic<size_t> m_queueDepth[PRIORITY_COUNT] = {};
+  std::list<std::shared_ptr<FiberWaiter>> m_admitWaiters; // 等待队列有空位的提交者
+  std::list<std::pair<size_t, std::shared_ptr<FiberWaiter>>> m_depthWaiters; // 等待队列深度降下来的协程
+  std::atomic<uint64_t> m_rejectedCount {0};
+  std::atomic<uint64_t> m_droppedCount {0};
   Fiber::ptr m_rootFiber; // 主协程
   std::string m_name;
 
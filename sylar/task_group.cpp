@@ -0,0 +1,195 @@
+#include "task_group.h"
+#include "deadline.h"
+#include "fiber_local.h"
+#include "iomanager.h"
+#include "log.h"
+#include "macro.h"
+
+#include <stdexcept>
+
+namespace sylar {
+
+bool CancellationToken::cancel(int reason) {
+  std::map<uint64_t, std::function<void(int)>> cbs;
+  {
+    MutexType::Lock lock(m_mutex);
+    if (m_reason) {
+      return false;
+    }
+    m_reason = reason;
+    cbs.swap(m_callbacks);
+  }
+  for (auto& i : cbs) {
+    i.second(reason);
+  }
+  return true;
+}
+
+uint64_t CancellationToken::addCallback(std::function<void(int reason)> cb) {
+  MutexType::Lock lock(m_mutex);
+  if (m_reason) {
+    lock.unlock();
+    cb(m_reason);
+    return 0;
+  }
+  uint64_t id = ++m_nextId;
+  m_callbacks.emplace(id, std::move(cb));
+  return id;
+}
+
+bool CancellationToken::delCallback(uint64_t id) {
+  MutexType::Lock lock(m_mutex);
+  return m_callbacks.erase(id) > 0;
+}
+
+static FiberLocal<CancellationToken::ptr>& CurrentTokenLocal() {
+  static FiberLocal<CancellationToken::ptr> s_token;
+  return s_token;
+}
+
+CancellationToken::ptr CancellationToken::GetCurrent() {
+  CancellationToken::ptr* token = CurrentTokenLocal().tryGet();
+  return token ? *token : nullptr;
+}
+
+void CancellationToken::SetCurrent(CancellationToken::ptr token) {
+  CurrentTokenLocal().set(std::move(token));
+}
+
+TaskGroup::TaskGroup(uint64_t timeout_ms, Scheduler* scheduler)
+    : m_scheduler(scheduler ? scheduler : Scheduler::GetThis()),
+      m_ctx(std::make_shared<Context>()) {
+  SYLAR_ASSERT2(m_scheduler, "TaskGroup needs a scheduler");
+  m_ctx->token = std::make_shared<CancellationToken>();
+  std::weak_ptr<CancellationToken> weak(m_ctx->token);
+
+  // 外层任务被取消时一起取消
+  m_parent = CancellationToken::GetCurrent();
+  if (m_parent) {
+    m_parentCbId = m_parent->addCallback([weak](int reason) {
+        auto token = weak.lock();
+        if (token) {
+          token->cancel(reason);
+        }
+      });
+  }
+
+  if (timeout_ms != (uint64_t)-1) {
+    IOManager* iom = dynamic_cast<IOManager*>(m_scheduler);
+    if (!iom) {
+      iom = IOManager::GetThis();
+    }
+    SYLAR_ASSERT2(iom, "TaskGroup deadline needs an IOManager");
+    // 整个任务组只用一个定时器, 到期后以ETIMEDOUT取消
+    m_deadline = iom->addTimer(timeout_ms, [weak]() {
+        auto token = weak.lock();
+        if (token) {
+          token->cancel(ETIMEDOUT);
+        }
+      });
+  }
+}
+
+TaskGroup::~TaskGroup() {
+  bool running = false;
+  {
+    Context::MutexType::Lock lock(m_ctx->mutex);
+    running = m_ctx->running > 0;
+  }
+  if (running) {
+    cancel();
+    waitAll();
+  }
+  if (m_deadline) {
+    m_deadline->cancel();
+  }
+  if (m_parentCbId) {
+    m_parent->delCallback(m_parentCbId);
+  }
+}
+
+void TaskGroup::spawn(std::function<void()> cb) {
+  auto ctx = m_ctx;
+  {
+    Context::MutexType::Lock lock(ctx->mutex);
+    ++ctx->running;
+  }
+  // 子任务继承创建者的截止时间
+  uint64_t deadline = GetDeadline();
+  bool rt = m_scheduler->schedule(std::function<void()>([ctx, cb, deadline]() {
+      // 子任务跑在调度器的回调协程上, 回调结束时协程局部变量会被清理
+      CancellationToken::SetCurrent(ctx->token);
+      SetDeadline(deadline);
+      std::exception_ptr e;
+      if (!ctx->token->isCancelled()) {
+        try {
+          cb();
+        } catch (...) {
+          e = std::current_exception();
+        }
+      }
+      OnChildDone(ctx, e);
+    }));
+  if (!rt) {
+    // 调度器队列满拒绝了任务, 按子任务失败处理
+    OnChildDone(ctx, std::make_exception_ptr(std::runtime_error("scheduler queue is full")));
+  }
+}
+
+void TaskGroup::OnChildDone(const std::shared_ptr<Context>& ctx, std::exception_ptr e) {
+  if (e) {
+    {
+      Context::MutexType::Lock lock(ctx->mutex);
+      if (!ctx->exception) {
+        ctx->exception = e;
+      }
+    }
+    ctx->token->cancel(ECANCELED);
+  }
+
+  std::list<FiberWaiter::ptr> waiters;
+  {
+    Context::MutexType::Lock lock(ctx->mutex);
+    if (--ctx->running == 0) {
+      waiters.swap(ctx->waiters);
+    }
+  }
+  for (auto& i : waiters) {
+    i->notify();
+  }
+}
+
+void TaskGroup::cancel(int reason) {
+  m_ctx->token->cancel(reason);
+}
+
+int TaskGroup::wait() {
+  waitAll();
+  if (m_deadline) {
+    m_deadline->cancel();
+  }
+  std::exception_ptr e;
+  {
+    Context::MutexType::Lock lock(m_ctx->mutex);
+    e = m_ctx->exception;
+  }
+  if (e) {
+    std::rethrow_exception(e);
+  }
+  return m_ctx->token->getReason();
+}
+
+void TaskGroup::waitAll() {
+  FiberWaiter::ptr waiter;
+  {
+    Context::MutexType::Lock lock(m_ctx->mutex);
+    if (!m_ctx->running) {
+      return;
+    }
+    waiter = std::make_shared<FiberWaiter>();
+    m_ctx->waiters.push_back(waiter);
+  }
+  waiter->wait();
+}
+
+}
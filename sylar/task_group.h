@@ -0,0 +1,105 @@
+#ifndef SYLAR_SYLAR_TASK_GROUP_H_
+#define SYLAR_SYLAR_TASK_GROUP_H_
+
+#include <memory>
+#include <functional>
+#include <exception>
+#include <atomic>
+#include <list>
+#include <map>
+#include <cerrno>
+
+#include "fiber_sync.h"
+#include "noncopyable.h"
+#include "thread.h"
+#include "timer.h"
+
+namespace sylar {
+
+class Scheduler;
+
+/*
+ * 取消令牌
+ * 取消时依次执行注册的回调; 运行在带令牌的协程中的hook IO(以及sleep)会被唤醒并返回-1,
+ * errno为取消原因(主动取消为ECANCELED, 超过截止时间为ETIMEDOUT)
+ * */
+class CancellationToken : public std::enable_shared_from_this<CancellationToken>, public NonCopyable {
+ public:
+  using ptr = std::shared_ptr<CancellationToken>;
+  using MutexType = Mutex;
+
+  // 取消, 只有第一次调用生效, 返回本次调用是否生效
+  bool cancel(int reason = ECANCELED);
+  bool isCancelled() const {return m_reason != 0;}
+  // 取消原因, 未取消时为0
+  int getReason() const {return m_reason;}
+
+  // 注册取消时执行的回调, 已经取消则立刻在当前协程执行并返回0
+  uint64_t addCallback(std::function<void(int reason)> cb);
+  // 删除回调, 返回false表示回调已经执行(或正在执行)
+  bool delCallback(uint64_t id);
+
+  // 当前协程关联的令牌, 不在TaskGroup的子任务中时为空
+  static CancellationToken::ptr GetCurrent();
+  static void SetCurrent(CancellationToken::ptr token);
+
+ private:
+  MutexType m_mutex;
+  std::atomic<int> m_reason {0};
+  uint64_t m_nextId = 0;
+  std::map<uint64_t, std::function<void(int)>> m_callbacks;
+};
+
+/*
+ * 结构化并发: 在同一个任务组中启动一批子任务, 等待它们全部结束
+ * 任意子任务抛出异常或者超过截止时间时取消其余子任务
+ * 在带令牌的协程中创建的任务组会随外层令牌一起取消, 子任务继承创建者的DeadlineGuard截止时间
+ * 析构时会取消并等待仍在运行的子任务
+ * */
+class TaskGroup : public NonCopyable {
+ public:
+  using ptr = std::shared_ptr<TaskGroup>;
+
+  /*
+   * scheduler: 子任务运行的调度器, 为空时使用当前调度器
+   * timeout_ms: 整个任务组的截止时间, 需要运行在IOManager中
+   * */
+  explicit TaskGroup(uint64_t timeout_ms = -1, Scheduler* scheduler = nullptr);
+  ~TaskGroup();
+
+  void spawn(std::function<void()> cb);
+  // 取消所有子任务, 不等待
+  void cancel(int reason = ECANCELED);
+  /*
+   * 等待所有子任务结束
+   * 返回0表示正常结束, 否则为取消原因; 子任务抛出的第一个异常在这里重新抛出
+   * */
+  int wait();
+
+  const CancellationToken::ptr& getToken() const {return m_ctx->token;}
+
+ private:
+  struct Context {
+    using MutexType = Mutex;
+    MutexType mutex;
+    size_t running = 0;
+    std::exception_ptr exception;
+    std::list<FiberWaiter::ptr> waiters;
+    CancellationToken::ptr token;
+  };
+
+  void waitAll();
+  // 子任务结束, e为子任务抛出的异常
+  static void OnChildDone(const std::shared_ptr<Context>& ctx, std::exception_ptr e);
+
+ private:
+  Scheduler* m_scheduler;
+  std::shared_ptr<Context> m_ctx;
+  Timer::ptr m_deadline;
+  CancellationToken::ptr m_parent;
+  uint64_t m_parentCbId = 0;
+};
+
+}
+
+#endif //SYLAR_SYLAR_TASK_GROUP_H_
@@ -5,6 +5,8 @@
 #include "thread.h"
 #include "log.h"
 
+#include <cerrno>
+#include <ctime>
 #include <utility>
 
 namespace sylar {
@@ -26,6 +28,23 @@ void Thread::SetName(const std::string& name) {
   t_thread_name = name;
 }
 
+bool Thread::SetAffinity(const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto i : cpus) {
+    if (i >= 0 && i < CPU_SETSIZE) {
+      CPU_SET(i, &set);
+    }
+  }
+  int rt = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (rt) {
+    SYLAR_LOG_ERROR(g_logger) << "pthread_setaffinity_np fail, rt=" << rt
+        << " name=" << t_thread_name;
+    return false;
+  }
+  return true;
+}
+
 Thread* Thread::GetThis() {
   return t_thread;
 }
@@ -90,9 +109,32 @@ Semaphore::~Semaphore() {
 }
 
 void Semaphore::wait() {
-  if (sem_wait(&m_semaphore)) {
-	throw std::logic_error("sem_wait error");
+  // 被信号打断时继续等待
+  while (sem_wait(&m_semaphore)) {
+    if (errno != EINTR) {
+	  throw std::logic_error("sem_wait error");
+    }
+  }
+}
+
+bool Semaphore::waitFor(uint64_t timeout_ms) {
+  timespec ts {};
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += timeout_ms / 1000;
+  ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ++ts.tv_sec;
+    ts.tv_nsec -= 1000000000L;
+  }
+  while (sem_timedwait(&m_semaphore, &ts)) {
+    if (errno == ETIMEDOUT) {
+      return false;
+    }
+    if (errno != EINTR) {
+      throw std::logic_error("sem_timedwait error");
+    }
   }
+  return true;
 }
 
 void Semaphore::notify() {
@@ -27,6 +27,8 @@ class Semaphore : public NonCopyable {
   ~Semaphore() override;
 
   void wait();
+  // 最多等待timeout_ms毫秒, 超时返回false
+  bool waitFor(uint64_t timeout_ms);
   void notify();
 
  private:
@@ -261,6 +263,8 @@ class Thread : public NonCopyable {
   static Thread* GetThis();
   static const std::string& GetName();
   static void SetName(const std::string& name);
+  // 把当前线程绑定到cpus上
+  static bool SetAffinity(const std::vector<int>& cpus);
 
  private:
   static void* run(void*);
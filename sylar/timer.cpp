@@ -233,4 +233,9 @@ bool TimerManager::hasTimer() {
   return !m_timers.empty();
 }
 
+size_t TimerManager::getTimerCount() {
+  RWMutexType::ReadLock read_lock(m_mutex);
+  return m_timers.size();
+}
+
 }
\ No newline at end of file
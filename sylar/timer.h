@@ -59,6 +59,8 @@ class TimerManager {
   void listExpiredCb(std::vector<std::function<void()>>& cbs);
   // 是否有定时器
   bool hasTimer();
+  // 定时器个数
+  size_t getTimerCount();
 
  protected:
   virtual void onTimerInsertedAtFront() = 0;
@@ -7,7 +7,18 @@
 #include "fiber.h"
 
 #include <execinfo.h>
+#include <cxxabi.h>
+#include <dlfcn.h>
 #include <sys/time.h>
+#include <sched.h>
+#include <dirent.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 
 namespace sylar {
 
@@ -62,4 +73,141 @@ uint64_t GetCurrentUS() {
   return tv.tv_sec * 1000000UL + tv.tv_usec;
 }
 
+uint64_t GetMonotonicWallUS() {
+  static const int64_t s_offset = []() {
+    timespec real {}, mono {};
+    clock_gettime(CLOCK_REALTIME, &real);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    return (int64_t)(real.tv_sec - mono.tv_sec) * 1000000 + (real.tv_nsec - mono.tv_nsec) / 1000;
+  }();
+  timespec ts {};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000 + s_offset;
+}
+
+std::string Demangle(const char* name) {
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+  if (status || !demangled) {
+    return name;
+  }
+  std::string rt(demangled);
+  free(demangled);
+  return rt;
+}
+
+std::string SymbolName(void* addr) {
+  Dl_info info;
+  std::stringstream ss;
+  if (!dladdr(addr, &info)) {
+    ss << addr;
+  } else if (info.dli_sname) {
+    ss << Demangle(info.dli_sname);
+  } else {
+    ss << info.dli_fname << "(+0x" << std::hex << ((char*)addr - (char*)info.dli_fbase) << ")";
+  }
+  return ss.str();
+}
+
+std::string CallbackName(const std::type_info* type, void* addr) {
+  if (addr) {
+    return SymbolName(addr);
+  }
+  return type ? Demangle(type->name()) : "unknown";
+}
+
+std::vector<int> ParseCpuList(const std::string& str) {
+  std::vector<int> cpus;
+  size_t pos = 0;
+  while (pos < str.size()) {
+    size_t end = str.find(',', pos);
+    if (end == std::string::npos) {
+      end = str.size();
+    }
+    std::string item = str.substr(pos, end - pos);
+    pos = end + 1;
+    item.erase(0, item.find_first_not_of(" \t\n"));
+    item.erase(item.find_last_not_of(" \t\n") + 1);
+    if (item.empty()) {
+      continue;
+    }
+
+    char* p = nullptr;
+    long first = strtol(item.c_str(), &p, 10);
+    long last = first;
+    if (p == item.c_str() || first < 0) {
+      return {};
+    }
+    if (*p == '-') {
+      const char* q = p + 1;
+      last = strtol(q, &p, 10);
+      if (p == q || last < first) {
+        return {};
+      }
+    }
+    if (*p != '\0') {
+      return {};
+    }
+    for (long i = first; i <= last; ++i) {
+      cpus.push_back((int)i);
+    }
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+std::vector<int> GetAvailableCpus() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set)) {
+    SYLAR_LOG_ERROR(g_logger) << "sched_getaffinity error, errno=" << errno
+        << " errstr=" << strerror(errno);
+    return cpus;
+  }
+  for (int i = 0; i < CPU_SETSIZE; ++i) {
+    if (CPU_ISSET(i, &set)) {
+      cpus.push_back(i);
+    }
+  }
+  return cpus;
+}
+
+std::vector<std::vector<int>> GetNumaNodeCpus() {
+  std::vector<std::vector<int>> nodes;
+  DIR* dir = opendir("/sys/devices/system/node");
+  if (!dir) {
+    return nodes;
+  }
+  std::vector<int> ids;
+  while (dirent* dp = readdir(dir)) {
+    if (strncmp(dp->d_name, "node", 4) == 0 && isdigit(dp->d_name[4])) {
+      ids.push_back(atoi(dp->d_name + 4));
+    }
+  }
+  closedir(dir);
+  std::sort(ids.begin(), ids.end());
+
+  std::vector<int> available = GetAvailableCpus();
+  for (auto id : ids) {
+    std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+    std::string line;
+    if (!std::getline(ifs, line)) {
+      continue;
+    }
+    // 只保留当前进程可以使用的cpu, 没有可用cpu的节点(比如只有内存的节点)跳过
+    std::vector<int> cpus;
+    for (auto cpu : ParseCpuList(line)) {
+      if (std::binary_search(available.begin(), available.end(), cpu)) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (!cpus.empty()) {
+      nodes.push_back(std::move(cpus));
+    }
+  }
+  return nodes;
+}
+
 }
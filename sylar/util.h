@@ -12,6 +12,7 @@
 
 #include <vector>
 #include <string>
+#include <typeinfo>
 
 namespace sylar {
 
@@ -25,6 +26,23 @@ std::string BacktraceToString(int size, int skip = 2, const std::string& prefix
 // 时间ms
 uint64_t GetCurrentMS(); // 获取当前时间以毫秒记
 uint64_t GetCurrentUS(); // 获取当前时间以微秒记
+// 以单调时钟推算的墙上时间(微秒): 第一次调用时记下两个时钟的差值, 之后只读单调时钟
+// 同一进程内单调递增, 不受系统时间跳变影响, 给日志时间戳用
+uint64_t GetMonotonicWallUS();
+
+// C++符号名还原, 失败时返回原样
+std::string Demangle(const char* name);
+// 地址所在的函数名, 没有导出的符号(比如可执行文件中的static函数)时和backtrace一样输出"模块(+偏移)", 可以用addr2line查
+std::string SymbolName(void* addr);
+// 回调的名字: 普通函数指针(addr)用符号名, 其他可调用对象(lambda, bind)用类型名
+std::string CallbackName(const std::type_info* type, void* addr);
+
+// 解析"0-3,8,10-11"形式的cpu列表, 格式错误时返回空
+std::vector<int> ParseCpuList(const std::string& str);
+// 当前进程允许使用的cpu(受taskset/cgroup限制)
+std::vector<int> GetAvailableCpus();
+// 每个NUMA节点上当前进程允许使用的cpu, 读取/sys/devices/system/node, 没有NUMA信息时返回空
+std::vector<std::vector<int>> GetNumaNodeCpus();
 }
 
 #endif //SYLAR_SYLAR_UTIL_H_
\ No newline at end of file
@@ -0,0 +1,421 @@
+#include "watchdog.h"
+#include "config.h"
+#include "fiber.h"
+#include "log.h"
+#include "util.h"
+
+#include <execinfo.h>
+#include <signal.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+
+namespace sylar {
+
+static Logger::ptr g_logger = SYLAR_LOG_NAME("system");
+
+static ConfigVar<bool>::ptr g_watchdog_enable =
+    Config::Lookup<bool>("watchdog.enable", false, "watch for fibers running too long without yielding");
+
+static ConfigVar<uint64_t>::ptr g_watchdog_threshold =
+    Config::Lookup<uint64_t>("watchdog.threshold_ms", 100,
+                             "a task running longer than this is marked for preemption and reported");
+
+static ConfigVar<bool>::ptr g_watchdog_preempt_in_log =
+    Config::Lookup<bool>("watchdog.preempt_in_log", false, "check preemption after each log line");
+
+static ConfigVar<uint64_t>::ptr g_watchdog_slow_task =
+    Config::Lookup<uint64_t>("watchdog.slow_task_ms", 0,
+                             "report tasks running longer than this in one go, 0 means disabled");
+
+static ConfigVar<uint64_t>::ptr g_watchdog_loop_stall =
+    Config::Lookup<uint64_t>("watchdog.loop_stall_ms", 0,
+                             "report event loops not back in epoll_wait within this, 0 means disabled");
+
+static std::atomic<bool> s_enable {false};
+static std::atomic<uint64_t> s_threshold_ms {100};
+static std::atomic<bool> s_preempt_in_log {false};
+static std::atomic<uint64_t> s_slow_task_ms {0};
+static std::atomic<uint64_t> s_loop_stall_ms {0};
+
+// 需要记录任务开始时间
+static bool IsTiming() {
+  return s_enable.load(std::memory_order_relaxed)
+      || s_slow_task_ms.load(std::memory_order_relaxed)
+      || s_loop_stall_ms.load(std::memory_order_relaxed);
+}
+
+// 需要看门狗线程
+static bool IsWatching() {
+  return s_enable || s_slow_task_ms || s_loop_stall_ms;
+}
+
+struct _WatchdogIniter {
+  _WatchdogIniter() {
+    s_enable = *g_watchdog_enable->getValue();
+    g_watchdog_enable->addListener([](const bool& old_value, const bool& new_value) {
+        SYLAR_LOG_INFO(g_logger) << "watchdog enable changed from " << old_value << " to " << new_value;
+        s_enable = new_value;
+        if (new_value) {
+          WatchdogMgr::GetInstance()->start();
+        }
+      });
+
+    s_threshold_ms = *g_watchdog_threshold->getValue();
+    g_watchdog_threshold->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+        SYLAR_LOG_INFO(g_logger) << "watchdog threshold changed from " << old_value << " to " << new_value;
+        s_threshold_ms = new_value;
+      });
+
+    s_preempt_in_log = *g_watchdog_preempt_in_log->getValue();
+    g_watchdog_preempt_in_log->addListener([](const bool& old_value, const bool& new_value) {
+        s_preempt_in_log = new_value;
+      });
+
+    s_slow_task_ms = *g_watchdog_slow_task->getValue();
+    g_watchdog_slow_task->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+        SYLAR_LOG_INFO(g_logger) << "watchdog slow task threshold changed from "
+            << old_value << " to " << new_value;
+        s_slow_task_ms = new_value;
+        if (new_value) {
+          WatchdogMgr::GetInstance()->start();
+        }
+      });
+
+    s_loop_stall_ms = *g_watchdog_loop_stall->getValue();
+    g_watchdog_loop_stall->addListener([](const uint64_t& old_value, const uint64_t& new_value) {
+        SYLAR_LOG_INFO(g_logger) << "watchdog loop stall threshold changed from "
+            << old_value << " to " << new_value;
+        s_loop_stall_ms = new_value;
+        if (new_value) {
+          WatchdogMgr::GetInstance()->start();
+        }
+      });
+  }
+};
+
+static _WatchdogIniter s_watchdog_initer;
+
+static thread_local WatchdogManager::RunSlot* t_slot = nullptr;
+
+// 抓取调用栈用的信号
+static int TraceSignal() {
+  return SIGRTMIN + 2;
+}
+
+static void OnTraceSignal(int) {
+  int saved = errno;
+  WatchdogManager::RunSlot* slot = t_slot;
+  if (slot) {
+    slot->frameCount = backtrace(slot->frames, WatchdogManager::RunSlot::kMaxFrames);
+    slot->traced.store(true, std::memory_order_release);
+  }
+  errno = saved;
+}
+
+void check_preempt() {
+  WatchdogManager::RunSlot* slot = t_slot;
+  if (!slot || !slot->preempt.load(std::memory_order_relaxed)) {
+    return;
+  }
+  slot->preempt.store(false, std::memory_order_relaxed);
+  if (!slot->startUs.load(std::memory_order_relaxed)) {
+    return;
+  }
+  Fiber::YieldToReady();
+}
+
+void check_preempt_in_log() {
+  if (s_preempt_in_log.load(std::memory_order_relaxed)) {
+    check_preempt();
+  }
+}
+
+WatchdogManager::WatchdogManager() {
+  struct sigaction sa {};
+  sa.sa_handler = OnTraceSignal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(TraceSignal(), &sa, nullptr);
+}
+
+WatchdogManager::~WatchdogManager() {
+  m_stop = true;
+  if (m_thread) {
+    m_thread->join();
+  }
+}
+
+void WatchdogManager::attach() {
+  auto slot = std::make_shared<RunSlot>();
+  slot->tid = GetThreadId();
+  slot->thread = pthread_self();
+  // backtrace第一次调用时会加载libgcc, 不能放在信号处理函数里
+  void* dummy[1];
+  backtrace(dummy, 1);
+  t_slot = slot.get();
+
+  MutexType::Lock lock(m_mutex);
+  m_slots.push_back(slot);
+  lock.unlock();
+  start();
+}
+
+void WatchdogManager::detach() {
+  RunSlot* slot = t_slot;
+  if (!slot) {
+    return;
+  }
+  MutexType::Lock lock(m_mutex);
+  t_slot = nullptr;
+  for (auto it = m_slots.begin(); it != m_slots.end(); ++it) {
+    if (it->get() == slot) {
+      m_slots.erase(it);
+      break;
+    }
+  }
+}
+
+void WatchdogManager::BeginTask(Fiber* fiber) {
+  RunSlot* slot = t_slot;
+  if (!slot || !IsTiming()) {
+    return;
+  }
+  const std::function<void()>& cb = fiber->getCallback();
+  auto fn = cb.target<void(*)()>();
+  slot->cbType = cb ? &cb.target_type() : nullptr;
+  slot->cbAddr = fn ? (void*)*fn : nullptr;
+  slot->fiberId.store(fiber->getId(), std::memory_order_relaxed);
+  slot->preempt.store(false, std::memory_order_relaxed);
+  slot->startUs.store(GetCurrentUS(), std::memory_order_relaxed);
+}
+
+void WatchdogManager::EndTask() {
+  RunSlot* slot = t_slot;
+  if (!slot) {
+    return;
+  }
+  uint64_t start_us = slot->startUs.load(std::memory_order_relaxed);
+  if (!start_us) {
+    return;
+  }
+  slot->startUs.store(0, std::memory_order_relaxed);
+
+  uint64_t used_us = GetCurrentUS() - start_us;
+  if (slot->loopWakeUs && used_us > slot->loopMaxUs) {
+    slot->loopMaxUs = used_us;
+    slot->loopMaxFiber = slot->fiberId;
+    slot->loopMaxType = slot->cbType;
+    slot->loopMaxAddr = slot->cbAddr;
+    // 复制一份, 同一个任务是慢任务时reportSlow还要用
+    SpinLock::Lock lock(slot->traceMutex);
+    if (slot->slowTraceStart == start_us) {
+      slot->loopMaxTrace = slot->slowTrace;
+    } else {
+      slot->loopMaxTrace.clear();
+    }
+  }
+  uint64_t slow_ms = s_slow_task_ms.load(std::memory_order_relaxed);
+  if (slow_ms && used_us >= slow_ms * 1000) {
+    WatchdogMgr::GetInstance()->reportSlow(*slot, start_us, used_us);
+  }
+}
+
+void WatchdogManager::LoopWake() {
+  RunSlot* slot = t_slot;
+  if (!slot || !s_loop_stall_ms.load(std::memory_order_relaxed)) {
+    return;
+  }
+  slot->loopWakeUs = GetCurrentUS();
+  slot->loopMaxUs = 0;
+  slot->loopMaxFiber = 0;
+  slot->loopMaxTrace.clear();
+}
+
+void WatchdogManager::LoopEnter() {
+  RunSlot* slot = t_slot;
+  if (!slot || !slot->loopWakeUs) {
+    return;
+  }
+  uint64_t used_us = GetCurrentUS() - slot->loopWakeUs;
+  slot->loopWakeUs = 0;
+  uint64_t stall_ms = s_loop_stall_ms.load(std::memory_order_relaxed);
+  if (!stall_ms || used_us < stall_ms * 1000) {
+    return;
+  }
+  WatchdogMgr::GetInstance()->reportStall(*slot, used_us);
+}
+
+void WatchdogManager::reportStall(RunSlot& slot, uint64_t used_us) {
+  std::string name = slot.loopMaxFiber ? CallbackName(slot.loopMaxType, slot.loopMaxAddr) : "<no task>";
+  {
+    MutexType::Lock lock(m_siteMutex);
+    SlowSite& site = m_stallSites[name];
+    site.name = name;
+    ++site.count;
+    site.totalUs += used_us;
+    site.maxUs = std::max(site.maxUs, used_us);
+  }
+  std::stringstream ss;
+  ss << "event loop on thread " << slot.tid << " stalled for " << used_us / 1000 << "ms";
+  if (slot.loopMaxFiber) {
+    ss << ", slowest task: fiber " << slot.loopMaxFiber << " " << name
+       << " (" << slot.loopMaxUs / 1000 << "ms)";
+    if (!slot.loopMaxTrace.empty()) {
+      ss << ", backtrace:\n" << slot.loopMaxTrace;
+    }
+  }
+  slot.loopMaxTrace.clear();
+  SYLAR_LOG_WARN(g_logger) << ss.str();
+}
+
+void WatchdogManager::reportSlow(RunSlot& slot, uint64_t start_us, uint64_t used_us) {
+  std::string name = CallbackName(slot.cbType, slot.cbAddr);
+  std::string bt;
+  {
+    SpinLock::Lock lock(slot.traceMutex);
+    if (slot.slowTraceStart == start_us) {
+      bt.swap(slot.slowTrace);
+    }
+  }
+  {
+    MutexType::Lock lock(m_siteMutex);
+    SlowSite& site = m_sites[name];
+    site.name = name;
+    ++site.count;
+    site.totalUs += used_us;
+    site.maxUs = std::max(site.maxUs, used_us);
+  }
+  SYLAR_LOG_WARN(g_logger) << "slow task: fiber " << slot.fiberId << " " << name
+      << " ran " << used_us / 1000 << "ms"
+      << (bt.empty() ? "" : ", backtrace:\n") << bt;
+}
+
+// 按总耗时从大到小
+static void SortSites(std::vector<WatchdogManager::SlowSite>& sites) {
+  std::sort(sites.begin(), sites.end(), [](const WatchdogManager::SlowSite& a, const WatchdogManager::SlowSite& b) {
+      return a.totalUs > b.totalUs;
+    });
+}
+
+std::vector<WatchdogManager::SlowSite> WatchdogManager::getSlowSites() {
+  std::vector<SlowSite> sites;
+  {
+    MutexType::Lock lock(m_siteMutex);
+    for (auto& i : m_sites) {
+      sites.push_back(i.second);
+    }
+  }
+  SortSites(sites);
+  return sites;
+}
+
+std::vector<WatchdogManager::SlowSite> WatchdogManager::getStallSites() {
+  std::vector<SlowSite> sites;
+  {
+    MutexType::Lock lock(m_siteMutex);
+    for (auto& i : m_stallSites) {
+      sites.push_back(i.second);
+    }
+  }
+  SortSites(sites);
+  return sites;
+}
+
+void WatchdogManager::start() {
+  MutexType::Lock lock(m_mutex);
+  if (m_thread || !IsWatching()) {
+    return;
+  }
+  m_thread.reset(new Thread(std::bind(&WatchdogManager::watch, this), "watchdog"));
+}
+
+void WatchdogManager::watch() {
+  while (!m_stop) {
+    uint64_t threshold_ms = s_enable ? (uint64_t)s_threshold_ms : 0;
+    uint64_t slow_ms = s_slow_task_ms;
+    uint64_t stall_ms = s_loop_stall_ms;
+    // 慢任务和可能造成卡顿的任务都在运行中抓取调用栈
+    uint64_t sample_ms = slow_ms && stall_ms ? std::min(slow_ms, stall_ms) : std::max(slow_ms, stall_ms);
+    uint64_t shortest = threshold_ms && sample_ms ? std::min(threshold_ms, sample_ms)
+                                                  : std::max(threshold_ms, sample_ms);
+    // 检查间隔取阈值的一半, 超时的任务最迟在1.5倍阈值时被发现
+    uint64_t interval_ms = std::max<uint64_t>(1, std::min<uint64_t>(shortest / 2, 100));
+    usleep(interval_ms * 1000);
+    if (!threshold_ms && !sample_ms) {
+      continue;
+    }
+
+    uint64_t now_us = GetCurrentUS();
+    MutexType::Lock lock(m_mutex);
+    for (auto& i : m_slots) {
+      check(*i, now_us, threshold_ms * 1000, sample_ms * 1000);
+    }
+  }
+}
+
+void WatchdogManager::check(RunSlot& slot, uint64_t now_us, uint64_t threshold_us, uint64_t sample_us) {
+  uint64_t start_us = slot.startUs.load(std::memory_order_relaxed);
+  if (!start_us) {
+    return;
+  }
+
+  // 慢任务在运行中抓取调用栈, 任务结束时或者事件循环卡顿时和耗时一起报告
+  if (sample_us && now_us >= start_us + sample_us && slot.sampled != start_us) {
+    slot.sampled = start_us;
+    std::string bt = traceSlot(slot);
+    SpinLock::Lock lock(slot.traceMutex);
+    slot.slowTraceStart = start_us;
+    slot.slowTrace.swap(bt);
+  }
+
+  if (!threshold_us || now_us < start_us + threshold_us) {
+    return;
+  }
+  if (slot.flagged != start_us) {
+    // 先设置抢占标记, 下一个让出点会检查它
+    slot.flagged = start_us;
+    slot.preempt.store(true, std::memory_order_relaxed);
+    return;
+  }
+  // 标记后又过了一个检查周期还在运行, 说明没有经过让出点, 报告一次
+  if (slot.reported == start_us) {
+    return;
+  }
+  slot.reported = start_us;
+
+  std::string bt = traceSlot(slot);
+  SYLAR_LOG_WARN(g_logger) << "fiber " << slot.fiberId << " on thread " << slot.tid
+      << " has been running for " << (now_us - start_us) / 1000 << "ms without yielding"
+      << (bt.empty() ? "" : ", backtrace:\n") << bt;
+}
+
+std::string WatchdogManager::traceSlot(RunSlot& slot) {
+  // 调用者持有m_mutex, 槽位所在的线程不会在此期间退出
+  slot.traced = false;
+  if (pthread_kill(slot.thread, TraceSignal())) {
+    return "";
+  }
+  for (int i = 0; i < 100 && !slot.traced.load(std::memory_order_acquire); ++i) {
+    usleep(1000);
+  }
+  if (!slot.traced) {
+    return "";
+  }
+
+  int n = slot.frameCount;
+  char** strings = backtrace_symbols(slot.frames, n);
+  if (!strings) {
+    return "";
+  }
+  std::stringstream ss;
+  // 跳过信号处理函数和信号跳板
+  for (int i = 2; i < n; ++i) {
+    ss << "    " << strings[i] << std::endl;
+  }
+  free(strings);
+  return ss.str();
+}
+
+}
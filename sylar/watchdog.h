@@ -0,0 +1,135 @@
+#ifndef SYLAR_SYLAR_WATCHDOG_H_
+#define SYLAR_SYLAR_WATCHDOG_H_
+
+#include <memory>
+#include <list>
+#include <map>
+#include <vector>
+#include <string>
+#include <atomic>
+#include <typeinfo>
+
+#include "singleton.h"
+#include "thread.h"
+
+namespace sylar {
+
+/*
+ * 检查当前协程是否被看门狗标记为运行太久, 是则让出执行权(YieldToReady)
+ * 协程只在hook调用和主动yield时切换, 计算密集的循环中需要定期调用, 开销是一次线程局部变量的读取
+ * 不在调度器的任务中或者没有被标记时直接返回
+ * */
+void check_preempt();
+
+// 日志中的让出点, 只在watchdog.preempt_in_log开启时检查(持有锁时打日志会让出, 默认关闭)
+void check_preempt_in_log();
+
+/*
+ * 看门狗
+ * 每个调度线程一个运行槽位, 记录当前任务开始执行的时间
+ * 后台线程定期检查, 任务连续运行超过watchdog.threshold_ms时设置抢占标记,
+ * 再过一个检查周期仍没有让出的, 向该线程发送信号抓取调用栈, 打印出运行过久的协程
+ * watchdog.enable默认关闭
+ *
+ * 同一套槽位也用于慢任务和事件循环卡顿检测:
+ * 单次执行超过watchdog.slow_task_ms的任务在结束时报告协程id, 回调名和运行中抓取的调用栈, 并按回调统计
+ * IO线程从epoll_wait返回到回到事件循环超过watchdog.loop_stall_ms时报告卡顿, 以及期间最慢的任务的协程id, 回调名和调用栈,
+ * 并按最慢任务的回调统计卡顿
+ * 运行超过slow_task_ms或loop_stall_ms(取开启的较小者)的任务在运行中抓取一次调用栈
+ * */
+class Fiber;
+
+class WatchdogManager {
+ public:
+  using MutexType = Mutex;
+
+  // 线程的运行槽位, 只由所属线程和看门狗线程访问
+  struct RunSlot {
+    static constexpr int kMaxFrames = 64;
+
+    pid_t tid = 0;
+    pthread_t thread = 0;
+    std::atomic<uint64_t> startUs {0}; // 当前任务开始执行的时间, 0表示没有在执行任务
+    std::atomic<uint64_t> fiberId {0};
+    std::atomic<bool> preempt {false};
+    uint64_t flagged = 0; // 已经设置过抢占标记的任务的startUs
+    uint64_t reported = 0; // 已经报告过的任务的startUs, 每个任务只报告一次
+
+    // 信号处理函数抓取的调用栈
+    void* frames[kMaxFrames];
+    std::atomic<int> frameCount {0};
+    std::atomic<bool> traced {false};
+
+    // 当前任务的回调, 出现慢任务时才解析成名字
+    const std::type_info* cbType = nullptr;
+    void* cbAddr = nullptr;
+    // 慢任务(或可能造成卡顿的任务)运行中抓取的调用栈, 由看门狗线程写入
+    SpinLock traceMutex;
+    uint64_t slowTraceStart = 0;
+    std::string slowTrace;
+    uint64_t sampled = 0;
+
+    // 事件循环: 上一次epoll_wait返回的时间和之后最慢的任务
+    uint64_t loopWakeUs = 0;
+    uint64_t loopMaxUs = 0;
+    uint64_t loopMaxFiber = 0;
+    const std::type_info* loopMaxType = nullptr;
+    void* loopMaxAddr = nullptr;
+    std::string loopMaxTrace;
+  };
+
+  // 按回调统计的慢任务(事件循环卡顿按期间最慢任务的回调统计, 耗时是卡顿的时长)
+  struct SlowSite {
+    std::string name;
+    uint64_t count = 0;
+    uint64_t totalUs = 0;
+    uint64_t maxUs = 0;
+  };
+
+  WatchdogManager();
+  ~WatchdogManager();
+
+  // 调度线程开始/结束时调用
+  void attach();
+  void detach();
+
+  // 调度线程开始/结束执行一个任务时调用
+  static void BeginTask(Fiber* fiber);
+  static void EndTask();
+
+  // IOManager在epoll_wait返回后和再次进入前调用
+  static void LoopWake();
+  static void LoopEnter();
+
+  // 慢任务统计, 按总耗时从大到小
+  std::vector<SlowSite> getSlowSites();
+  // 事件循环卡顿统计, 按总耗时从大到小
+  std::vector<SlowSite> getStallSites();
+
+  // 启动看门狗线程, 调度线程attach或者watchdog.enable打开时调用, 未开启时什么也不做
+  void start();
+
+ private:
+  void watch();
+  // sample_us: 任务运行超过它时抓取一次调用栈, 0表示不抓取
+  void check(RunSlot& slot, uint64_t now_us, uint64_t threshold_us, uint64_t sample_us);
+  // 向运行槽位所在的线程发信号抓取调用栈
+  std::string traceSlot(RunSlot& slot);
+  void reportSlow(RunSlot& slot, uint64_t start_us, uint64_t used_us);
+  void reportStall(RunSlot& slot, uint64_t used_us);
+
+ private:
+  MutexType m_mutex;
+  std::list<std::shared_ptr<RunSlot>> m_slots;
+  MutexType m_siteMutex;
+  std::map<std::string, SlowSite> m_sites;
+  std::map<std::string, SlowSite> m_stallSites;
+  Thread::ptr m_thread;
+  std::atomic<bool> m_stop {false};
+};
+
+typedef Singleton<WatchdogManager> WatchdogMgr;
+
+}
+
+#endif //SYLAR_SYLAR_WATCHDOG_H_
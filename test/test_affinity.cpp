@@ -0,0 +1,85 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+#include "../sylar/fd_manager.h"
+
+#include <sys/socket.h>
+#include <atomic>
+#include <cstring>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const int kPairs = 64;
+static const int kRounds = 2000;
+static const size_t kWorkingSet = 64 * 1024;
+
+static std::atomic<uint64_t> s_bytes {0};
+
+/*
+ * 一对socket来回收发, 每轮都扫一遍协程自己的工作内存
+ * 不绑定时协程和它的内存会在不同节点的cpu之间来回迁移, 跨节点访问会拉低吞吐
+ * */
+static void ping_pong(int fd, bool first) {
+  std::vector<char> buf(kWorkingSet);
+  char msg = 0;
+  for (int i = 0; i < kRounds; ++i) {
+    if (first || i) {
+      send(fd, &msg, 1, 0);
+    }
+    if (recv(fd, &msg, 1, 0) != 1) {
+      break;
+    }
+    memset(&buf[0], i, buf.size());
+    s_bytes += buf.size();
+  }
+  if (!first) {
+    send(fd, &msg, 1, 0);
+  }
+  close(fd);
+}
+
+static void run_bench(size_t threads, const std::string& affinity) {
+  sylar::Config::Lookup<std::string>("scheduler.cpu_affinity")->setValue(affinity);
+  s_bytes = 0;
+  uint64_t begin = sylar::GetCurrentUS();
+  {
+    sylar::IOManager iom(threads, false, "bench");
+    iom.schedule([&iom]() {
+      for (int i = 0; i < kPairs; ++i) {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        sylar::FdMgr::GetInstance()->get(fds[0], true);
+        sylar::FdMgr::GetInstance()->get(fds[1], true);
+        iom.schedule(std::bind(ping_pong, fds[0], true));
+        iom.schedule(std::bind(ping_pong, fds[1], false));
+      }
+    });
+  }
+  uint64_t used = sylar::GetCurrentUS() - begin;
+  SYLAR_LOG_INFO(g_logger) << "threads=" << threads
+      << " affinity=" << (affinity.empty() ? "none" : affinity)
+      << " used=" << used / 1000 << "ms"
+      << " throughput=" << s_bytes * 1.0 / used << "MB/s";
+}
+
+// 用法: test_affinity [线程数] [绑定方式...], 例如 test_affinity 16 "" cpu numa
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+
+  size_t threads = argc > 1 ? atoi(argv[1]) : 4;
+  std::vector<std::string> modes;
+  for (int i = 2; i < argc; ++i) {
+    modes.emplace_back(argv[i]);
+  }
+  if (modes.empty()) {
+    modes = {"", "cpu", "numa"};
+  }
+
+  auto nodes = sylar::GetNumaNodeCpus();
+  SYLAR_LOG_INFO(g_logger) << "available cpus=" << sylar::GetAvailableCpus().size()
+      << " numa nodes=" << nodes.size();
+  for (auto& i : modes) {
+    run_bench(threads, i);
+  }
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include "../sylar/sylar.h"
+#include "../sylar/log.h"
+
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const char* kFile = "/tmp/sylar_test_async_log.txt";
+
+static size_t count_lines(const std::string& file, const std::string& needle) {
+  std::ifstream in(file);
+  std::string line;
+  size_t n = 0;
+  while (std::getline(in, line)) {
+    if (line.find(needle) != std::string::npos) {
+      ++n;
+    }
+  }
+  return n;
+}
+
+// 多个线程写同一个异步appender, BLOCK策略下不能丢日志
+void test_block() {
+  auto logger = SYLAR_LOG_NAME("async");
+  logger->clearAppender();
+  auto appender = std::make_shared<sylar::AsyncLogAppender>(kFile, 64, sylar::AsyncLogAppender::BLOCK);
+  appender->setFormatter(std::make_shared<sylar::LogFormatter>("%t%T%m%n"));
+  logger->addAppender(appender);
+
+  const int kThreads = 4;
+  const int kLines = 20000;
+  std::vector<sylar::Thread::ptr> threads;
+  uint64_t start = sylar::GetCurrentUS();
+  for (int i = 0; i < kThreads; ++i) {
+    threads.push_back(std::make_shared<sylar::Thread>([logger]() {
+        for (int j = 0; j < kLines; ++j) {
+          SYLAR_LOG_INFO(logger) << "block line " << j;
+        }
+      }, "writer_" + std::to_string(i)));
+  }
+  // 写日志时不持有Logger的锁, 生产者阻塞时也能修改appender集合
+  std::atomic<bool> done {false};
+  std::atomic<uint64_t> changes {0};
+  auto changer = std::make_shared<sylar::Thread>([logger, &done, &changes]() {
+      while (!done) {
+        auto extra = std::make_shared<sylar::FileLogAppender>("/dev/null");
+        logger->addAppender(extra);
+        logger->deleteAppender(extra);
+        ++changes;
+      }
+    }, "changer");
+  for (auto& t : threads) {
+    t->join();
+  }
+  uint64_t used = sylar::GetCurrentUS() - start;
+  done = true;
+  changer->join();
+  appender->flush();
+  SYLAR_LOG_INFO(g_logger) << "block: lines=" << count_lines(kFile, "block line")
+      << " expect=" << kThreads * kLines << " dropped=" << appender->getDropped()
+      << " used=" << used << "us appender_changes=" << changes;
+  logger->clearAppender();
+}
+
+// COUNT策略下缓冲满时丢弃, 文件中记录丢弃条数
+void test_count() {
+  auto logger = SYLAR_LOG_NAME("async");
+  // 同一个文件上新建appender是追加, 不会清掉test_block写的内容
+  size_t kept = count_lines(kFile, "block line");
+  auto appender = std::make_shared<sylar::AsyncLogAppender>(kFile, 16, sylar::AsyncLogAppender::COUNT);
+  appender->setFormatter(std::make_shared<sylar::LogFormatter>("%m%n"));
+  logger->addAppender(appender);
+  for (int i = 0; i < 10000; ++i) {
+    SYLAR_LOG_INFO(logger) << "count line " << i;
+  }
+  // FATAL同步刷新
+  SYLAR_LOG_FATAL(logger) << "count fatal";
+  SYLAR_LOG_INFO(g_logger) << "count: written=" << count_lines(kFile, "count line")
+      << " dropped=" << appender->getDropped()
+      << " fatal=" << count_lines(kFile, "count fatal")
+      << " report=" << count_lines(kFile, "dropped")
+      << " block_kept=" << (count_lines(kFile, "block line") == kept);
+  logger->clearAppender();
+}
+
+// 反复重建appender(配置重载), 线程里已经析构的appender的缓冲要被回收
+void test_recreate() {
+  auto logger = SYLAR_LOG_NAME("async_recreate");
+  for (int i = 0; i < 200; ++i) {
+    auto appender = std::make_shared<sylar::AsyncLogAppender>("/dev/null", 8192);
+    logger->addAppender(appender);
+    SYLAR_LOG_INFO(logger) << "recreate " << i;
+    logger->clearAppender();
+  }
+  SYLAR_LOG_INFO(g_logger) << "recreate: appenders=200";
+}
+
+// 通过日志配置创建
+void test_yaml() {
+  YAML::Node root = YAML::Load(
+      "logs:\n"
+      "  - name: async_yaml\n"
+      "    level: info\n"
+      "    appenders:\n"
+      "      - type: AsyncLogAppender\n"
+      "        file: /tmp/sylar_test_async_log_yaml.txt\n"
+      "        capacity: 1024\n"
+      "        overflow: drop\n");
+  sylar::Config::LoadFromYAML(root);
+  auto logger = SYLAR_LOG_NAME("async_yaml");
+  SYLAR_LOG_INFO(logger) << "from yaml";
+  SYLAR_LOG_INFO(g_logger) << std::endl << logger->toYamlString();
+}
+
+int main(int argc, char* argv[]) {
+  std::remove(kFile);
+  test_block();
+  test_count();
+  test_recreate();
+  test_yaml();
+  return 0;
+}
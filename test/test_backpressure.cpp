@@ -0,0 +1,120 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static void set_queue(uint64_t capacity, const std::string& policy) {
+  sylar::Config::Lookup<uint64_t>("scheduler.queue_capacity")->setValue(capacity);
+  sylar::Config::Lookup<std::string>("scheduler.overflow_policy")->setValue(policy);
+}
+
+// 单线程调度器, 提交任务的协程不让出时队列里的任务都执行不了
+void submit_burst(sylar::IOManager* iom, const std::string& name, sylar::Scheduler::Priority priority) {
+  int accepted = 0;
+  for (int i = 0; i < 20; ++i) {
+    if (iom->schedule([]() {}, priority)) {
+      ++accepted;
+    }
+  }
+  SYLAR_LOG_INFO(g_logger) << name << " accepted=" << accepted
+      << " depth=" << iom->getQueueDepth()
+      << " rejected=" << iom->getRejectedCount()
+      << " dropped=" << iom->getDroppedCount();
+}
+
+void test_reject() {
+  set_queue(8, "reject");
+  sylar::IOManager iom(1, false, "reject");
+  iom.schedule(std::bind(submit_burst, &iom, "reject", sylar::Scheduler::NORMAL));
+}
+
+void test_drop_oldest() {
+  set_queue(8, "drop_oldest");
+  sylar::IOManager iom(1, false, "drop");
+  iom.schedule(std::bind(submit_burst, &iom, "drop_oldest", sylar::Scheduler::BACKGROUND));
+}
+
+void test_block() {
+  set_queue(8, "block");
+  sylar::IOManager iom(1, false, "block");
+  iom.schedule([&iom]() {
+    uint64_t begin = sylar::GetCurrentMS();
+    for (int i = 0; i < 20; ++i) {
+      // 队列满时挂起当前协程, 等调度线程执行掉一部分任务后继续
+      iom.schedule([]() {
+          uint64_t end = sylar::GetCurrentMS() + 2;
+          while (sylar::GetCurrentMS() < end);
+        });
+    }
+    SYLAR_LOG_INFO(g_logger) << "block submitted 20 tasks, used="
+        << sylar::GetCurrentMS() - begin << "ms depth=" << iom.getQueueDepth();
+  });
+}
+
+// 批量提交也按单个任务检查容量, 超出的部分按策略拒绝
+void test_batch() {
+  set_queue(8, "reject");
+  sylar::IOManager iom(1, false, "batch");
+  iom.schedule([&iom]() {
+    std::vector<std::function<void()>> tasks(1000, []() {});
+    bool ok = iom.schedule(tasks.begin(), tasks.end());
+    SYLAR_LOG_INFO(g_logger) << "batch ok=" << ok << " depth=" << iom.getQueueDepth()
+        << " rejected=" << iom.getRejectedCount();
+  });
+}
+
+// 多个线程同时提交, 检查和入队在同一个临界区, 队列不会超过容量
+void test_concurrent() {
+  set_queue(8, "reject");
+  sylar::IOManager iom(1, false, "concurrent");
+  std::atomic<size_t> max_depth {0};
+  // 调度线程被占住, 队列只进不出
+  sylar::Semaphore sem;
+  iom.schedule([&sem]() {sem.wait();});
+  std::vector<sylar::Thread::ptr> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.push_back(std::make_shared<sylar::Thread>([&iom, &max_depth]() {
+        for (int i = 0; i < 1000; ++i) {
+          iom.schedule([]() {});
+          size_t depth = iom.getQueueDepth();
+          size_t old = max_depth;
+          while (depth > old && !max_depth.compare_exchange_weak(old, depth));
+        }
+      }, "producer_" + std::to_string(t)));
+  }
+  for (auto& t : threads) {
+    t->join();
+  }
+  SYLAR_LOG_INFO(g_logger) << "concurrent max_depth=" << max_depth << " capacity=8"
+      << " rejected=" << iom.getRejectedCount();
+  sem.notify();
+}
+
+// 暂停accept用的等待: 队列降到指定深度时被调度线程唤醒, 不轮询
+void test_depth_waiter() {
+  set_queue(0, "block");
+  sylar::IOManager iom(1, false, "depth");
+  iom.schedule([&iom]() {
+    for (int i = 0; i < 5; ++i) {
+      iom.schedule([]() {});
+    }
+    auto waiter = std::make_shared<sylar::FiberWaiter>();
+    bool waited = iom.waitQueueDepth(1, waiter);
+    if (waited) {
+      waiter->wait();
+    }
+    SYLAR_LOG_INFO(g_logger) << "depth waiter waited=" << waited << " depth=" << iom.getQueueDepth();
+  });
+}
+
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+  test_reject();
+  test_drop_oldest();
+  test_block();
+  test_batch();
+  test_concurrent();
+  test_depth_waiter();
+  return 0;
+}
@@ -0,0 +1,153 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+#include "../sylar/channel.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+void test_channel() {
+  sylar::IOManager iom(2, false, "chan");
+  auto chan = std::make_shared<sylar::Channel<int>>(4);
+
+  iom.schedule([chan]() {
+    for (int i = 0; i < 20; ++i) {
+      chan->send(i);
+    }
+    chan->close();
+    SYLAR_LOG_INFO(g_logger) << "producer done";
+  });
+
+  iom.schedule([chan]() {
+    int v = 0;
+    int sum = 0;
+    while (chan->recv(v)) {
+      sum += v;
+    }
+    SYLAR_LOG_INFO(g_logger) << "consumer done sum=" << sum;
+  });
+
+  iom.schedule([]() {
+    sylar::Channel<int> empty;
+    int v = 0;
+    uint64_t begin = sylar::GetCurrentMS();
+    bool rt = empty.recv(v, 100);
+    SYLAR_LOG_INFO(g_logger) << "recv timeout rt=" << rt
+        << " used=" << sylar::GetCurrentMS() - begin << "ms";
+  });
+}
+
+void test_select() {
+  sylar::IOManager iom(1, false, "select");
+  std::vector<sylar::Channel<std::string>::ptr> chans;
+  for (int i = 0; i < 3; ++i) {
+    chans.push_back(std::make_shared<sylar::Channel<std::string>>());
+  }
+
+  iom.schedule([chans]() {
+    std::string v;
+    while (true) {
+      int idx = sylar::Channel<std::string>::Select(chans, v, 500);
+      if (idx < 0) {
+        SYLAR_LOG_INFO(g_logger) << "select timeout";
+        break;
+      }
+      SYLAR_LOG_INFO(g_logger) << "select chan=" << idx << " value=" << v;
+    }
+  });
+
+  iom.schedule([chans]() {
+    for (int i = 0; i < 6; ++i) {
+      chans[i % chans.size()]->send("msg_" + std::to_string(i));
+      usleep(10 * 1000);
+    }
+  });
+}
+
+/*
+ * 两个Select和一个recv等同一个通道a: s1等[a, b], s2等[a, c], r等a
+ * a唤醒s1后b也来了数据, s1取走b的数据时, a的唤醒要转给s2或者r, 否则a的数据一直没人取
+ * 单线程调度, 顺序是确定的; s1从哪个通道开始检查是轮换的, 多试几轮
+ * */
+void test_select_wakeup() {
+  sylar::IOManager iom(1, false, "select_wakeup");
+  auto crossed = std::make_shared<int>(0);
+  auto stranded = std::make_shared<int>(0);
+  auto checked = std::make_shared<int>(0);
+  const int trials = 20;
+  for (int t = 0; t < trials; ++t) {
+    auto a = std::make_shared<sylar::Channel<int>>();
+    auto b = std::make_shared<sylar::Channel<int>>();
+    auto c = std::make_shared<sylar::Channel<int>>();
+    auto done = std::make_shared<int>(0);
+
+    iom.schedule([a, b, crossed, done]() {
+      int v = 0;
+      if (sylar::Channel<int>::Select({a, b}, v, 200) == 1) {
+        ++*crossed;
+      }
+      ++*done;
+    });
+    iom.schedule([a, c, done]() {
+      int v = 0;
+      sylar::Channel<int>::Select({a, c}, v, 200);
+      ++*done;
+    });
+    iom.schedule([a, done]() {
+      int v = 0;
+      a->recv(v, 200);
+      ++*done;
+    });
+    iom.schedule([a, b]() {
+      a->send(1);
+      b->send(2);
+    });
+    iom.schedule([a, done, stranded, checked]() {
+      while (*done != 3) {
+        usleep(1000);
+      }
+      if (a->size()) {
+        ++*stranded;
+      }
+      ++*checked;
+    });
+  }
+  iom.schedule([crossed, stranded, checked, trials]() {
+    while (*checked != trials) {
+      usleep(1000);
+    }
+    SYLAR_LOG_INFO(g_logger) << "select wakeup: crossed=" << *crossed << " stranded=" << *stranded;
+  });
+}
+
+void test_spsc() {
+  sylar::IOManager iom(2, false, "spsc");
+  auto chan = std::make_shared<sylar::SPSCChannel<uint64_t>>(64);
+  static const uint64_t N = 100000;
+
+  iom.schedule([chan]() {
+    for (uint64_t i = 1; i <= N; ++i) {
+      chan->send(i);
+    }
+    chan->close();
+  });
+
+  iom.schedule([chan]() {
+    uint64_t v = 0;
+    uint64_t sum = 0;
+    uint64_t begin = sylar::GetCurrentUS();
+    while (chan->recv(v)) {
+      sum += v;
+    }
+    SYLAR_LOG_INFO(g_logger) << "spsc sum=" << sum << " expect=" << N * (N + 1) / 2
+        << " used=" << sylar::GetCurrentUS() - begin << "us";
+  });
+}
+
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+  test_channel();
+  test_select();
+  test_select_wakeup();
+  test_spsc();
+  return 0;
+}
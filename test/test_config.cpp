@@ -58,13 +58,13 @@ void test_yaml() {
 }
 
 void test_config() {
-  SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "before: " << g_int_value_config->getValue();
+  SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "before: " << *g_int_value_config->getValue();
   SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "before: " << g_float_value_config->toString();
 
 #define XX(g_var, name, prefix) \
 {                              \
-  auto& v = (g_var)->getValue(); \
-  for(auto& e : v) { \
+  auto v = (g_var)->getValue(); \
+  for(auto& e : *v) { \
     SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << #prefix " "#name": " << e; \
   } \
   SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << #prefix " "#name" yaml: " << g_var->toString(); \
@@ -72,8 +72,8 @@ void test_config() {
 
 #define XX_M(g_var, name, prefix) \
 {                              \
-  auto& v = (g_var)->getValue(); \
-  for(auto& e : v) { \
+  auto v = (g_var)->getValue(); \
+  for(auto& e : *v) { \
     SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << #prefix " "#name": {" << e.first << " - " << e.second << "}"; \
   } \
   SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << #prefix " "#name" yaml: " << g_var->toString(); \
@@ -89,7 +89,7 @@ void test_config() {
   YAML::Node root = YAML::LoadFile("/home/changyuli/Documents/Project/Repos/sylar/test/resource/test.yml");
   sylar::Config::LoadFromYAML(root);
 
-  SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "after: " << g_int_value_config->getValue();
+  SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "after: " << *g_int_value_config->getValue();
   SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "after: " << g_float_value_config->toString();
 
   XX(g_int_vector_value_config, int_vec, after);
@@ -159,16 +159,16 @@ sylar::ConfigVar<std::map<std::string, Person>>::ptr g_person_map =
 	sylar::Config::Lookup("class.person_map", std::map<std::string, Person>(), "system person");
 
 void test_class() {
-  SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "before: " << g_person->getValue().toString() << " - " << g_person->toString();
+  SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "before: " << g_person->getValue()->toString() << " - " << g_person->toString();
 
 
 #define XX_PM(g_var, prefix) \
   {                          \
   	auto m = g_person_map->getValue(); \
-  	for(auto& i : m) {        \
+  	for(auto& i : *m) {       \
     	SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << (prefix) << ": " << i.first << " - " << i.second.toString();                         \
   	}                         \
-  	SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << (prefix) << ": size=" << m.size();                           \
+  	SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << (prefix) << ": size=" << m->size();                           \
   }
 
   g_person->addListener([](const Person& old_value, const Person& new_value) {
@@ -180,7 +180,7 @@ void test_class() {
   YAML::Node root = YAML::LoadFile("/home/changyuli/Documents/Project/Repos/sylar/test/resource/test.yml");
   sylar::Config::LoadFromYAML(root);
 
-  SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "after: " << g_person->getValue().toString() << " - " << g_person->toString();
+  SYLAR_LOG_INFO(SYLAR_LOG_ROOT()) << "after: " << g_person->getValue()->toString() << " - " << g_person->toString();
   XX_PM(g_person_map, "class.map after");
 }
 
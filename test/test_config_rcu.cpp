@@ -0,0 +1,119 @@
+#include "../sylar/config.h"
+#include "../sylar/rcu.h"
+#include "../sylar/thread.h"
+#include "../sylar/util.h"
+
+#include <iostream>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static sylar::ConfigVar<int>::ptr g_int =
+    sylar::Config::Lookup("bench.int", (int)1, "bench int");
+
+static sylar::ConfigVar<std::vector<int>>::ptr g_vec =
+    sylar::Config::Lookup("bench.vec", std::vector<int>(16, 0), "bench vec");
+
+// 原来的读法: 读锁里取值
+struct LockedInt {
+  sylar::RWMutex mutex;
+  int value = 1;
+  int get() {
+    sylar::RWMutex::ReadLock lock(mutex);
+    return value;
+  }
+  void set(int v) {
+    sylar::RWMutex::WriteLock lock(mutex);
+    value = v;
+  }
+};
+
+// 防止读的结果被优化掉
+static std::atomic<uint64_t> s_sink {0};
+
+template <typename Read, typename Reload>
+static void bench(const char* name, int readers, uint64_t ms, Read read, Reload reload) {
+  std::atomic<bool> stop {false};
+  std::atomic<uint64_t> total {0};
+  std::vector<sylar::Thread::ptr> threads;
+  for (int i = 0; i < readers; ++i) {
+    threads.push_back(std::make_shared<sylar::Thread>([&]() {
+        uint64_t n = 0;
+        uint64_t sum = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+          for (int j = 0; j < 1000; ++j) {
+            sum += read();
+          }
+          n += 1000;
+        }
+        total += n;
+        s_sink += sum;
+      }, std::string("reader_") + std::to_string(i)));
+  }
+  // 读的同时不停地重新加载配置
+  uint64_t reloads = 0;
+  uint64_t start = sylar::GetCurrentMS();
+  while (sylar::GetCurrentMS() - start < ms) {
+    reload(++reloads);
+    usleep(1000);
+  }
+  stop = true;
+  for (auto& t : threads) {
+    t->join();
+  }
+  SYLAR_LOG_INFO(g_logger) << name << ": readers=" << readers << " reloads=" << reloads
+      << " reads/s=" << total * 1000 / ms;
+}
+
+int main(int argc, char* argv[]) {
+  int readers = argc > 1 ? atoi(argv[1]) : 4;
+  uint64_t ms = argc > 2 ? atoi(argv[2]) : 1000;
+
+  // 监听函数在新版本发布之后调用
+  g_int->addListener([](const int& old_value, const int& new_value) {
+      if (*g_int->getValue() != new_value) {
+        SYLAR_LOG_ERROR(g_logger) << "listener sees old value";
+      }
+    });
+
+  LockedInt locked;
+  bench("rwmutex", readers, ms, [&]() {return locked.get();}, [&](uint64_t i) {locked.set(i);});
+  bench("epoch", readers, ms, []() {return *g_int->getValue();}, [](uint64_t i) {g_int->setValue(i);});
+
+  // 读者拿到的值是完整的快照: 每个版本的元素都相同
+  std::atomic<uint64_t> torn {0};
+  bench("epoch vector", readers, ms, [&]() {
+      auto snapshot = g_vec->getValue();
+      const std::vector<int>& v = *snapshot;
+      for (auto i : v) {
+        if (i != v[0]) {
+          ++torn;
+        }
+      }
+      return v[0];
+    }, [](uint64_t i) {
+      g_vec->setValue(std::vector<int>(16, i));
+    });
+  SYLAR_LOG_INFO(g_logger) << "torn reads: " << torn;
+
+  // 还有读者持有旧版本时旧版本保持不变, 不回收; 读者离开后下一次修改时回收
+  bool alive = false;
+  size_t pending = 0;
+  {
+    auto held = g_vec->getValue();
+    int held_value = (*held)[0];
+    g_vec->setValue(std::vector<int>(16, held_value + 1));
+    alive = (*held)[0] == held_value;
+    pending = sylar::Rcu::GetPendingCount();
+  }
+  g_vec->setValue(std::vector<int>(16, 0));
+  SYLAR_LOG_INFO(g_logger) << "old version: alive_while_held=" << alive
+      << " pending_while_held=" << pending
+      << " pending_after_release=" << sylar::Rcu::GetPendingCount();
+
+  // 通过YAML重新加载
+  YAML::Node root = YAML::Load("bench:\n  int: 42\n");
+  sylar::Config::LoadFromYAML(root);
+  SYLAR_LOG_INFO(g_logger) << "bench.int=" << *g_int->getValue() << " " << g_int->toString();
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+#include "../sylar/coroutine.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+sylar::Task<void> echo_session(sylar::Socket::ptr client) {
+  char buf[1024];
+  while (true) {
+    int n = co_await sylar::async_recv(client, buf, sizeof(buf));
+    if (n <= 0) {
+      break;
+    }
+    co_await sylar::async_send(client, buf, n);
+  }
+  client->close();
+}
+
+sylar::Task<void> echo_server(sylar::IOManager* iom, sylar::Socket::ptr sock) {
+  while (true) {
+    auto client = co_await sylar::async_accept(sock);
+    if (!client) {
+      SYLAR_LOG_INFO(g_logger) << "server accept timeout, quit";
+      break;
+    }
+    sylar::co_spawn(iom, echo_session(client));
+  }
+  sock->close();
+}
+
+sylar::Task<int> echo_once(sylar::Socket::ptr sock, const std::string& msg) {
+  co_await sylar::async_send(sock, msg.data(), msg.size());
+  std::string buf(msg.size(), '\0');
+  int n = co_await sylar::async_recv(sock, &buf[0], buf.size());
+  SYLAR_LOG_INFO(g_logger) << "client recv: " << buf.substr(0, n > 0 ? n : 0);
+  co_return n;
+}
+
+sylar::Task<void> echo_client(sylar::Address::ptr addr) {
+  auto sock = sylar::Socket::CreateTCPSocket();
+  bool ok = co_await sylar::async_connect(sock, addr, 1000);
+  if (!ok) {
+    SYLAR_LOG_ERROR(g_logger) << "connect " << addr->toString() << " fail errno=" << errno;
+    co_return;
+  }
+  int total = 0;
+  for (int i = 0; i < 5; ++i) {
+    total += co_await echo_once(sock, "hello_" + std::to_string(i));
+    co_await sylar::sleep_for(20);
+  }
+  SYLAR_LOG_INFO(g_logger) << "client done total=" << total;
+  sock->close();
+}
+
+void test_echo() {
+  sylar::IOManager iom(2, false, "coro");
+  // socket相关的操作放在调度协程中, hook才会记录超时设置
+  iom.schedule([&iom]() {
+    auto sock = sylar::Socket::CreateTCPSocket();
+    auto addr = sylar::IPv4Address::Create("127.0.0.1", 0);
+    if (!sock->bind(addr) || !sock->listen()) {
+      SYLAR_LOG_ERROR(g_logger) << "bind/listen fail";
+      return;
+    }
+    // 没有新连接时accept超时退出, 让IOManager可以结束
+    sock->setRecvTimeout(500);
+    auto local = sock->getLocalAddress();
+    SYLAR_LOG_INFO(g_logger) << "listen on " << local->toString();
+
+    sylar::co_spawn(&iom, echo_server(&iom, sock));
+    sylar::co_spawn(&iom, echo_client(local));
+  });
+
+  // 有栈协程和无栈协程在同一个IOManager上并存
+  iom.schedule([]() {
+    for (int i = 0; i < 3; ++i) {
+      usleep(30 * 1000);
+      SYLAR_LOG_INFO(g_logger) << "stackful fiber tick " << i;
+    }
+  });
+}
+
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+  test_echo();
+  return 0;
+}
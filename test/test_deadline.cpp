@@ -0,0 +1,48 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+#include "../sylar/fd_manager.h"
+#include "../sylar/deadline.h"
+
+#include <sys/socket.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// 模拟一个很慢的后端: 对端永远不回数据, fd自身的接收超时为100ms
+static int make_slow_backend() {
+  int fds[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  sylar::FdMgr::GetInstance()->get(fds[0], true);
+  sylar::FdMgr::GetInstance()->get(fds[1], true);
+  timeval tv {0, 100 * 1000};
+  setsockopt(fds[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  return fds[0];
+}
+
+void handle_request() {
+  int fd = make_slow_backend();
+  uint64_t begin = sylar::GetCurrentMS();
+  // 整个请求最多250ms, 不管中间调用了多少次后端
+  sylar::DeadlineGuard guard(250);
+  char buf[16];
+  for (int i = 0; i < 5; ++i) {
+    int rt = recv(fd, buf, sizeof(buf), 0);
+    int err = errno;
+    SYLAR_LOG_INFO(g_logger) << "backend call " << i << " rt=" << rt << " errno=" << err
+        << " remain=" << sylar::GetDeadlineRemainingMS()
+        << " elapsed=" << sylar::GetCurrentMS() - begin << "ms";
+  }
+  {
+    // 嵌套的guard只会缩短截止时间
+    sylar::DeadlineGuard inner(10000);
+    SYLAR_LOG_INFO(g_logger) << "inner remain=" << sylar::GetDeadlineRemainingMS();
+  }
+  SYLAR_LOG_INFO(g_logger) << "request done elapsed=" << sylar::GetCurrentMS() - begin << "ms";
+}
+
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+  sylar::IOManager iom(1, false, "deadline");
+  iom.schedule(handle_request);
+  return 0;
+}
@@ -0,0 +1,81 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+#include "../sylar/fd_manager.h"
+#include "../sylar/channel.h"
+#include "../sylar/fiber_dump.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const char* kAdminPath = "/tmp/sylar_test_fiber_dump.sock";
+
+static void blocked_recv(int fd) {
+  char buf[16];
+  recv(fd, buf, sizeof(buf), 0);
+}
+
+// 通过管理socket取一份转储
+static std::string read_admin() {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr {};
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, kAdminPath);
+  std::string text;
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+      text.append(buf, n);
+    }
+  }
+  close(fd);
+  return text;
+}
+
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::INFO);
+  sylar::Config::Lookup<int>("fiber.dump_signal")->setValue(SIGUSR2);
+  sylar::Config::Lookup<std::string>("fiber.admin_socket")->setValue(kAdminPath);
+
+  int fds[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  sylar::FdMgr::GetInstance()->get(fds[0], true);
+  sylar::FdMgr::GetInstance()->get(fds[1], true);
+  sylar::Channel<int> chan(1);
+
+  sylar::IOManager iom(2, false, "dump");
+  iom.schedule(std::bind(blocked_recv, fds[0]));
+  iom.schedule([]() {usleep(500 * 1000);});
+  iom.schedule([&chan]() {
+    int v;
+    chan.recv(v);
+  });
+  sylar::Config::Lookup<bool>("fiber.capture_stack")->setValue(true);
+  iom.schedule(sylar::Fiber::ptr(new sylar::Fiber([]() {usleep(300 * 1000);})));
+  sylar::Config::Lookup<bool>("fiber.capture_stack")->setValue(false);
+
+  usleep(100 * 1000);
+  // 信号触发的转储打在日志里
+  raise(SIGUSR2);
+  usleep(50 * 1000);
+  SYLAR_LOG_INFO(g_logger) << "admin socket dump:" << std::endl << read_admin();
+
+  // 换成别的信号或者设为0时, 原来的信号恢复默认处理
+  auto handler = [](int sig) {
+    struct sigaction sa {};
+    sigaction(sig, nullptr, &sa);
+    return sa.sa_handler == SIG_DFL ? "default" : "dump";
+  };
+  sylar::Config::Lookup<int>("fiber.dump_signal")->setValue(SIGUSR1);
+  SYLAR_LOG_INFO(g_logger) << "dump_signal=SIGUSR1: SIGUSR2 " << handler(SIGUSR2) << ", SIGUSR1 " << handler(SIGUSR1);
+  sylar::Config::Lookup<int>("fiber.dump_signal")->setValue(0);
+  SYLAR_LOG_INFO(g_logger) << "dump_signal=0: SIGUSR1 " << handler(SIGUSR1);
+
+  send(fds[1], "x", 1, 0);
+  chan.send(1);
+  return 0;
+}
@@ -0,0 +1,42 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+#include "../sylar/fiber_local.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+struct RequestContext {
+  RequestContext() {
+    SYLAR_LOG_INFO(g_logger) << "RequestContext construct fiber=" << sylar::Fiber::GetFiberId();
+  }
+  ~RequestContext() {
+    SYLAR_LOG_INFO(g_logger) << "RequestContext destruct trace_id=" << trace_id;
+  }
+  std::string trace_id;
+};
+
+static sylar::FiberLocal<RequestContext> s_request;
+static sylar::FiberLocal<int> s_counter(100);
+
+void handle(int id) {
+  s_request->trace_id = "trace_" + std::to_string(id);
+  for (int i = 0; i < 3; ++i) {
+    ++*s_counter;
+    // usleep会让出协程, 之后可能在别的线程上继续执行
+    usleep(10 * 1000);
+    SYLAR_LOG_INFO(g_logger) << "id=" << id << " trace_id=" << s_request->trace_id
+        << " counter=" << *s_counter;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+  sylar::IOManager iom(3, false, "fls");
+  for (int i = 0; i < 3; ++i) {
+    iom.schedule(std::bind(handle, i));
+  }
+  iom.schedule([]() {
+    SYLAR_LOG_INFO(g_logger) << "untouched local=" << (s_request.tryGet() ? "exist" : "null");
+  });
+  return 0;
+}
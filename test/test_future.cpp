@@ -0,0 +1,86 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+#include "../sylar/future.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// 模拟一次耗时的后端调用
+int backend_call(int id, int ms) {
+  usleep(ms * 1000);
+  return id * 10;
+}
+
+void test_fan_out() {
+  sylar::IOManager iom(2, false, "future");
+
+  iom.schedule([&iom]() {
+    uint64_t begin = sylar::GetCurrentMS();
+    std::vector<sylar::Future<int>> futures;
+    for (int i = 1; i <= 5; ++i) {
+      futures.push_back(sylar::async(&iom, [i]() {
+          return backend_call(i, 100);
+        }));
+    }
+    // 在协程中等待, 不阻塞线程
+    auto all = sylar::whenAll(futures).get();
+    int sum = 0;
+    for (auto& i : all) {
+      sum += i;
+    }
+    SYLAR_LOG_INFO(g_logger) << "whenAll sum=" << sum
+        << " used=" << sylar::GetCurrentMS() - begin << "ms";
+
+    // bool结果在多个线程中同时写入不同下标
+    std::vector<sylar::Future<bool>> flags;
+    for (int i = 0; i < 64; ++i) {
+      flags.push_back(sylar::async(&iom, [i]() {return i % 3 == 0;}));
+    }
+    auto all_flags = sylar::whenAll(flags).get();
+    int set = 0;
+    for (size_t i = 0; i < all_flags.size(); ++i) {
+      set += all_flags[i] == (i % 3 == 0);
+    }
+    SYLAR_LOG_INFO(g_logger) << "whenAll bool correct=" << set << "/" << all_flags.size();
+
+    std::vector<sylar::Future<int>> racers;
+    racers.push_back(sylar::async(&iom, []() {return backend_call(1, 300);}));
+    racers.push_back(sylar::async(&iom, []() {return backend_call(2, 50);}));
+    auto first = sylar::whenAny(racers).get();
+    SYLAR_LOG_INFO(g_logger) << "whenAny index=" << first.first << " value=" << first.second;
+
+    auto chained = sylar::async(&iom, []() {return 20;})
+        .then([](const int& v) {return std::to_string(v * 2);})
+        .then([](const std::string& v) {return "value=" + v;});
+    SYLAR_LOG_INFO(g_logger) << "then " << chained.get();
+
+    auto failed = sylar::async(&iom, []() -> int {
+        throw std::runtime_error("backend down");
+      }).then([](const int& v) {return v + 1;});
+    try {
+      failed.get();
+    } catch (std::exception& e) {
+      SYLAR_LOG_INFO(g_logger) << "exception propagated: " << e.what();
+    }
+  });
+}
+
+void test_thread_wait() {
+  sylar::IOManager iom(1, false, "future_thr");
+  // 在普通线程中等待, 阻塞线程
+  auto f = sylar::async(&iom, []() {
+      usleep(50 * 1000);
+    });
+  f.get();
+  SYLAR_LOG_INFO(g_logger) << "void future ready in main thread";
+
+  sylar::Promise<int> never;
+  bool rt = never.getFuture().waitFor(100);
+  SYLAR_LOG_INFO(g_logger) << "waitFor timeout rt=" << rt;
+}
+
+int main(int argc, char* argv[]) {
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+  test_fan_out();
+  test_thread_wait();
+  return 0;
+}
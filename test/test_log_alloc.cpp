@@ -0,0 +1,63 @@
+#include "../sylar/log.h"
+#include "../sylar/util.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// 统计operator new的调用次数
+static std::atomic<uint64_t> s_allocs {0};
+
+void* operator new(size_t size) {
+  s_allocs.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+static void bench(const char* name, sylar::Logger::ptr logger, int n) {
+  // 预热: 事件池, 线程局部缓冲, 环形缓冲槽位
+  for (int i = 0; i < 10000; ++i) {
+    SYLAR_LOG_INFO(logger) << "warm up " << i << " value=" << 3.14;
+  }
+  uint64_t allocs = s_allocs;
+  uint64_t start = sylar::GetCurrentUS();
+  for (int i = 0; i < n; ++i) {
+    SYLAR_LOG_INFO(logger) << "bench line " << i << " value=" << 3.14;
+  }
+  uint64_t used = sylar::GetCurrentUS() - start;
+  allocs = s_allocs - allocs;
+  uint64_t fmt_allocs = s_allocs;
+  for (int i = 0; i < n; ++i) {
+    SYLAR_LOG_FMT_INFO(logger, "fmt line %d value=%.2f", i, 3.14);
+  }
+  fmt_allocs = s_allocs - fmt_allocs;
+  std::cout << name << ": lines=" << n
+            << " allocs/line=" << (double)allocs / n
+            << " fmt allocs/line=" << (double)fmt_allocs / n
+            << " ns/line=" << used * 1000 / n << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  int n = argc > 1 ? atoi(argv[1]) : 100000;
+
+  auto logger = std::make_shared<sylar::Logger>("bench");
+  logger->addAppender(std::make_shared<sylar::FileLogAppender>("/dev/null"));
+  bench("file", logger, n);
+
+  logger->clearAppender();
+  auto async = std::make_shared<sylar::AsyncLogAppender>("/dev/null", 1024);
+  logger->addAppender(async);
+  bench("async", logger, n);
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include "../sylar/log.h"
+#include "../sylar/log_binary.h"
+#include "../sylar/util.h"
+
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+
+static const char* kFile = "/tmp/sylar_test_log_binary.bin";
+
+enum Color {RED = 1, GREEN = 2};
+
+int main(int argc, char* argv[]) {
+  int n = argc > 1 ? atoi(argv[1]) : 200000;
+
+  unlink(kFile);
+  auto logger = SYLAR_LOG_NAME("bin");
+  auto appender = std::make_shared<sylar::BinaryFileLogAppender>(kFile);
+  logger->addAppender(appender);
+
+  std::string name = "sylar";
+  SYLAR_LOG_BIN_INFO(logger, "int=%d uint=%u neg=%ld big=%llu", 42, 7u, -5L, 1ULL << 40);
+  SYLAR_LOG_BIN_INFO(logger, "double=%.3f exp=%e str=%s cstr=%-6s| ptr=%p", 3.14159, 1e-9, name, "ab", (void*)0x1234);
+  SYLAR_LOG_BIN_WARN(logger, "enum=%d char=%c hex=%08x %%done", GREEN, 'x', 255);
+  SYLAR_LOG_BIN_ERROR(logger, "no args");
+  SYLAR_LOG_BIN_INFO(logger, "mismatch %s", 1);
+  // 同一个调用点用运行时的级别调用, 每条记录按自己的级别还原
+  for (auto level : {sylar::LogLevel::INFO, sylar::LogLevel::ERROR}) {
+    SYLAR_LOG_BIN(logger, level, "runtime level %d", (int)level);
+  }
+  // 普通的文本日志作为文本记录写入
+  SYLAR_LOG_INFO(logger) << "text line";
+
+  // 其他appender收到二进制日志时当场还原
+  auto text = SYLAR_LOG_NAME("bin_text");
+  text->addAppender(std::make_shared<sylar::StdoutLogAppender>());
+  SYLAR_LOG_BIN_INFO(text, "fallback %s %d", "to text", 1);
+
+  appender->flush();
+  sylar::BinaryLogReader reader;
+  if (!reader.open(kFile)) {
+    std::cout << reader.getError() << std::endl;
+    return 1;
+  }
+  std::string line;
+  size_t decoded = 0;
+  while (reader.next(line)) {
+    std::cout << "decoded: " << line << std::endl;
+    ++decoded;
+  }
+
+  // 同一个文件上再建一个appender(配置重载)是追加, 旧记录保留, 调用点重新定义
+  {
+    auto reload = std::make_shared<sylar::Logger>("bin_reload");
+    reload->addAppender(std::make_shared<sylar::BinaryFileLogAppender>(kFile));
+    SYLAR_LOG_BIN_INFO(reload, "after reload %d", 1);
+  }
+  appender->flush();
+  sylar::BinaryLogReader reloaded;
+  size_t total = 0;
+  if (reloaded.open(kFile)) {
+    while (reloaded.next(line)) {
+      ++total;
+    }
+  }
+  std::cout << "reload: before=" << decoded << " after=" << total
+            << " error=" << reloaded.getError() << std::endl;
+
+  // 记录里的长度损坏时报错, 不按它分配内存
+  {
+    std::ofstream out("/tmp/sylar_test_log_binary_bad.bin", std::ios::binary);
+    uint32_t version = sylar::BinaryLog::kVersion;
+    uint32_t size = 0xffffffff;
+    out.write(sylar::BinaryLog::kMagic, sizeof(sylar::BinaryLog::kMagic) - 1);
+    out.write((const char*)&version, sizeof(version));
+    out.put(sylar::BinaryLog::TEXT_RECORD);
+    out.write((const char*)&size, sizeof(size));
+  }
+  sylar::BinaryLogReader bad;
+  if (bad.open("/tmp/sylar_test_log_binary_bad.bin") && !bad.next(line)) {
+    std::cout << "corrupt file: " << bad.getError() << std::endl;
+  }
+  unlink("/tmp/sylar_test_log_binary_bad.bin");
+
+  // 旧版本的文件不能接着追加, 改名为.old后重新建文件
+  {
+    const char* old_file = "/tmp/sylar_test_log_binary_v1.bin";
+    {
+      std::ofstream out(old_file, std::ios::binary);
+      uint32_t version = sylar::BinaryLog::kVersion - 1;
+      out.write(sylar::BinaryLog::kMagic, sizeof(sylar::BinaryLog::kMagic) - 1);
+      out.write((const char*)&version, sizeof(version));
+    }
+    std::make_shared<sylar::BinaryFileLogAppender>(old_file);
+    sylar::BinaryLogReader upgraded;
+    std::cout << "old version: moved=" << (access((std::string(old_file) + ".old").c_str(), F_OK) == 0)
+              << " reopened=" << upgraded.open(old_file) << std::endl;
+    unlink(old_file);
+    unlink((std::string(old_file) + ".old").c_str());
+  }
+
+  // 同一条日志, 二进制和文本格式化到/dev/null的耗时对比
+  auto bench = std::make_shared<sylar::Logger>("bench");
+  bench->addAppender(std::make_shared<sylar::BinaryFileLogAppender>("/dev/null"));
+  uint64_t start = sylar::GetCurrentUS();
+  for (int i = 0; i < n; ++i) {
+    SYLAR_LOG_BIN_INFO(bench, "request id=%d user=%s cost=%.2fms", i, name, 1.25);
+  }
+  uint64_t bin_us = sylar::GetCurrentUS() - start;
+
+  bench->clearAppender();
+  bench->addAppender(std::make_shared<sylar::FileLogAppender>("/dev/null"));
+  start = sylar::GetCurrentUS();
+  for (int i = 0; i < n; ++i) {
+    SYLAR_LOG_FMT_INFO(bench, "request id=%d user=%s cost=%.2fms", i, name.c_str(), 1.25);
+  }
+  uint64_t text_us = sylar::GetCurrentUS() - start;
+  std::cout << "binary: " << bin_us * 1000 / n << " ns/line, text: " << text_us * 1000 / n << " ns/line" << std::endl;
+  return 0;
+}
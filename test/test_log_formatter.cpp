@@ -0,0 +1,65 @@
+#include "../sylar/log.h"
+#include "../sylar/log_pattern.h"
+#include "../sylar/util.h"
+
+#include <iostream>
+
+static constexpr char kDefaultPattern[] = "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n";
+static constexpr char kShortPattern[] = "%d%T%p%T%m%n";
+static constexpr char kMilliPattern[] = "%d{%H:%M:%S}.%ms%T%p%T%m%n";
+
+template <const char* P>
+void bench(int n) {
+  auto logger = std::make_shared<sylar::Logger>("bench");
+  auto runtime = std::make_shared<sylar::LogFormatter>(P);
+  auto fused = std::make_shared<sylar::StaticLogFormatter<P>>();
+
+  sylar::LogEventWarp warp(logger, sylar::LogLevel::INFO, __FILE__, __LINE__);
+  warp.getSS() << "formatter benchmark message " << 42;
+  auto& event = warp.getEvent();
+  // LogEventWarp析构时会输出, 这里不需要
+  logger->setLevel(sylar::LogLevel::Level(100));
+
+  std::string a, b;
+  runtime->format(a, logger, sylar::LogLevel::INFO, event);
+  fused->format(b, logger, sylar::LogLevel::INFO, event);
+  std::cout << "pattern: " << P << std::endl
+            << "  same output: " << (a == b ? "yes" : "no") << std::endl;
+
+  std::string out;
+  uint64_t start = sylar::GetCurrentUS();
+  for (int i = 0; i < n; ++i) {
+    out.clear();
+    runtime->format(out, logger, sylar::LogLevel::INFO, event);
+  }
+  uint64_t runtime_us = sylar::GetCurrentUS() - start;
+
+  start = sylar::GetCurrentUS();
+  for (int i = 0; i < n; ++i) {
+    out.clear();
+    fused->format(out, logger, sylar::LogLevel::INFO, event);
+  }
+  uint64_t fused_us = sylar::GetCurrentUS() - start;
+
+  std::cout << "  runtime: " << (uint64_t)(n * 1e6 / runtime_us) << " lines/sec/core" << std::endl
+            << "  static:  " << (uint64_t)(n * 1e6 / fused_us) << " lines/sec/core" << std::endl;
+}
+
+// 公开构造函数创建的事件保存线程名的副本, 传临时字符串不会悬空
+void test_event_thread_name() {
+  auto logger = std::make_shared<sylar::Logger>("event");
+  sylar::LogEvent::ptr event(new sylar::LogEvent(logger, sylar::LogLevel::INFO, __FILE__, __LINE__,
+                                                 0, 1, 2, time(0), std::string("temporary_thread")));
+  std::string out;
+  sylar::LogFormatter("%N").format(out, logger, sylar::LogLevel::INFO, event);
+  std::cout << "thread name: " << out << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  int n = argc > 1 ? atoi(argv[1]) : 1000000;
+  test_event_thread_name();
+  bench<kDefaultPattern>(n);
+  bench<kShortPattern>(n);
+  bench<kMilliPattern>(n);
+  return 0;
+}
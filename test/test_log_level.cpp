@@ -0,0 +1,34 @@
+#include "../sylar/log.h"
+#include "../sylar/util.h"
+
+#include <iostream>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("level");
+
+static int s_evaluated = 0;
+
+static int sideEffect() {
+  return ++s_evaluated;
+}
+
+int main(int argc, char* argv[]) {
+  int n = argc > 1 ? atoi(argv[1]) : 100000000;
+  std::cout << "SYLAR_MIN_LOG_LEVEL=" << SYLAR_MIN_LOG_LEVEL << std::endl;
+
+  // 编译期去掉的语句不会对参数求值
+  SYLAR_LOG_DEBUG(g_logger) << "debug " << sideEffect();
+  SYLAR_LOG_INFO(g_logger) << "info " << sideEffect();
+  SYLAR_LOG_WARN(g_logger) << "warn " << sideEffect();
+  std::cout << "evaluated=" << s_evaluated << " expected=" << 4 - std::max(SYLAR_MIN_LOG_LEVEL, 1) << std::endl;
+
+  // 运行期关掉的DEBUG只有一次原子读
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  s_evaluated = 0;
+  uint64_t start = sylar::GetCurrentUS();
+  for (int i = 0; i < n; ++i) {
+    SYLAR_LOG_DEBUG(g_logger) << "disabled " << sideEffect();
+  }
+  uint64_t used = sylar::GetCurrentUS() - start;
+  std::cout << "disabled debug: " << used * 1000.0 / n << " ns/call, evaluated=" << s_evaluated << std::endl;
+  return 0;
+}
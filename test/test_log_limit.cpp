@@ -0,0 +1,95 @@
+#include "../sylar/log.h"
+#include "../sylar/log_limit.h"
+#include "../sylar/config.h"
+#include "../sylar/thread.h"
+#include "../sylar/util.h"
+
+#include <unistd.h>
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// 统计每个调用点真正输出了多少条
+class CountAppender : public sylar::LogAppender {
+ public:
+  using ptr = std::shared_ptr<CountAppender>;
+  void log(const std::shared_ptr<sylar::Logger>& logger, sylar::LogLevel::Level level, const sylar::LogEvent::ptr& event) override {
+    ++count;
+  }
+  std::string toYamlString() override {return "";}
+  std::atomic<uint64_t> count {0};
+};
+
+// 同一个调用点
+static void storm(const sylar::Logger::ptr& logger, int i) {
+  SYLAR_LOG_ERROR_LIMITED(logger) << "epoll_ctl storm " << i;
+}
+
+int main(int argc, char* argv[]) {
+  for (int i = 0; i < 25; ++i) {
+    SYLAR_LOG_INFO_EVERY_N(g_logger, 10) << "every 10, i=" << i;
+  }
+  for (int i = 0; i < 25; ++i) {
+    SYLAR_LOG_INFO_FIRST_N(g_logger, 3) << "first 3, i=" << i;
+  }
+  for (int i = 0; i < 30; ++i) {
+    SYLAR_LOG_INFO_EVERY_MS(g_logger, 100) << "every 100ms, i=" << i;
+    usleep(10 * 1000);
+  }
+  // 级别不够的不计数
+  g_logger->setLevel(sylar::LogLevel::WARN);
+  for (int i = 0; i < 5; ++i) {
+    SYLAR_LOG_INFO_EVERY_N(g_logger, 2) << "filtered";
+  }
+  g_logger->setLevel(sylar::LogLevel::DEBUG);
+
+  // 多线程打同一个限流的调用点: 每秒10条, 最多攒20条
+  auto logger = SYLAR_LOG_NAME("limited");
+  auto counter = std::make_shared<CountAppender>();
+  logger->addAppender(counter);
+  sylar::Config::Lookup<uint64_t>("log.rate_limit.rate")->setValue(10);
+  sylar::Config::Lookup<uint64_t>("log.rate_limit.burst")->setValue(20);
+
+  std::atomic<bool> stop {false};
+  std::atomic<uint64_t> attempts {0};
+  std::vector<sylar::Thread::ptr> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.push_back(std::make_shared<sylar::Thread>([&]() {
+        while (!stop) {
+          storm(logger, ++attempts);
+        }
+      }, "storm_" + std::to_string(i)));
+  }
+  uint64_t begin = sylar::GetCurrentMS();
+  sleep(1);
+  stop = true;
+  for (auto& t : threads) {
+    t->join();
+  }
+  uint64_t elapsed = sylar::GetCurrentMS() - begin;
+  // 期望 burst + rate * 秒数
+  SYLAR_LOG_INFO(g_logger) << "rate limited: attempts=" << attempts << " emitted=" << counter->count
+      << " expected<=" << 20 + 10 * elapsed / 1000 + 1;
+
+  // 下一条带上之前丢掉的条数
+  logger->clearAppender();
+  logger->addAppender(std::make_shared<sylar::StdoutLogAppender>());
+  sleep(1);
+  for (int i = 0; i < 3; ++i) {
+    storm(logger, -i);
+  }
+
+  // 开销
+  sylar::Config::Lookup<uint64_t>("log.rate_limit.rate")->setValue(1);
+  sylar::Config::Lookup<uint64_t>("log.rate_limit.burst")->setValue(1);
+  int n = argc > 1 ? atoi(argv[1]) : 10000000;
+  uint64_t start = sylar::GetCurrentUS();
+  for (int i = 0; i < n; ++i) {
+    SYLAR_LOG_DEBUG_LIMITED(logger) << "suppressed " << i;
+  }
+  uint64_t used = sylar::GetCurrentUS() - start;
+  SYLAR_LOG_INFO(g_logger) << "suppressed call cost " << used * 1000.0 / n << " ns";
+  return 0;
+}
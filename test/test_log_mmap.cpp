@@ -0,0 +1,197 @@
+#include "../sylar/config.h"
+#include "../sylar/fiber.h"
+#include "../sylar/log.h"
+#include "../sylar/log_mmap.h"
+#include "../sylar/macro.h"
+#include "../sylar/thread.h"
+#include "../sylar/util.h"
+
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const char* kFile = "/tmp/sylar_test_log_mmap.log";
+
+// 统计行数和文件中0字节的个数
+static void check(const char* what, const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  SYLAR_LOG_INFO(g_logger) << what << ": size=" << data.size()
+      << " lines=" << std::count(data.begin(), data.end(), '\n')
+      << " zeros=" << std::count(data.begin(), data.end(), '\0');
+}
+
+// 不是"reload line N"的行(被截断或者覆盖)的条数, 以及末尾之前的0字节个数
+static void check_reload(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  size_t end = data.find_last_not_of('\0');
+  data.resize(end == std::string::npos ? 0 : end + 1);
+  size_t lines = 0, bad = 0;
+  std::istringstream ss(data);
+  std::string line;
+  while (std::getline(ss, line)) {
+    ++lines;
+    if (line.compare(0, 12, "reload line ") || line.find_first_not_of("0123456789", 12) != std::string::npos) {
+      ++bad;
+    }
+  }
+  SYLAR_LOG_INFO(g_logger) << "reload: lines=" << lines << " bad=" << bad
+      << " zeros=" << std::count(data.begin(), data.end(), '\0');
+}
+
+// 写日志的同时反复重载"logs", 两个logger配置同一个文件, 新旧appender同时映射这个文件
+static void test_reload(int n) {
+  static const char* kReloadFile = "/tmp/sylar_test_log_mmap_reload.log";
+  unlink(kReloadFile);
+  auto load = [](const char* level) {
+    std::string yaml = std::string("logs:\n")
+        + "  - name: mmap_reload\n"
+        + "    level: " + level + "\n"
+        + "    appenders:\n"
+        + "      - type: MmapFileLogAppender\n"
+        + "        file: " + kReloadFile + "\n"
+        + "        chunk_size: 64K\n"
+        + "        formatter: \"%m%n\"\n"
+        + "  - name: mmap_reload2\n"
+        + "    level: " + level + "\n"
+        + "    appenders:\n"
+        + "      - type: MmapFileLogAppender\n"
+        + "        file: " + kReloadFile + "\n"
+        + "        formatter: \"%m%n\"\n";
+    sylar::Config::LoadFromYAML(YAML::Load(yaml));
+  };
+  load("info");
+  std::atomic<bool> done {false};
+  std::vector<sylar::Thread::ptr> threads;
+  for (int t = 0; t < 2; ++t) {
+    threads.push_back(std::make_shared<sylar::Thread>([t, n, &done]() {
+        auto logger = SYLAR_LOG_NAME(t ? "mmap_reload2" : "mmap_reload");
+        for (int i = 0; i < n / 2 || !done; ++i) {
+          SYLAR_LOG_INFO(logger) << "reload line " << i;
+        }
+      }, "mmap_reload_" + std::to_string(t)));
+  }
+  for (int i = 0; i < 200; ++i) {
+    load(i % 2 ? "info" : "debug");
+  }
+  done = true;
+  for (auto& t : threads) {
+    t->join();
+  }
+  SYLAR_LOG_NAME("mmap_reload")->clearAppender();
+  SYLAR_LOG_NAME("mmap_reload2")->clearAppender();
+  check_reload(kReloadFile);
+  unlink(kReloadFile);
+}
+
+// 一直递归到撑爆协程栈; 用volatile的开关让编译器不认为是无限递归
+static volatile bool s_recurse = true;
+static int overflow(int depth) {
+  volatile char buf[1024];
+  buf[0] = depth;
+  if (!s_recurse) {
+    return buf[0];
+  }
+  return overflow(depth + 1) + buf[0];
+}
+
+// 子进程写count行后按how结束, SIGSEGV表示协程栈溢出
+static void child(int count, int how) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    auto logger = SYLAR_LOG_NAME("mmap_child");
+    logger->addAppender(std::make_shared<sylar::MmapFileLogAppender>(kFile, 64 * 1024));
+    for (int i = 0; i < count; ++i) {
+      SYLAR_LOG_INFO(logger) << "child line " << i;
+    }
+    if (how == SIGKILL) {
+      kill(getpid(), SIGKILL);
+    } else if (how == SIGSEGV) {
+      sylar::Fiber::GetThis();
+      sylar::Fiber::ptr fiber(new sylar::Fiber([]() {overflow(0);}, 64 * 1024, true));
+      fiber->call();
+    }
+    SYLAR_ASSERT(count < 0);
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  SYLAR_LOG_INFO(g_logger) << "child exit by signal " << (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+}
+
+int main(int argc, char* argv[]) {
+  int n = argc > 1 ? atoi(argv[1]) : 200000;
+  unlink(kFile);
+
+  // 多线程写, 跨越多个窗口, 关闭时截断
+  {
+    auto logger = SYLAR_LOG_NAME("mmap");
+    auto appender = std::make_shared<sylar::MmapFileLogAppender>(kFile, 1024 * 1024, 100);
+    logger->addAppender(appender);
+    std::vector<sylar::Thread::ptr> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.push_back(std::make_shared<sylar::Thread>([logger, n]() {
+          for (int i = 0; i < n / 4; ++i) {
+            SYLAR_LOG_INFO(logger) << "line " << i;
+          }
+        }, "mmap_" + std::to_string(t)));
+    }
+    for (auto& t : threads) {
+      t->join();
+    }
+    SYLAR_LOG_INFO(g_logger) << "written " << appender->getSize() << " bytes, expect lines=" << n / 4 * 4;
+    logger->clearAppender();
+  }
+  check("closed", kFile);
+
+  // 重新打开接着写; SYLAR_ASSERT失败(SIGABRT)时截断
+  child(1000, SIGABRT);
+  check("after abort (+1000 lines)", kFile);
+
+  // kill -9来不及截断, 留下预分配的0, 下次打开时找到结尾
+  child(1000, SIGKILL);
+  check("after kill -9 (trailing zeros)", kFile);
+
+  // 协程栈溢出, 崩溃处理函数在备用栈上截断
+  child(1000, SIGSEGV);
+  check("after fiber stack overflow (+1000 lines)", kFile);
+  {
+    auto logger = SYLAR_LOG_NAME("mmap_reopen");
+    logger->addAppender(std::make_shared<sylar::MmapFileLogAppender>(kFile));
+    for (int i = 0; i < 1000; ++i) {
+      SYLAR_LOG_INFO(logger) << "reopen line " << i;
+    }
+    logger->clearAppender();
+  }
+  check("reopened (+1000 lines)", kFile);
+  SYLAR_LOG_INFO(g_logger) << "expect lines=" << n / 4 * 4 + 4000 << " zeros=0";
+
+  test_reload(n);
+
+  // 和FileLogAppender比较
+  auto bench = [n](const char* name, sylar::LogAppender::ptr appender) {
+    auto logger = SYLAR_LOG_NAME(name);
+    logger->addAppender(appender);
+    uint64_t start = sylar::GetCurrentUS();
+    for (int i = 0; i < n; ++i) {
+      SYLAR_LOG_INFO(logger) << "bench line " << i;
+    }
+    appender->flush();
+    uint64_t used = sylar::GetCurrentUS() - start;
+    logger->clearAppender();
+    SYLAR_LOG_INFO(g_logger) << name << ": " << used * 1000.0 / n << " ns/line";
+  };
+  bench("bench_file", std::make_shared<sylar::FileLogAppender>("/tmp/sylar_test_log_mmap_file.log"));
+  bench("bench_mmap", std::make_shared<sylar::MmapFileLogAppender>("/tmp/sylar_test_log_mmap_bench.log"));
+  unlink("/tmp/sylar_test_log_mmap_file.log");
+  unlink("/tmp/sylar_test_log_mmap_bench.log");
+  return 0;
+}
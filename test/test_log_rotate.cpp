@@ -0,0 +1,95 @@
+#include "../sylar/log.h"
+#include "../sylar/log_rotate.h"
+#include "../sylar/config.h"
+
+#include <dirent.h>
+#include <zlib.h>
+#include <vector>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static const char* kDir = "/tmp/sylar_test_log_rotate";
+
+static std::vector<std::string> list_dir() {
+  std::vector<std::string> files;
+  DIR* d = opendir(kDir);
+  while (dirent* e = d ? readdir(d) : nullptr) {
+    if (e->d_name[0] != '.') {
+      files.push_back(e->d_name);
+    }
+  }
+  if (d) {
+    closedir(d);
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+static size_t gz_lines(const std::string& path) {
+  gzFile f = gzopen(path.c_str(), "rb");
+  size_t lines = 0;
+  char buf[4096];
+  int n;
+  while ((n = gzread(f, buf, sizeof(buf))) > 0) {
+    lines += std::count(buf, buf + n, '\n');
+  }
+  gzclose(f);
+  return lines;
+}
+
+// 按大小切分, 保留3个并压缩
+void test_size() {
+  auto logger = SYLAR_LOG_NAME("rotate_size");
+  auto appender = std::make_shared<sylar::FileLogAppender>(std::string(kDir) + "/size.log");
+  appender->setFormatter(std::make_shared<sylar::LogFormatter>("%m%n"));
+  appender->setMaxSize(4096);
+  appender->setMaxFiles(3);
+  appender->setCompress(true);
+  logger->addAppender(appender);
+  for (int i = 0; i < 2000; ++i) {
+    SYLAR_LOG_INFO(logger) << "size rotate line " << i << " padding padding padding";
+  }
+  sylar::LogRotatorMgr::GetInstance()->wait();
+  logger->clearAppender();
+  for (auto& i : list_dir()) {
+    if (i.find(".gz") != std::string::npos) {
+      SYLAR_LOG_INFO(g_logger) << "size: " << i << " lines=" << gz_lines(std::string(kDir) + "/" + i);
+    } else {
+      SYLAR_LOG_INFO(g_logger) << "size: " << i;
+    }
+  }
+}
+
+// 按时间切分, 通过日志配置设置
+void test_time() {
+  YAML::Node root = YAML::Load(
+      "logs:\n"
+      "  - name: rotate_time\n"
+      "    level: info\n"
+      "    formatter: \"%d%T%m%n\"\n"
+      "    appenders:\n"
+      "      - type: FileLogAppender\n"
+      "        file: /tmp/sylar_test_log_rotate/time.log\n"
+      "        rotate_interval: 1\n"
+      "        max_size: 1M\n"
+      "        max_files: 10\n");
+  sylar::Config::LoadFromYAML(root);
+  auto logger = SYLAR_LOG_NAME("rotate_time");
+  for (int i = 0; i < 3; ++i) {
+    SYLAR_LOG_INFO(logger) << "time rotate " << i;
+    usleep(1000 * 1000);
+  }
+  SYLAR_LOG_INFO(g_logger) << std::endl << logger->toYamlString();
+  for (auto& i : list_dir()) {
+    if (i.compare(0, 4, "time") == 0) {
+      SYLAR_LOG_INFO(g_logger) << "time: " << i;
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  system((std::string("rm -rf ") + kDir + " && mkdir -p " + kDir).c_str());
+  test_size();
+  test_time();
+  return 0;
+}
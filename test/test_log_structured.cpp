@@ -0,0 +1,101 @@
+#include "../sylar/log.h"
+#include "../sylar/log_structured.h"
+#include "../sylar/config.h"
+#include "../sylar/util.h"
+
+#include <iostream>
+#include <random>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+enum State {CONNECTED = 3};
+
+// 逐字节的转义, 用来对照
+static void naive_json(std::string& out, const std::string& s) {
+  for (char c : s) {
+    if (c == '"') {
+      out += "\\\"";
+    } else if (c == '\\') {
+      out += "\\\\";
+    } else if (c == '\n') {
+      out += "\\n";
+    } else if (c == '\r') {
+      out += "\\r";
+    } else if (c == '\t') {
+      out += "\\t";
+    } else if ((unsigned char)c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char)c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  YAML::Node root = YAML::Load(
+      "logs:\n"
+      "  - name: json\n"
+      "    level: debug\n"
+      "    appenders:\n"
+      "      - type: StdoutLogAppender\n"
+      "        formatter: json\n"
+      "  - name: logfmt\n"
+      "    level: debug\n"
+      "    appenders:\n"
+      "      - type: StdoutLogAppender\n"
+      "        formatter: logfmt\n");
+  sylar::Config::LoadFromYAML(root);
+
+  std::string peer = "10.0.0.1:8080";
+  for (auto name : {"json", "logfmt"}) {
+    auto logger = SYLAR_LOG_NAME(name);
+    SYLAR_LOG_INFO(logger) << "accept" << sylar::kv("fd", 7) << sylar::kv("peer", peer)
+        << sylar::kv("ok", true) << sylar::kv("latency_ms", 1.25) << sylar::kv("state", CONNECTED);
+    SYLAR_LOG_WARN(logger) << "quote \" backslash \\ tab\tnewline\n ctrl\x01 utf8 中文"
+        << sylar::kv("path", "/a b/c=d") << sylar::kv("empty", "") << sylar::kv("nan", 0.0 / 0.0);
+  }
+  // 文本格式器把字段接在内容后面, 普通ostream直接输出
+  SYLAR_LOG_INFO(g_logger) << "text" << sylar::kv("fd", 7) << sylar::kv("peer", peer);
+  std::cout << "plain" << sylar::kv("fd", 7) << std::endl;
+  std::cout << "toYaml:" << std::endl << SYLAR_LOG_NAME("json")->toYamlString() << std::endl;
+
+  // 随机串和逐字节实现对照
+  std::mt19937 rng(1);
+  const char alphabet[] = "abc \"\\\n\t\x01\x1f\x7f\xe4\xb8\xad=";
+  int bad = 0;
+  for (int i = 0; i < 100000; ++i) {
+    std::string s(rng() % 40, ' ');
+    for (auto& c : s) {
+      c = alphabet[rng() % (sizeof(alphabet) - 1)];
+    }
+    std::string fast, slow;
+    sylar::LogEscape::AppendJson(fast, s);
+    naive_json(slow, s);
+    if (fast != slow) {
+      ++bad;
+    }
+  }
+  std::cout << "escape mismatches: " << bad << std::endl;
+
+  // 性能: 绝大部分内容不需要转义
+  std::string text = "GET /index.html HTTP/1.1 200 1234 bytes from 10.0.0.1 in 1.25ms user agent curl";
+  int n = argc > 1 ? atoi(argv[1]) : 2000000;
+  std::string out;
+  uint64_t start = sylar::GetCurrentUS();
+  for (int i = 0; i < n; ++i) {
+    out.clear();
+    sylar::LogEscape::AppendJson(out, text);
+  }
+  uint64_t swar = sylar::GetCurrentUS() - start;
+  start = sylar::GetCurrentUS();
+  for (int i = 0; i < n; ++i) {
+    out.clear();
+    naive_json(out, text);
+  }
+  uint64_t naive = sylar::GetCurrentUS() - start;
+  std::cout << "escape " << text.size() << " bytes: swar " << swar * 1000.0 / n
+            << " ns, bytewise " << naive * 1000.0 / n << " ns" << std::endl;
+  return 0;
+}
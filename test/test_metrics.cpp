@@ -0,0 +1,48 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+#include "../sylar/fd_manager.h"
+#include "../sylar/metrics.h"
+
+#include <sys/socket.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static void echo_pair(int rounds) {
+  int fds[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  sylar::FdMgr::GetInstance()->get(fds[0], true);
+  sylar::FdMgr::GetInstance()->get(fds[1], true);
+  sylar::IOManager::GetThis()->schedule([fds, rounds]() {
+    char c;
+    for (int i = 0; i < rounds && recv(fds[1], &c, 1, 0) == 1; ++i) {
+      send(fds[1], &c, 1, 0);
+    }
+    close(fds[1]);
+  });
+  char c = 'x';
+  for (int i = 0; i < rounds; ++i) {
+    send(fds[0], &c, 1, 0);
+    recv(fds[0], &c, 1, 0);
+  }
+  close(fds[0]);
+}
+
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  sylar::Config::Lookup<uint64_t>("metrics.dump_interval_ms")->setValue(200);
+
+  sylar::IOManager iom(2, false, "metrics");
+  for (int i = 0; i < 4; ++i) {
+    iom.schedule(std::bind(echo_pair, 1000));
+  }
+  iom.schedule([]() {
+    for (int i = 0; i < 5; ++i) {
+      usleep(100 * 1000);
+    }
+  });
+  auto timer = iom.addTimer(1000, []() {}, true);
+  usleep(600 * 1000);
+  SYLAR_LOG_INFO(g_logger) << "snapshot: " << sylar::MetricsMgr::GetInstance()->snapshot().toString();
+  timer->cancel();
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+#include "../sylar/parallel.h"
+
+#include <cmath>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static double heavy(size_t i) {
+  double v = i;
+  for (int k = 0; k < 200; ++k) {
+    v = std::sqrt(v + k);
+  }
+  return v;
+}
+
+void test_parallel(sylar::IOManager* iom) {
+  static const size_t N = 1000000;
+  std::vector<double> data(N);
+
+  uint64_t begin = sylar::GetCurrentUS();
+  for (size_t i = 0; i < N; ++i) {
+    data[i] = heavy(i);
+  }
+  double serial = 0;
+  for (auto& i : data) {
+    serial += i;
+  }
+  uint64_t serial_us = sylar::GetCurrentUS() - begin;
+
+  begin = sylar::GetCurrentUS();
+  sylar::parallel_for<size_t>(0, N, 10000, [&data](size_t b, size_t e) {
+      for (size_t i = b; i < e; ++i) {
+        data[i] = heavy(i);
+      }
+    });
+  double sum = sylar::parallel_reduce<size_t>(0, N, 10000, 0.0,
+      [&data](size_t b, size_t e) {
+        double s = 0;
+        for (size_t i = b; i < e; ++i) {
+          s += data[i];
+        }
+        return s;
+      }, [](double a, double b) {return a + b;});
+  uint64_t parallel_us = sylar::GetCurrentUS() - begin;
+
+  SYLAR_LOG_INFO(g_logger) << "threads=" << iom->getThreadCount()
+      << " serial=" << serial << " " << serial_us << "us"
+      << " parallel=" << sum << " " << parallel_us << "us";
+
+  // 结果为bool时每一段也各有自己的槽位
+  bool all_positive = sylar::parallel_reduce<size_t, bool>(0, N, 10000, true,
+      [&data](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) {
+          if (!(data[i] > 0)) {
+            return false;
+          }
+        }
+        return true;
+      }, [](bool a, bool b) {return a && b;});
+  SYLAR_LOG_INFO(g_logger) << "all positive=" << all_positive;
+
+  try {
+    sylar::parallel_for<int>(0, 100, 1, [](int b, int e) {
+        if (b == 42) {
+          throw std::runtime_error("bad item 42");
+        }
+      });
+  } catch (std::exception& e) {
+    SYLAR_LOG_INFO(g_logger) << "parallel_for exception: " << e.what();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+  sylar::IOManager iom(4, false, "parallel");
+  iom.schedule(std::bind(test_parallel, &iom));
+  return 0;
+}
@@ -0,0 +1,80 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+static void busy_ms(int ms) {
+  uint64_t end = sylar::GetCurrentUS() + ms * 1000;
+  while (sylar::GetCurrentUS() < end);
+}
+
+void test_priority(sylar::IOManager* iom) {
+  for (int i = 0; i < 100; ++i) {
+    iom->schedule([]() {busy_ms(1);}, sylar::Scheduler::BACKGROUND);
+  }
+  uint64_t begin = sylar::GetCurrentMS();
+  iom->schedule([begin]() {
+    SYLAR_LOG_INFO(g_logger) << "normal task delay=" << sylar::GetCurrentMS() - begin << "ms";
+  });
+  iom->schedule([begin]() {
+    SYLAR_LOG_INFO(g_logger) << "high task delay=" << sylar::GetCurrentMS() - begin << "ms";
+  }, sylar::Scheduler::HIGH);
+  SYLAR_LOG_INFO(g_logger) << "queue depth high=" << iom->getQueueDepth(sylar::Scheduler::HIGH)
+      << " normal=" << iom->getQueueDepth(sylar::Scheduler::NORMAL)
+      << " background=" << iom->getQueueDepth(sylar::Scheduler::BACKGROUND);
+}
+
+// 高优先级任务源源不断时, 后台任务也不会被饿死
+void test_starvation(sylar::IOManager* iom) {
+  static int high_runs = 0;
+  iom->schedule([]() {
+    SYLAR_LOG_INFO(g_logger) << "background task ran after " << high_runs << " high tasks";
+  }, sylar::Scheduler::BACKGROUND);
+  std::function<void()> high;
+  high = [iom, &high]() {
+    if (++high_runs < 100) {
+      iom->schedule(high, sylar::Scheduler::HIGH);
+    }
+  };
+  iom->schedule(high, sylar::Scheduler::HIGH);
+  iom->schedule(high, sylar::Scheduler::HIGH);
+  // 等所有任务跑完, high引用的是本函数的局部变量
+  while (high_runs < 100) {
+    usleep(10 * 1000);
+  }
+}
+
+// 高优先级的协程让出后仍然在高优先级队列, 不会排到普通任务后面
+void test_yield(sylar::IOManager* iom) {
+  static std::atomic<int> normal_runs {0};
+  iom->schedule([]() {
+    int before = normal_runs;
+    sylar::Fiber::YieldToReady();
+    SYLAR_LOG_INFO(g_logger) << "high task resumed after yield, normal ran in between="
+        << normal_runs - before;
+  }, sylar::Scheduler::HIGH);
+  for (int i = 0; i < 50; ++i) {
+    iom->schedule([]() {
+      busy_ms(1);
+      ++normal_runs;
+    });
+  }
+}
+
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+  {
+    sylar::IOManager iom(1, false, "priority");
+    iom.schedule(std::bind(test_priority, &iom));
+  }
+  {
+    sylar::IOManager iom(1, false, "yield");
+    iom.schedule(std::bind(test_yield, &iom));
+  }
+  {
+    sylar::IOManager iom(1, false, "starvation");
+    iom.schedule(std::bind(test_starvation, &iom));
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+#include "../sylar/fd_manager.h"
+#include "../sylar/task_group.h"
+
+#include <sys/socket.h>
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// 创建一对没有数据的socket, 在上面recv会一直阻塞
+static int make_idle_socket() {
+  int fds[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  sylar::FdMgr::GetInstance()->get(fds[0], true);
+  sylar::FdMgr::GetInstance()->get(fds[1], true);
+  return fds[0];
+}
+
+void blocked_recv(const std::string& name) {
+  int fd = make_idle_socket();
+  char buf[16];
+  uint64_t begin = sylar::GetCurrentMS();
+  int rt = recv(fd, buf, sizeof(buf), 0);
+  int err = errno;
+  SYLAR_LOG_INFO(g_logger) << name << " recv rt=" << rt << " errno=" << err
+      << " (" << strerror(err) << ") used=" << sylar::GetCurrentMS() - begin << "ms";
+}
+
+void test_fail_fast() {
+  sylar::IOManager iom(2, false, "tg");
+  iom.schedule([]() {
+    sylar::TaskGroup group;
+    group.spawn(std::bind(blocked_recv, "child_1"));
+    group.spawn(std::bind(blocked_recv, "child_2"));
+    group.spawn([]() {
+      usleep(50 * 1000);
+      throw std::runtime_error("child_3 failed");
+    });
+    try {
+      group.wait();
+    } catch (std::exception& e) {
+      SYLAR_LOG_INFO(g_logger) << "group failed: " << e.what();
+    }
+  });
+}
+
+void test_deadline() {
+  sylar::IOManager iom(2, false, "tg_deadline");
+  iom.schedule([]() {
+    uint64_t begin = sylar::GetCurrentMS();
+    // 一个截止时间覆盖所有子任务, 不需要给每次调用设置超时
+    sylar::TaskGroup group(100);
+    group.spawn(std::bind(blocked_recv, "io"));
+    group.spawn([]() {
+      int rt = usleep(1000 * 1000);
+      int err = errno;
+      SYLAR_LOG_INFO(g_logger) << "sleep rt=" << rt << " errno=" << err;
+    });
+    group.spawn([]() {
+      // 嵌套的任务组随外层一起取消
+      sylar::TaskGroup inner;
+      inner.spawn(std::bind(blocked_recv, "nested"));
+      inner.wait();
+    });
+    int rt = group.wait();
+    SYLAR_LOG_INFO(g_logger) << "group done rt=" << rt << " (" << strerror(rt)
+        << ") used=" << sylar::GetCurrentMS() - begin << "ms";
+  });
+}
+
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+  test_fail_fast();
+  test_deadline();
+  return 0;
+}
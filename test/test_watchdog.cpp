@@ -0,0 +1,71 @@
+#include "../sylar/sylar.h"
+#include "../sylar/iomanager.h"
+#include "../sylar/watchdog.h"
+
+static sylar::Logger::ptr g_logger = SYLAR_LOG_ROOT();
+
+// 忙等ms毫秒, preemptible为true时在循环中检查抢占标记
+static void busy_loop(uint64_t ms, bool preemptible) {
+  uint64_t begin = sylar::GetCurrentMS();
+  while (sylar::GetCurrentMS() - begin < ms) {
+    if (preemptible) {
+      sylar::check_preempt();
+    }
+  }
+  SYLAR_LOG_INFO(g_logger) << "busy loop " << ms << "ms preemptible=" << preemptible << " done";
+}
+
+// 单线程调度器上, 忙等的协程之后提交的任务要多久才能执行
+static void run_case(bool preemptible) {
+  sylar::IOManager iom(1, false, "watchdog");
+  uint64_t begin = sylar::GetCurrentMS();
+  iom.schedule(std::bind(busy_loop, 300, preemptible));
+  iom.schedule([begin, preemptible]() {
+    SYLAR_LOG_INFO(g_logger) << "preemptible=" << preemptible
+        << " other task started after " << sylar::GetCurrentMS() - begin << "ms";
+  });
+}
+
+static void slow_handler() {
+  uint64_t begin = sylar::GetCurrentMS();
+  while (sylar::GetCurrentMS() - begin < 40);
+}
+
+// 慢任务和事件循环卡顿: 同一个回调多次超过阈值, 按回调汇总
+static void run_slow_tasks() {
+  sylar::Config::Lookup<bool>("watchdog.enable")->setValue(false);
+  sylar::Config::Lookup<uint64_t>("watchdog.slow_task_ms")->setValue(20);
+  sylar::Config::Lookup<uint64_t>("watchdog.loop_stall_ms")->setValue(50);
+  {
+    sylar::IOManager iom(1, false, "slow");
+    for (int i = 0; i < 3; ++i) {
+      iom.schedule(&slow_handler);
+    }
+    iom.schedule([]() {
+      usleep(10 * 1000);
+      uint64_t begin = sylar::GetCurrentMS();
+      // 定时器唤醒后阻塞事件循环
+      while (sylar::GetCurrentMS() - begin < 60);
+    });
+  }
+  for (auto& i : sylar::WatchdogMgr::GetInstance()->getSlowSites()) {
+    SYLAR_LOG_INFO(g_logger) << "slow site " << i.name << " count=" << i.count
+        << " total=" << i.totalUs / 1000 << "ms max=" << i.maxUs / 1000 << "ms";
+  }
+  for (auto& i : sylar::WatchdogMgr::GetInstance()->getStallSites()) {
+    SYLAR_LOG_INFO(g_logger) << "stall site " << i.name << " count=" << i.count
+        << " total=" << i.totalUs / 1000 << "ms max=" << i.maxUs / 1000 << "ms";
+  }
+}
+
+int main(int argc, char* argv[]) {
+  g_logger->setLevel(sylar::LogLevel::INFO);
+  SYLAR_LOG_NAME("system")->setLevel(sylar::LogLevel::WARN);
+  sylar::Config::Lookup<uint64_t>("watchdog.threshold_ms")->setValue(50);
+  sylar::Config::Lookup<bool>("watchdog.enable")->setValue(true);
+
+  run_case(false);
+  run_case(true);
+  run_slow_tasks();
+  return 0;
+}
@@ -0,0 +1,31 @@
+// 把BinaryFileLogAppender写的二进制日志还原成文本
+// 用法: log_decoder file...
+
+#include "../sylar/log_binary.h"
+
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " file..." << std::endl;
+    return 1;
+  }
+  int rt = 0;
+  std::string line;
+  for (int i = 1; i < argc; ++i) {
+    sylar::BinaryLogReader reader;
+    if (!reader.open(argv[i])) {
+      std::cerr << reader.getError() << std::endl;
+      rt = 1;
+      continue;
+    }
+    while (reader.next(line)) {
+      std::cout << line << '\n';
+    }
+    if (!reader.getError().empty()) {
+      std::cerr << argv[i] << ": " << reader.getError() << std::endl;
+      rt = 1;
+    }
+  }
+  return rt;
+}